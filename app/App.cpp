@@ -1,3 +1,4 @@
+#include <Common/Config.hpp>
 #include <Common/Globals.hpp>
 #include <Common/Utils.hpp>
 #include <Functional/Function.hpp>
@@ -12,27 +13,160 @@
 #include <httpparser/request.h>
 #include <iostream>
 #include <thread>
+#include <unistd.h>
 #include <unordered_map>
 
 using namespace httpparser;
 using namespace proxy;
 
+static void PrintUsage(const char *Name) {
+  std::cerr << "Usage: " << Name
+            << " [-b poll|epoll|uring] [-r] [-H HOSTS] [-n NAMESERVER] "
+               "[-m SIZE[K|M|G]] [-e lru|slru|tinylfu] [-B SIZE[K|M]] "
+               "[-d DIR] [-D SIZE[K|M|G]] [-w SEC] PORT [WORKERS]"
+            << std::endl;
+}
+
+static bool ParsePollerType(const std::string &Name, PollerType &Type) {
+  if (Name == "poll")
+    Type = PollerType::Poll;
+  else if (Name == "epoll")
+    Type = PollerType::Epoll;
+  else if (Name == "uring")
+    Type = PollerType::IoUring;
+  else
+    return false;
+  return true;
+}
+
+static bool ParseEvictionPolicy(const std::string &Name,
+                                EvictionPolicyType &Type) {
+  if (Name == "lru")
+    Type = EvictionPolicyType::LRU;
+  else if (Name == "slru")
+    Type = EvictionPolicyType::SLRU;
+  else if (Name == "tinylfu")
+    Type = EvictionPolicyType::TinyLFU;
+  else
+    return false;
+  return true;
+}
+
+static bool ParseSize(std::string Str, std::size_t &Size) {
+  std::size_t Multiplier = 1;
+  if (!Str.empty()) {
+    switch (std::toupper(static_cast<unsigned char>(Str.back()))) {
+    case 'K':
+      Multiplier = std::size_t(1) << 10;
+      break;
+    case 'M':
+      Multiplier = std::size_t(1) << 20;
+      break;
+    case 'G':
+      Multiplier = std::size_t(1) << 30;
+      break;
+    }
+    if (Multiplier != 1)
+      Str.pop_back();
+  }
+  if (!Utils::StrToInt<std::size_t>(Size, Str))
+    return false;
+  Size *= Multiplier;
+  return true;
+}
+
 int main(int argc, char const *argv[]) {
-  if (argc != 2) {
-    std::cerr << "Expected a port argument" << std::endl;
+  Config Cfg;
+  int Opt;
+  while ((Opt = getopt(argc, const_cast<char *const *>(argv), "b:rH:n:m:e:B:d:D:w:")) != -1) {
+    switch (Opt) {
+    case 'b':
+      if (!ParsePollerType(optarg, Cfg.Poller)) {
+        std::cerr << "Unknown poller backend " << optarg << std::endl;
+        return 1;
+      }
+      break;
+    case 'r':
+      Cfg.ReusePort = true;
+      break;
+    case 'H':
+      Cfg.HostsFile = optarg;
+      break;
+    case 'n':
+      Cfg.NameServer = optarg;
+      break;
+    case 'm':
+      if (!ParseSize(optarg, Cfg.CacheSize)) {
+        std::cerr << "Invalid cache size " << optarg << std::endl;
+        return 1;
+      }
+      break;
+    case 'e':
+      if (!ParseEvictionPolicy(optarg, Cfg.CachePolicy)) {
+        std::cerr << "Unknown eviction policy " << optarg << std::endl;
+        return 1;
+      }
+      break;
+    case 'B':
+      if (!ParseSize(optarg, Cfg.MaxCacheBlockSize) ||
+          Cfg.MaxCacheBlockSize < Globals::MinCacheBlockSize ||
+          Cfg.MaxCacheBlockSize > Globals::CacheBlockSizeLimit) {
+        std::cerr << "Invalid cache block size " << optarg << std::endl;
+        return 1;
+      }
+      break;
+    case 'd':
+      Cfg.DiskCacheDir = optarg;
+      break;
+    case 'D':
+      if (!ParseSize(optarg, Cfg.DiskCacheSize)) {
+        std::cerr << "Invalid disk cache size " << optarg << std::endl;
+        return 1;
+      }
+      break;
+    case 'w':
+      if (!Utils::StrToInt<std::size_t>(Cfg.StaleWhileRevalidateSec,
+                                        std::string(optarg))) {
+        std::cerr << "Invalid stale period " << optarg << std::endl;
+        return 1;
+      }
+      break;
+    default:
+      PrintUsage(argv[0]);
+      return 1;
+    }
+  }
+
+  int ArgsNum = argc - optind;
+  if (ArgsNum != 1 && ArgsNum != 2) {
+    PrintUsage(argv[0]);
+    return 1;
+  }
+  const char *const *Args = argv + optind;
+
+  if (!Utils::StrToInt<uint16_t>(Cfg.Port, std::string(Args[0]))) {
+    std::cerr << "Couldn't convert " << Args[0] << " to a number" << std::endl;
     return 1;
   }
 
-  uint16_t Port;
-  if (!Utils::StrToInt<uint16_t>(Port, std::string(argv[1]))) {
-    std::cerr << "Couldn't convert " << argv[1] << " to a number" << std::endl;
+  if (ArgsNum == 2 &&
+      !Utils::StrToInt<std::size_t>(Cfg.WorkersNum, std::string(Args[1]))) {
+    std::cerr << "Couldn't convert " << Args[1] << " to a number" << std::endl;
     return 1;
   }
 
   Log::DefaultLogger.SetMinimumLevel(Log::Level::Fatal);
   Log::DefaultLogger.SetThreadInfoEnabled(true);
 
-  auto Srv = std::make_unique<Server>(Port);
+  // Bad name servers, cache directories and ports only show up here
+  std::unique_ptr<Server> Srv;
+  try {
+    Srv = std::make_unique<Server>(Cfg);
+  } catch (const std::exception &E) {
+    std::cerr << "Couldn't start the proxy: " << E.what() << std::endl;
+    return 1;
+  }
+
   try {
     Thread SrvThread(Function(&Server::Start, Srv.get()));
     Utils::BlockInterruptionSignals();
@@ -0,0 +1,67 @@
+#pragma once
+#include <Parallel/Mutex.hpp>
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+namespace proxy {
+struct BlockAllocatorStats {
+  std::size_t SlabsNum;
+  std::size_t SlotsNum;
+  std::size_t UsedSlotsNum;
+  // Memory mapped for the slabs
+  std::size_t Size;
+};
+
+// Hands out fixed-size slots carved from large slabs. Every thread keeps a
+// small list of free slots, it's refilled from and drained into the shared
+// list in batches, so most allocations take no lock. Slabs are unmapped only
+// along with the allocator.
+class BlockAllocator {
+private:
+  struct FreeSlot {
+    FreeSlot *Next;
+  };
+
+  struct ThreadCache {
+    BlockAllocator *Owner = nullptr;
+    FreeSlot *Head = nullptr;
+    std::size_t Num = 0;
+
+    ~ThreadCache();
+  };
+
+  std::size_t Idx;
+  std::size_t SlotSize;
+  std::size_t SlabSize;
+  std::size_t SlotsPerSlab;
+  // Free slots moved between a thread and the shared list at once
+  std::size_t BatchNum;
+  // Guards the fields below
+  Mutex Lock;
+  std::vector<char *> Slabs;
+  // Slots of the newest slab that were never handed out
+  char *SlabCursor = nullptr;
+  char *SlabEnd = nullptr;
+  FreeSlot *FreeSlots = nullptr;
+  std::atomic<std::size_t> UsedSlotsNum{0};
+
+  ThreadCache &GetThreadCache();
+  void Refill(ThreadCache &TC);
+  void Drain(ThreadCache &TC, std::size_t Num);
+  void MapSlab();
+
+public:
+  explicit BlockAllocator(std::size_t SlotSize);
+  BlockAllocator(const BlockAllocator &) = delete;
+  BlockAllocator &operator=(const BlockAllocator &) = delete;
+
+  // Throws std::bad_alloc if no memory can be mapped
+  void *Allocate();
+  void Deallocate(void *Slot);
+  std::size_t GetSlotSize() const;
+  BlockAllocatorStats GetStats();
+
+  ~BlockAllocator();
+};
+} // namespace proxy
@@ -1,27 +1,104 @@
 #pragma once
 #include <Cache/CacheListener.hpp>
 #include <Cache/CacheRecord.hpp>
-#include <Parallel/ReadWriteLock.hpp>
-#include <set>
+#include <Cache/DiskCache.hpp>
+#include <Cache/EvictionPolicy.hpp>
+#include <Common/Config.hpp>
+#include <Common/Globals.hpp>
+#include <Parallel/Mutex.hpp>
+#include <atomic>
+#include <memory>
 #include <unordered_map>
 
 namespace proxy {
+struct CacheStats {
+  std::size_t Size;
+  std::size_t RecordsNum;
+  std::size_t EvictionsNum;
+};
+
+// Records are evicted once the cache outgrows its memory budget. Records
+// that are still being downloaded are never evicted, the ones being read
+// are dropped from the index and freed when their readers are done.
+// The index is split into shards by the key hash, every shard has its own
+// lock and eviction policy, so requests for different keys rarely contend.
+// A stale record is replaced with a new one on the next request, which
+// revalidates the stale one if it can. Within its stale window the stale
+// record keeps being served instead, while a single refresh downloads the
+// new one aside and swaps it in once it's complete.
+// With a disk tier, a few records too large for memory are downloaded
+// outside the memory budget and moved to disk once they're complete.
 class Cache {
 private:
-  ReadWriteLock RecordsLock;
-  ReadWriteLock URIListenersLock;
-  std::unordered_map<std::string, CacheRecord *> Records;
-  std::unordered_map<std::string, std::set<CacheListener *>> URIListeners;
+  struct Entry {
+    // Holds the index reference
+    CacheRecord *Record;
+    // Memory charged for the record
+    std::size_t Size;
+    // Replacement being downloaded in the background, holds a reference
+    CacheRecord *Refresh = nullptr;
+    // Too large for memory, isn't charged beyond its overhead
+    bool IsSpilling = false;
+  };
+
+  struct alignas(Globals::CacheLineSize) Shard {
+    Mutex Lock;
+    std::unordered_map<std::string, Entry> Records;
+    std::unique_ptr<EvictionPolicy> Policy;
+    std::size_t EvictionsNum = 0;
+  };
+
+  static_assert((Globals::CacheShardsNum & (Globals::CacheShardsNum - 1)) == 0,
+                "Number of cache shards must be a power of two");
+
+  std::unique_ptr<Shard[]> Shards;
+  std::size_t Capacity;
+  std::size_t MaxRecordSize;
+  // Evicted records go there if set
+  DiskCache *Disk;
+  std::atomic<std::size_t> UsedSize{0};
+  // Shards are evicted from in turns
+  std::atomic<std::size_t> EvictionCursor{0};
+  std::atomic<std::size_t> SpillingNum{0};
+
+  static std::size_t GetKeyHash(const std::string &URI);
+  Shard &GetShard(std::size_t KeyHash);
+  // Called with the shard lock held. Returns the record to be served and
+  // sets Download to the one to be downloaded, if there's any. Returns
+  // null if the request can't share the record being downloaded.
+  CacheRecord *GetOrCreateRecord(Shard &S, const std::string &URI,
+                                 std::size_t KeyHash,
+                                 CacheRecordPtr &Download);
+  void DropRefresh(Entry &E);
+  // Called with the shard lock held, returns false if the record can't be
+  // spilled to disk
+  bool StartSpill(const std::string &URI, Shard &S, Entry &E);
+  void EvictFrom(Shard &S);
+  void Evict();
 
 public:
-  Cache() = default;
+  Cache(std::size_t Capacity, EvictionPolicyType PolicyType,
+        DiskCache *Disk = nullptr);
 
-  void PutRecord(const std::string &URI, CacheRecord *Record);
-  void AddListener(const std::string &URI, CacheListener *Listener);
-  void RemoveListener(const std::string &URI, CacheListener *Listener);
+  // Attaches the listener to the record, creating the record if there's
+  // no fresh one. Download is set to the record that has to be downloaded,
+  // either the created one or the refresh of a stale one, if there's any.
+  // The listener is detached through the record it was notified about.
+  // Returns false without attaching it if the record is being downloaded
+  // and isn't known to be shareable yet, the request has to bypass the
+  // cache then.
+  bool AddListener(const std::string &URI, CacheListener *Listener,
+                   CacheRecordPtr &Download);
   bool HasRecord(const std::string &URI);
-  CacheRecord *TryGetRecord(const std::string &URI);
-  CacheRecord *GetRecord(const std::string &URI);
+  // Accounts for the record growth, returns false if the record has become
+  // too large to be cached. With a disk tier a record too large for memory
+  // keeps being downloaded to be written to disk instead.
+  bool ChargeRecord(CacheRecord *Record, std::size_t Size);
+  // Swaps the finished refresh in for the stale record if it's complete
+  void CommitRefresh(CacheRecord *Record);
+  // Moves the finished spilling record from memory to the disk tier
+  void CommitSpill(CacheRecord *Record);
+  CacheStats GetStats();
 
   ~Cache();
 };
@@ -1,22 +1,57 @@
 #pragma once
-#include <vector>
-#include <Parallel/Mutex.hpp>
+#include <Cache/BlockAllocator.hpp>
+#include <Common/Globals.hpp>
+#include <atomic>
+#include <cstddef>
+#include <memory>
 
 namespace proxy {
+// A block takes a single allocator slot, its bytes follow the header. Slots
+// come in power of two sizes. The record writer may keep appending bytes to
+// the last block until it's full, the size, the link to the next block and
+// the final flag are published atomically. A block with the next one linked
+// or marked final doesn't change anymore.
 class CacheBlock {
 private:
-  std::vector<char> Bytes;
-  Mutex IsFinalMutex;
-  bool _IsFinal = false;
+  std::atomic<CacheBlock *> Next{nullptr};
+  std::atomic<std::size_t> Size{0};
+  std::atomic<bool> _IsFinal{false};
+  std::size_t ClassIdx;
+
+  explicit CacheBlock(std::size_t ClassIdx) : ClassIdx(ClassIdx) {}
+  ~CacheBlock() = default;
 
 public:
-  explicit CacheBlock(std::size_t Capacity = 0) : Bytes() {Bytes.reserve(Capacity);}
+  static constexpr std::size_t HeaderSize = Globals::CacheLineSize;
+
+  // Returns a block with room for at least MinCapacity bytes, or the
+  // largest one. Throws std::bad_alloc if there's no memory left.
+  static CacheBlock *Create(std::size_t MinCapacity);
+  static void Destroy(CacheBlock *Block);
+  // Summed over all block sizes
+  static BlockAllocatorStats GetAllocatorStats();
+
+  CacheBlock(const CacheBlock &) = delete;
+  CacheBlock &operator=(const CacheBlock &) = delete;
 
-  std::vector<char> &GetBytes();
-  const std::vector<char> &GetBytes() const;
+  char *GetData();
+  const char *GetData() const;
+  std::size_t GetSize() const;
+  // Publishes Size bytes written past the end of the block data
+  void Grow(std::size_t Size);
+  std::size_t GetCapacity() const;
+  std::size_t GetFreeSpace() const;
+  // Memory taken by the block, including the unused capacity
+  std::size_t GetMemorySize() const;
+  CacheBlock *GetNext() const;
+  void SetNext(CacheBlock *Block);
   void SetFinal(bool Final);
-  bool IsFinal();
+  bool IsFinal() const;
+};
 
-  ~CacheBlock() = default;
+struct CacheBlockDeleter {
+  void operator()(CacheBlock *Block) const { CacheBlock::Destroy(Block); }
 };
+
+using CacheBlockPtr = std::unique_ptr<CacheBlock, CacheBlockDeleter>;
 } // namespace proxy
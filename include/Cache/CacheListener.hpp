@@ -1,12 +1,45 @@
 #pragma once
-#include <Cache/CacheRecord.hpp>
+#include <atomic>
+#include <cstddef>
 
 namespace proxy {
 class CacheRecord;
+class CacheListener;
+
+// Delivers record updates to the listeners served by a single thread. A
+// batch of listeners costs a single wakeup of the thread.
+class CacheWakeupQueue {
+public:
+  // Queues the listeners that aren't queued yet, can be called from any
+  // thread
+  virtual void WakeupListeners(CacheListener *const *Listeners,
+                               std::size_t Num) = 0;
+  virtual ~CacheWakeupQueue() = default;
+};
 
 class CacheListener {
+private:
+  // Set while the listener is queued, the updates coming meanwhile are
+  // handled by the same wakeup
+  std::atomic<bool> IsWakeupPending{false};
+
 public:
-  virtual void OnCacheRecordUpdate(CacheRecord *Record) = 0;
+  // Called once the listener is attached to the record
+  virtual void OnCacheRecordAttach(CacheRecord *Record) = 0;
+  // Called on the queue thread after the record got new data
+  virtual void OnCacheWakeup() = 0;
+  virtual CacheWakeupQueue *GetWakeupQueue() = 0;
+
+  // Returns false if the listener is queued already
+  bool MarkWakeupPending() {
+    return !IsWakeupPending.exchange(true, std::memory_order_acq_rel);
+  }
+  // Called by the queue before OnCacheWakeup(), so that the data published
+  // before the last update is visible
+  void ClearWakeupPending() {
+    IsWakeupPending.exchange(false, std::memory_order_acq_rel);
+  }
+
   virtual ~CacheListener() = default;
 };
 } // namespace proxy
@@ -1,45 +1,114 @@
 #pragma once
 #include <Cache/CacheBlock.hpp>
 #include <Cache/CacheListener.hpp>
+#include <Cache/Freshness.hpp>
+#include <Common/RefPtr.hpp>
 #include <Parallel/Mutex.hpp>
-#include <deque>
-#include <set>
+#include <atomic>
 #include <string>
+#include <utility>
+#include <vector>
 
 namespace proxy {
+class Cache;
 class CacheListener;
 
-class CacheRecord {
+// Block state as seen by a reader at some point
+struct CacheBlockSpan {
+  CacheBlock *Block;
+  std::size_t Size;
+  // The block won't grow anymore
+  bool IsSealed;
+  bool IsFinal;
+};
+
+// Records are shared by the cache index, the downloading remote and the
+// clients streaming them, each holding a reference. An evicted record is
+// freed once the last reader lets it go. Blocks live as long as their record.
+// The remote handler is the only writer, it fills the last block and
+// appends new ones to a singly linked chain, publishing them with release
+// stores, so readers never take a lock to walk the chain.
+// A stale record is replaced with a new one that revalidates it. If the
+// origin says it's not modified, the new record serves the stale one's
+// blocks instead of its own.
+class CacheRecord : public RefCounted<CacheRecord> {
 private:
   std::string Address;
-  std::deque<CacheBlock *> Blocks;
-  std::set<CacheListener *> Listeners;
-  std::size_t TotalSize = 0;
-  Mutex BlocksMutex;
+  // Charged for the record memory, may be null
+  Cache *Owner;
+  // Hash of the address, picks the cache shard
+  std::size_t KeyHash;
+  // Downloaded aside and swapped in for a stale record once finished
+  bool IsRefresh;
+  // Outgrew the memory budget, goes to the disk tier once finished
+  bool IsSpilling = false;
+  std::atomic<CacheBlock *> FirstBlock{nullptr};
+  // Only used by the writer
+  CacheBlock *LastBlock = nullptr;
+  std::size_t MemorySize = 0;
+  // Record holding the blocks if this one was revalidated
+  std::atomic<CacheRecord *> Source{nullptr};
+  // Record being revalidated, until the writer takes it
+  RefPtr<CacheRecord> Stale;
+  // Set by the writer before the record is finished
+  Freshness Fresh;
+  // Grouped by the queue waking them up, so that an update costs a single
+  // wakeup per queue
+  std::vector<std::pair<CacheWakeupQueue *, std::vector<CacheListener *>>>
+      Listeners;
   Mutex ListenersMutex;
-  Mutex TotalSizeMutex;
-  Mutex IsFinishedMutex;
-  Mutex IsCompleteMutex;
-  bool _IsFinished = false;
-  bool _IsComplete = false;
+  std::atomic<std::size_t> TotalSize{0};
+  std::atomic<bool> _HasFreshness{false};
+  std::atomic<bool> _IsFinished{false};
+  std::atomic<bool> _IsComplete{false};
 
   void NotifyRecordUpdate();
 
+  friend class RefCounted<CacheRecord>;
+  ~CacheRecord();
+
 public:
-  explicit CacheRecord(std::string Address) : Address(std::move(Address)) {}
+  explicit CacheRecord(std::string Address, Cache *Owner = nullptr,
+                       std::size_t KeyHash = 0, bool IsRefresh = false)
+      : Address(std::move(Address)), Owner(Owner), KeyHash(KeyHash),
+        IsRefresh(IsRefresh) {}
 
-  void AppendBlock(CacheBlock *Block);
+  const std::string &GetAddress() const;
+  std::size_t GetKeyHash() const;
+  // Returns false if the record has outgrown the cache and shouldn't be
+  // appended to anymore
+  bool AppendBlock(CacheBlock *Block);
+  // Only for the writer
+  CacheBlock *GetLastBlock();
+  // Publishes Size bytes written to the free space of the last block
+  void GrowLastBlock(std::size_t Size);
   void AddListener(CacheListener *Listener);
   void RemoveListener(CacheListener *Listener);
-  CacheBlock *GetBlock(std::size_t Idx);
-  std::size_t GetNumBlocks();
-  bool HasBlock(std::size_t Idx);
+  // Fills Out with up to MaxNum blocks following After, or the first ones
+  // if it's null, returns their number
+  std::size_t GetBlocks(const CacheBlock *After, CacheBlockSpan *Out,
+                        std::size_t MaxNum);
+  // Called before the record is published
+  void SetStale(RefPtr<CacheRecord> Record);
+  RefPtr<CacheRecord> TakeStale();
+  // Set once, when the response headers are parsed
+  void SetFreshness(Freshness NewFresh);
+  bool HasFreshness() const;
+  // Only valid once HasFreshness() is true or the record is finished
+  const Freshness &GetFreshness() const;
+  // Makes the record serve the blocks of the finished record, which was
+  // found to be still valid. Returns false like AppendBlock.
+  bool ServeFrom(CacheRecord *Validated);
   void Finish();
-  bool IsFinished();
+  bool IsFinished() const;
   void SetComplete(bool Complete);
-  bool IsComplete();
-  std::size_t GetTotalSize();
-
-  ~CacheRecord();
+  bool IsComplete() const;
+  std::size_t GetTotalSize() const;
+  // Only for the writer
+  std::size_t GetMemorySize() const;
+  // Called by the cache while charging the writer
+  void SetSpilling();
 };
+
+using CacheRecordPtr = RefPtr<CacheRecord>;
 } // namespace proxy
@@ -0,0 +1,99 @@
+#pragma once
+#include <Cache/CacheRecord.hpp>
+#include <Cache/DiskJournal.hpp>
+#include <Cache/DiskSegment.hpp>
+#include <Parallel/Mutex.hpp>
+#include <Parallel/ThreadPool.hpp>
+#include <atomic>
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace proxy {
+struct DiskCacheEntry {
+  DiskSegmentPtr Segment;
+  uint64_t Offset = 0;
+  std::size_t Size = 0;
+  uint64_t DataChecksum = 0;
+  int64_t ExpiresAt = 0;
+  // Validators of the stored response, empty if it has none
+  std::string ETag;
+  std::string LastModified;
+};
+
+struct DiskCacheStats {
+  std::size_t Size;
+  std::size_t RecordsNum;
+  std::size_t SegmentsNum;
+  std::size_t WritesNum;
+  std::size_t HitsNum;
+};
+
+// Second cache tier for complete records evicted from memory. Records are
+// appended to fixed-size segment files by the thread pool, the index stays
+// in memory and is journaled, so the records survive restarts. Once the tier
+// is full, the oldest segment is dropped with all its records.
+class DiskCache {
+private:
+  struct Segment {
+    DiskSegmentPtr File;
+    uint64_t Id;
+    // Records written to the segment, some may be overwritten since
+    std::vector<std::string> Keys;
+  };
+
+  std::string Dir;
+  std::size_t Capacity;
+  ThreadPool *Pool;
+  DiskJournal Journal;
+  // Serializes the writers reserving space, taken before Lock. Segment files
+  // are created and dropped under it only, so that lookups don't wait for
+  // the file system.
+  Mutex ReserveLock;
+  uint64_t WriteOffset = 0;
+  uint64_t NextSegmentId = 0;
+  // Guards the fields below
+  Mutex Lock;
+  std::unordered_map<std::string, DiskCacheEntry> Index;
+  // Oldest first, records are appended to the last one
+  std::deque<Segment> Segments;
+  std::size_t JournalEntriesNum = 0;
+  bool IsCompacting = false;
+  std::atomic<std::size_t> PendingWritesNum{0};
+  std::atomic<std::size_t> WritesNum{0};
+  std::atomic<std::size_t> HitsNum{0};
+
+  // Opens the segments left by the previous run and queues their records
+  // to be verified
+  void LoadSegments();
+  void VerifySegment(DiskSegmentPtr File,
+                     std::vector<DiskJournalEntry> Entries);
+  // Called on the thread pool
+  bool Reserve(std::size_t Size, DiskSegmentPtr &File, uint64_t &Offset);
+  // Called with the lock held, the returned file is left for the caller to
+  // unlink
+  DiskSegmentPtr DropOldestSegment();
+  Segment *FindSegment(const DiskSegment *File);
+  // Called with the lock held, the journal is rewritten from the snapshot
+  // once the lock is released
+  std::vector<DiskJournalEntry> SnapshotJournal();
+  void CompactJournal(std::vector<DiskJournalEntry> Entries);
+  void WriteRecord(std::string URI, CacheRecordPtr Record);
+
+public:
+  DiskCache(std::string Dir, std::size_t Capacity, ThreadPool *Pool);
+  DiskCache(const DiskCache &) = delete;
+  DiskCache &operator=(const DiskCache &) = delete;
+
+  // Queues a complete record to be written, doesn't touch any files or locks
+  // itself. Records that don't fit a segment, aren't fresh or come while too
+  // many writes are pending are dropped.
+  void Store(const std::string &URI, CacheRecordPtr Record);
+  // Only finds the fresh records, the stale ones are fetched again
+  bool Find(const std::string &URI, DiskCacheEntry &Entry);
+  DiskCacheStats GetStats();
+
+  ~DiskCache();
+};
+} // namespace proxy
@@ -0,0 +1,53 @@
+#pragma once
+#include <Parallel/Mutex.hpp>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace proxy {
+struct DiskJournalEntry {
+  std::string Key;
+  uint64_t SegmentId = 0;
+  uint64_t Offset = 0;
+  uint64_t Size = 0;
+  // Checksum of the record bytes in the segment
+  uint64_t DataChecksum = 0;
+  bool IsComplete = false;
+  // Wall clock time the record becomes stale at
+  int64_t ExpiresAt = 0;
+  // Validators of the stored response, empty if it has none
+  std::string ETag;
+  std::string LastModified;
+};
+
+// Append-only log of the records written to the disk cache segments, the
+// index is rebuilt from it on start. Every entry is checksummed, a torn or
+// damaged tail is ignored.
+class DiskJournal {
+private:
+  std::string Path;
+  int FD = -1;
+  Mutex Lock;
+  // Entries appended while a rewrite is in progress, they go to both files
+  bool IsRewriting = false;
+  std::string Backlog;
+
+  void SyncDir();
+
+public:
+  explicit DiskJournal(std::string Path);
+  DiskJournal(const DiskJournal &) = delete;
+  DiskJournal &operator=(const DiskJournal &) = delete;
+
+  // Reads the entries up to the first damaged one
+  std::vector<DiskJournalEntry> Load();
+  // Entries appended from now on are carried over by the next Rewrite
+  void StartRewrite();
+  // Durably replaces the journal with the entries and opens it for
+  // appending, may run concurrently with Append
+  void Rewrite(const std::vector<DiskJournalEntry> &Entries);
+  void Append(const DiskJournalEntry &Entry);
+
+  ~DiskJournal();
+};
+} // namespace proxy
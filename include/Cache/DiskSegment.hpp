@@ -0,0 +1,38 @@
+#pragma once
+#include <Common/RefPtr.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace proxy {
+// Append-only file holding cached responses back to back. The whole file is
+// mapped, so that the responses can be read without copying. Readers keep
+// the segment alive after it's removed from the disk cache.
+class DiskSegment : public RefCounted<DiskSegment> {
+private:
+  std::string Path;
+  int FD = -1;
+  char *Data = nullptr;
+  std::size_t Size;
+
+  friend class RefCounted<DiskSegment>;
+  ~DiskSegment();
+
+public:
+  // Creates an empty segment file of Size bytes or opens the existing one
+  DiskSegment(std::string Path, std::size_t Size, bool Create = true);
+  DiskSegment(const DiskSegment &) = delete;
+  DiskSegment &operator=(const DiskSegment &) = delete;
+
+  const std::string &GetPath() const;
+  int GetFD() const;
+  const char *GetData() const;
+  std::size_t GetSize() const;
+  // Blocks until the bytes are written, throws on failure
+  void Write(uint64_t Offset, const char *Bytes, std::size_t Size);
+  // Removes the file, the data stays available until the segment is freed
+  void Unlink();
+};
+
+using DiskSegmentPtr = RefPtr<DiskSegment>;
+} // namespace proxy
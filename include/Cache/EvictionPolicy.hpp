@@ -0,0 +1,28 @@
+#pragma once
+#include <Common/Config.hpp>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <string>
+
+namespace proxy {
+// Orders the cache records for eviction, sizes are in bytes. Calls are
+// serialized by the cache.
+class EvictionPolicy {
+public:
+  using CanEvictFn = std::function<bool(const std::string &Key)>;
+
+  static std::unique_ptr<EvictionPolicy> Create(EvictionPolicyType Type,
+                                                std::size_t Capacity);
+
+  virtual void OnInsert(const std::string &Key, std::size_t Size) = 0;
+  virtual void OnAccess(const std::string &Key) = 0;
+  virtual void OnResize(const std::string &Key, std::size_t Size) = 0;
+  virtual void OnRemove(const std::string &Key) = 0;
+  // Picks the record to evict among the ones CanEvict accepts, returns false
+  // if there is none. The victim stays tracked until OnRemove().
+  virtual bool SelectVictim(const CanEvictFn &CanEvict,
+                            std::string &Victim) = 0;
+  virtual ~EvictionPolicy() = default;
+};
+} // namespace proxy
@@ -0,0 +1,29 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace proxy {
+// Count-min sketch estimating how often keys were requested recently. All
+// counters are halved periodically, so old popularity fades away.
+class FrequencySketch {
+private:
+  static constexpr std::size_t DepthNum = 4;
+  static constexpr uint8_t MaxCount = 15;
+
+  std::vector<uint8_t> Counters;
+  std::size_t WidthMask;
+  std::size_t AdditionsNum = 0;
+  std::size_t SampleSize;
+
+  std::size_t GetCounterIdx(std::size_t Hash, std::size_t Depth) const;
+  void Age();
+
+public:
+  explicit FrequencySketch(std::size_t Width);
+
+  void Increment(const std::string &Key);
+  unsigned Estimate(const std::string &Key) const;
+};
+} // namespace proxy
@@ -0,0 +1,50 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+namespace proxy {
+// Response headers that decide how long the response may be served from
+// the cache, collected while the response is framed
+struct CacheHeaders {
+  std::string CacheControl;
+  std::string Pragma;
+  std::string Expires;
+  std::string Date;
+  std::string Age;
+  std::string ETag;
+  std::string LastModified;
+  bool HasVary = false;
+};
+
+// Freshness lifetime and validators of a cached response. Times are
+// seconds of the wall clock, as in the HTTP dates.
+struct Freshness {
+  // The response is stale from this time on
+  int64_t ExpiresAt = 0;
+  // Time the response stays fresh for once received
+  int64_t Lifetime = 0;
+  // Time past the expiry the response may still be served for while it's
+  // being refreshed
+  int64_t StaleWindow = 0;
+  // False if the response must not be served to other requests
+  bool IsStorable = false;
+  std::string ETag;
+  std::string LastModified;
+
+  static int64_t Now();
+  // Computes the freshness of a response received at ResponseTime. The
+  // default stale window applies unless the response sets its own.
+  static Freshness FromHeaders(const CacheHeaders &Headers, int StatusCode,
+                               int64_t ResponseTime,
+                               int64_t DefaultStaleWindow = 0);
+  // Refreshes the freshness of a stored response with a 304 response
+  static Freshness FromNotModified(const Freshness &Stored,
+                                   const CacheHeaders &Headers,
+                                   int64_t ResponseTime);
+
+  bool IsFresh(int64_t Time) const;
+  bool CanServeStale(int64_t Time) const;
+  // Whether a stale response can be revalidated with a conditional request
+  bool HasValidators() const;
+};
+} // namespace proxy
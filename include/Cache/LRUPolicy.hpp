@@ -0,0 +1,25 @@
+#pragma once
+#include <Cache/EvictionPolicy.hpp>
+#include <list>
+#include <unordered_map>
+
+namespace proxy {
+class LRUPolicy : public EvictionPolicy {
+private:
+  struct Entry {
+    std::string Key;
+    std::size_t Size;
+  };
+
+  // Most recently used first
+  std::list<Entry> Entries;
+  std::unordered_map<std::string, std::list<Entry>::iterator> Index;
+
+public:
+  void OnInsert(const std::string &Key, std::size_t Size) override;
+  void OnAccess(const std::string &Key) override;
+  void OnResize(const std::string &Key, std::size_t Size) override;
+  void OnRemove(const std::string &Key) override;
+  bool SelectVictim(const CanEvictFn &CanEvict, std::string &Victim) override;
+};
+} // namespace proxy
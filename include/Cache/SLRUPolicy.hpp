@@ -0,0 +1,37 @@
+#pragma once
+#include <Cache/EvictionPolicy.hpp>
+#include <list>
+#include <unordered_map>
+
+namespace proxy {
+// Segmented LRU: records enter the probation segment and get promoted to the
+// protected one on a hit, so a burst of one-time requests can only flush
+// probation.
+class SLRUPolicy : public EvictionPolicy {
+private:
+  struct Entry {
+    std::string Key;
+    std::size_t Size;
+    bool IsProtected;
+  };
+  using EntryIterator = std::list<Entry>::iterator;
+
+  // Most recently used first
+  std::list<Entry> Probation;
+  std::list<Entry> Protected;
+  std::size_t ProtectedSize = 0;
+  std::size_t ProtectedCapacity;
+  std::unordered_map<std::string, EntryIterator> Index;
+
+  void Promote(EntryIterator It);
+
+public:
+  explicit SLRUPolicy(std::size_t Capacity);
+
+  void OnInsert(const std::string &Key, std::size_t Size) override;
+  void OnAccess(const std::string &Key) override;
+  void OnResize(const std::string &Key, std::size_t Size) override;
+  void OnRemove(const std::string &Key) override;
+  bool SelectVictim(const CanEvictFn &CanEvict, std::string &Victim) override;
+};
+} // namespace proxy
@@ -0,0 +1,38 @@
+#pragma once
+#include <Cache/EvictionPolicy.hpp>
+#include <Cache/FrequencySketch.hpp>
+#include <Cache/SLRUPolicy.hpp>
+#include <list>
+#include <unordered_map>
+
+namespace proxy {
+// W-TinyLFU: new records go to a small LRU window. Records leaving the
+// window are admitted to the main SLRU only if they were requested more
+// often than its victim, otherwise they are evicted themselves.
+class TinyLFUPolicy : public EvictionPolicy {
+private:
+  struct Entry {
+    std::string Key;
+    std::size_t Size;
+  };
+
+  // Most recently used first
+  std::list<Entry> Window;
+  std::size_t WindowSize = 0;
+  std::size_t WindowCapacity;
+  std::unordered_map<std::string, std::list<Entry>::iterator> WindowIndex;
+  SLRUPolicy Main;
+  FrequencySketch Sketch;
+
+  void Admit(std::list<Entry>::iterator It);
+
+public:
+  explicit TinyLFUPolicy(std::size_t Capacity);
+
+  void OnInsert(const std::string &Key, std::size_t Size) override;
+  void OnAccess(const std::string &Key) override;
+  void OnResize(const std::string &Key, std::size_t Size) override;
+  void OnRemove(const std::string &Key) override;
+  bool SelectVictim(const CanEvictFn &CanEvict, std::string &Victim) override;
+};
+} // namespace proxy
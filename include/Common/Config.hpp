@@ -0,0 +1,44 @@
+#pragma once
+#include <Common/Globals.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace proxy {
+// IoUring falls back to epoll on kernels without io_uring support
+enum class PollerType { Poll, Epoll, IoUring };
+
+enum class EvictionPolicyType { LRU, SLRU, TinyLFU };
+
+#ifdef __linux__
+constexpr PollerType DefaultPollerType = PollerType::Epoll;
+#else
+constexpr PollerType DefaultPollerType = PollerType::Poll;
+#endif
+
+struct Config {
+  uint16_t Port = 0;
+  // Number of event loop workers, 0 means one per online CPU.
+  std::size_t WorkersNum = 0;
+  PollerType Poller = DefaultPollerType;
+  // Every worker accepts connections from its own SO_REUSEPORT listener.
+  bool ReusePort = false;
+  // Threads running blocking jobs such as DNS lookups, 0 means one per
+  // online CPU.
+  std::size_t PoolThreadsNum = 0;
+  std::string HostsFile = "/etc/hosts";
+  // Queried directly with DNSClient, empty means getaddrinfo() is used
+  std::string NameServer;
+  // Memory budget of the cache in bytes
+  std::size_t CacheSize = Globals::DefaultCacheSize;
+  EvictionPolicyType CachePolicy = EvictionPolicyType::LRU;
+  // Cache blocks of large responses grow up to this size
+  std::size_t MaxCacheBlockSize = Globals::DefaultMaxCacheBlockSize;
+  // Directory of the disk cache tier, empty means it's disabled
+  std::string DiskCacheDir;
+  std::size_t DiskCacheSize = Globals::DefaultDiskCacheSize;
+  // Stale responses are served for this long while they're refreshed,
+  // unless the origin sets its own stale-while-revalidate period
+  std::size_t StaleWhileRevalidateSec = 0;
+};
+} // namespace proxy
@@ -1,13 +1,81 @@
 #pragma once
 #include <cstddef>
+#include <cstdint>
 
 namespace proxy::Globals {
 constexpr std::size_t DefaultReadBufferSize{4096};
+// Cache blocks start at this size unless the response is known to be
+// smaller and grow twice at a time up to the configured maximum
 constexpr std::size_t DefaultCacheBlockSize{4096};
+constexpr std::size_t MinCacheBlockSize{256};
+constexpr std::size_t DefaultMaxCacheBlockSize{256 << 10};
+constexpr std::size_t CacheBlockSizeLimit{1 << 20};
 constexpr std::size_t DefaultResponseBufferSize{4096};
 constexpr std::size_t StackBufferSize{2048};
-constexpr std::size_t BufferConcatSizeThreshold{
-    static_cast<std::size_t>(DefaultCacheBlockSize * 0.2)};
+// Connections are closed after being inactive for this long
 constexpr std::size_t ClientTimeoutSec{666};
 constexpr std::size_t ClientTimeoutMSec{ClientTimeoutSec * 1000};
+constexpr std::size_t ClientKeepAliveTimeoutSec{15};
+// Time to receive the request headers once the first byte arrives
+constexpr std::size_t HeaderReadTimeoutSec{30};
+// Time to serve a request, from reading it to sending the last byte
+constexpr std::size_t RequestTimeoutSec{3600};
+constexpr std::size_t ConnectTimeoutSec{10};
+// Time for an origin to send the response headers
+constexpr std::size_t UpstreamHeaderTimeoutSec{60};
+constexpr std::size_t TimerWheelTickMSec{100};
+constexpr std::size_t MaxRequestHeaderSize{32768};
+constexpr std::size_t MaxRequestHeadersNum{128};
+// Room for the headers added to a request forwarded upstream
+constexpr std::size_t UpstreamRequestHeadroom{128};
+// Client input isn't read past this while a response is being sent
+constexpr std::size_t MaxPipelinedInputSize{65536};
+constexpr std::size_t EventLoopTickMSec{1000};
+constexpr std::size_t EpollMaxEvents{1024};
+constexpr unsigned IoUringEntries{256};
+constexpr std::size_t AcceptBatchSize{64};
+constexpr std::size_t ResolverTimeoutMSec{2000};
+constexpr std::size_t ResolverAttemptsNum{2};
+// Used when the TTL is unknown, e.g. for getaddrinfo() results
+constexpr uint32_t ResolverDefaultTTLSec{60};
+constexpr uint32_t ResolverMaxTTLSec{3600};
+constexpr uint32_t ResolverNegativeTTLSec{5};
+constexpr std::size_t MaxResponseHeaderSize{65536};
+constexpr std::size_t UpstreamMaxIdlePerOrigin{16};
+constexpr std::size_t UpstreamMaxIdleTotal{256};
+constexpr std::size_t UpstreamIdleTimeoutSec{30};
+constexpr std::size_t SplicePipeSize{262144};
+// Cache blocks gathered into a single send
+constexpr std::size_t MaxWriteBlocksNum{64};
+constexpr std::size_t ResolverCacheMaxSize{4096};
+constexpr std::size_t DefaultCacheSize{256 << 20};
+// A single record may take at most this share of the cache
+constexpr std::size_t CacheMaxRecordPercent{10};
+// Index and eviction policy bookkeeping per record besides its key
+constexpr std::size_t CacheEntryOverhead{128};
+// Responses without explicit lifetime stay fresh for this share of the time
+// passed since they were last modified, up to a day
+constexpr int64_t HeuristicFreshnessPercent{10};
+constexpr int64_t MaxHeuristicFreshnessSec{24 * 60 * 60};
+// Has to be a power of two
+constexpr std::size_t CacheShardsNum{64};
+constexpr std::size_t CacheLineSize{64};
+// Cache blocks are carved from slabs of this size, a huge page on x86-64
+constexpr std::size_t BlockSlabSize{2 << 20};
+// Free slot bytes moved between a thread and the shared list at once
+constexpr std::size_t BlockAllocatorBatchSize{128 << 10};
+constexpr std::size_t MaxBlockAllocatorsNum{16};
+constexpr std::size_t DefaultDiskCacheSize{std::size_t(1) << 30};
+constexpr std::size_t DiskSegmentSize{64 << 20};
+// Evicted records waiting to be written to disk
+constexpr std::size_t DiskMaxPendingWrites{64};
+// Responses too large for memory downloaded at once to be written to disk,
+// each takes up to a segment of memory outside the cache budget
+constexpr std::size_t DiskMaxSpillingRecords{4};
+// Journal entries of dropped or overwritten records kept before compaction
+constexpr std::size_t DiskJournalMaxStaleEntries{4096};
+constexpr std::size_t SLRUProtectedPercent{80};
+constexpr std::size_t TinyLFUWindowPercent{1};
+// Used to size the frequency sketch
+constexpr std::size_t TinyLFUAverageRecordSize{16384};
 } // namespace proxy::Globals
@@ -0,0 +1,65 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <utility>
+
+namespace proxy {
+// Intrusive reference counter, the object is deleted along with its last
+// reference. Objects are created holding a single reference.
+template <typename T> class RefCounted {
+private:
+  std::atomic<std::size_t> RefsNum{1};
+
+public:
+  void Ref() { RefsNum.fetch_add(1, std::memory_order_relaxed); }
+
+  void Unref() {
+    if (RefsNum.fetch_sub(1, std::memory_order_acq_rel) == 1)
+      delete static_cast<T *>(this);
+  }
+
+  std::size_t GetRefsNum() const {
+    return RefsNum.load(std::memory_order_relaxed);
+  }
+};
+
+template <typename T> class RefPtr {
+private:
+  T *Ptr = nullptr;
+
+public:
+  RefPtr() = default;
+  RefPtr(std::nullptr_t) {}
+  explicit RefPtr(T *Ptr) : Ptr(Ptr) {
+    if (Ptr)
+      Ptr->Ref();
+  }
+  RefPtr(const RefPtr &Other) : RefPtr(Other.Ptr) {}
+  RefPtr(RefPtr &&Other) noexcept : Ptr(std::exchange(Other.Ptr, nullptr)) {}
+
+  RefPtr &operator=(RefPtr Other) {
+    std::swap(Ptr, Other.Ptr);
+    return *this;
+  }
+
+  // Takes over the reference the object was created with
+  static RefPtr Adopt(T *Ptr) {
+    RefPtr P;
+    P.Ptr = Ptr;
+    return P;
+  }
+
+  void Reset() { RefPtr().Swap(*this); }
+  void Swap(RefPtr &Other) { std::swap(Ptr, Other.Ptr); }
+
+  T *Get() const { return Ptr; }
+  T *operator->() const { return Ptr; }
+  T &operator*() const { return *Ptr; }
+  explicit operator bool() const { return Ptr != nullptr; }
+
+  ~RefPtr() {
+    if (Ptr)
+      Ptr->Unref();
+  }
+};
+} // namespace proxy
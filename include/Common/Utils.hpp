@@ -1,15 +1,17 @@
 #pragma once
 #include <Common/ProxyException.hpp>
 #include <Logging/Logger.hpp>
+#include <algorithm>
+#include <cctype>
 #include <cstdint>
 #include <cstring>
-#include <httpparser/request.h>
 #include <iostream>
 #include <poll.h>
 #include <pthread.h>
 #include <signal.h>
 #include <sstream>
 #include <string>
+#include <string_view>
 #include <type_traits>
 
 namespace proxy {
@@ -26,6 +28,32 @@ struct Utils {
     return true;
   }
 
+  static bool EqualsIgnoreCase(std::string_view L, std::string_view R) {
+    return L.size() == R.size() &&
+           std::equal(L.begin(), L.end(), R.begin(), [](char A, char B) {
+             return std::tolower(static_cast<unsigned char>(A)) ==
+                    std::tolower(static_cast<unsigned char>(B));
+           });
+  }
+
+  static std::string TrimString(const std::string &S) {
+    const char *Spaces = " \t\r\n";
+    std::size_t Begin = S.find_first_not_of(Spaces);
+    if (Begin == std::string::npos)
+      return "";
+    return S.substr(Begin, S.find_last_not_of(Spaces) - Begin + 1);
+  }
+
+  // FNV-1a, may be continued over several buffers
+  static uint64_t Checksum(const char *Bytes, std::size_t Size,
+                           uint64_t Hash = 14695981039346656037ULL) {
+    for (std::size_t i = 0; i < Size; i++) {
+      Hash ^= static_cast<unsigned char>(Bytes[i]);
+      Hash *= 1099511628211ULL;
+    }
+    return Hash;
+  }
+
   static std::string EventsToString(short Events) {
     std::stringstream ss;
     const char *Prefix = "";
@@ -51,26 +79,6 @@ struct Utils {
     return ss.str();
   }
 
-  static std::string RequestToString(const httpparser::Request &R) {
-    std::stringstream stream;
-    stream << R.method << " " << R.uri << " HTTP/" << R.versionMajor << "."
-           << R.versionMinor << "\r\n";
-
-    for (auto It = R.headers.begin(); It != R.headers.end(); ++It)
-      stream << It->name << ": " << It->value << "\r\n";
-
-    std::string data(R.content.begin(), R.content.end());
-    stream << data << "\r\n";
-    return stream.str();
-  }
-
-  template <class InputIt1, class InputIt2, class OutputIt>
-  static OutputIt ConcatRanges(InputIt1 First1, InputIt1 Last1, InputIt2 First2,
-                               InputIt2 Last2, OutputIt Out) {
-    Out = std::copy(First1, Last1, Out);
-    return std::copy(First2, Last2, Out);
-  }
-
   static void BlockInterruptionSignals() {
     sigset_t SigMask;
     sigemptyset(&SigMask);
@@ -7,6 +7,7 @@
 #include <sstream>
 #include <stdio.h>
 #include <string>
+#include <string_view>
 #include <time.h>
 
 namespace proxy {
@@ -37,6 +38,10 @@ enum class Level { Debug, Info, Error, Fatal, None };
 namespace convert {
 static std::string to_string(std::string s) { return s; }
 
+static std::string to_string(const char *s) { return s; }
+
+static std::string to_string(std::string_view s) { return std::string(s); }
+
 static std::string to_string(Thread::Id TID) {
   std::ostringstream OS;
   OS << TID;
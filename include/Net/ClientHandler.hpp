@@ -2,19 +2,19 @@
 #include <Cache/CacheListener.hpp>
 #include <Cache/CacheRecord.hpp>
 #include <Common/Globals.hpp>
-#include <Functional/Function.hpp>
 #include <Net/EndToEndHandlerBase.hpp>
+#include <Net/Pipe.hpp>
 #include <Net/PollHandlerBase.hpp>
 #include <Net/RemoteHandler.hpp>
+#include <Net/RequestParser.hpp>
+#include <Net/ResponseFramer.hpp>
 #include <Net/Server.hpp>
 #include <Net/Socket.hpp>
 #include <Parallel/Mutex.hpp>
-#include <Parallel/Semaphore.hpp>
-#include <Parallel/Thread.hpp>
-#include <httpparser/request.h>
 #include <httpparser/response.h>
 #include <memory>
 #include <optional>
+#include <string_view>
 #include <vector>
 
 namespace proxy {
@@ -22,24 +22,36 @@ class ClientHandler : public PollHandlerBase,
                       public EndToEndHandlerBase,
                       public CacheListener {
 private:
-  Thread ClientThread;
-  Mutex CacheEventMutex;
-  Semaphore CacheEventSemaphore;
-
   Mutex IsTerminatedMutex;
   bool _IsTerminated = false;
 
   Socket *ClientSock = nullptr;
   int SockFD;
   Server *Srv = nullptr;
-  Poller Poll;
-  httpparser::Request ClientRequest;
+  // Client input, may hold the pipelined requests following the current one
   std::vector<char> RequestBytes;
+  // Keeps its position in RequestBytes between the reads
+  RequestParser ReqParser;
+  // Shared with the remote handlers sending it. Kept for the connection
+  // once they are gone, so that its capacity is reused.
+  std::shared_ptr<std::vector<char>> UpstreamRequestBytes;
+  std::size_t UpstreamHeadSize = 0;
   bool RequestFinished = false;
+  bool InputClosed = false;
+  bool KeepAlive = false;
+  // HEAD requests are served with the heads of the cached GET responses
+  bool IsHead = false;
+  // Tracks the response sent to the client to tell where it ends
+  ResponseFramer ClientFramer;
 
   bool IsEndToEnd = false;
+  // The whole response is relayed bypassing the cache, rather than the rest
+  // of an incomplete record
+  bool IsPassThrough = false;
   RemoteHandler *EndToEndHandler = nullptr;
   std::vector<char> ResponseBuffer;
+  // Response body relay, the buffer is used when splice() isn't available
+  std::unique_ptr<Pipe> ResponsePipe;
   bool ReadHeader = false;
   httpparser::Response EndToEndResponse;
   std::vector<char> *RemoteInput = nullptr;
@@ -48,31 +60,63 @@ private:
   uint16_t RemoteHostPort;
   std::string CacheAddress;
 
-  CacheRecord *ResponseCacheRecord = nullptr;
-  std::size_t CurBlockIdx = 0;
+  CacheRecordPtr ResponseCacheRecord;
+  // Null until the first block goes out completely
+  const CacheBlock *LastSentBlock = nullptr;
+  // Position in the block following LastSentBlock
   std::size_t CurBlockPos = 0;
-  std::size_t CacheBlocksNum = 0;
-  std::size_t PrevCacheBlocksNum = 0;
-
-  void ClientRoutine();
+  // Cache hits are sent with completion-based requests where the poller
+  // supports them. The blocks and the record are kept until the send
+  // completes.
+  IORequest SendRequest{this};
+  CacheBlockSpan SendBlocks[Globals::MaxWriteBlocksNum];
+  std::size_t SendBlocksNum = 0;
+  struct iovec SendIOVecs[Globals::MaxWriteBlocksNum];
+  std::size_t SendIOVecsNum = 0;
+  CacheRecordPtr SendRecord;
+
+  // Response served from the disk cache tier
+  DiskCacheEntry DiskRecord;
+  std::size_t DiskRecordPos = 0;
 
   void SendRecordFromCache();
+  // Feeds the sent bytes to the framer and skips the blocks that went out
+  // completely. Returns false if the blocks were sent partially.
+  bool AdvanceCacheSend(const CacheBlockSpan *Blocks, std::size_t BlocksNum,
+                        const struct iovec *IOVecs, std::size_t IOVecsNum,
+                        std::size_t WrittenBytesNum);
+  // Cuts the vectors at the end of the response, returns their new number
+  std::size_t ClipToResponse(struct iovec *IOVecs,
+                             std::size_t IOVecsNum) const;
+  bool TryStartDiskResponse();
+  void SendRecordFromDisk();
+  void HandleCacheRecordEnd();
+  void DetachFromRecord();
   void HandleWriteEvents();
 
   void HandleClientInput();
+  // Arms the deadline of the next request
+  void ArmWaitTimer();
+  bool TryStartRequest();
+  void HandleResponseEnd();
+  // Writes the parsed request to UpstreamRequestBytes
+  void PrepareUpstreamRequest(bool HasHostHeader, std::string_view Method,
+                              std::string_view Body);
+  // Relays the response of UpstreamRequestBytes from a new remote handler
+  void StartEndToEnd();
+  // Relays the response as it is, bypassing the cache
+  void StartPassThrough();
+  void FinishEndToEnd();
   void HandleEndToEndWrite();
-
-  void WaitForCacheRecordUpdate(std::size_t LastBlocksNum);
+  bool HasEndToEndInput() const;
 
   bool IsTerminated();
   void Finish();
 
 public:
   ClientHandler(Server *Srv, Socket *ClientSock)
-      : Srv(Srv), ClientSock(ClientSock), CacheEventSemaphore(0),
-        ClientThread(Function(&ClientHandler::ClientRoutine, this)) {
+      : ClientSock(ClientSock), Srv(Srv) {
     SockFD = ClientSock->GetFD();
-    ResponseBuffer.reserve(Globals::DefaultResponseBufferSize);
   }
 
   void Handle(Poller *P, PollClient *Client) override;
@@ -80,8 +124,14 @@ public:
 
   void HandleRemoteEndInput(RemoteHandler *RemHandler,
                             std::vector<char> *Bytes) override;
+  void HandleRemoteEndFinished(RemoteHandler *RemHandler) override;
+
+  void HandleIO(IORequest *Req) override;
+  bool HasIOInFlight() const override;
 
-  void OnCacheRecordUpdate(CacheRecord *Record) override;
+  void OnCacheRecordAttach(CacheRecord *Record) override;
+  void OnCacheWakeup() override;
+  CacheWakeupQueue *GetWakeupQueue() override;
   void Terminate() override;
   SocketBase *GetSocket() override;
   std::optional<SocketBase::TimePointT> GetLastIOTimePoint() override;
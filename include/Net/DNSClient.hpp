@@ -0,0 +1,40 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <sys/socket.h>
+#include <vector>
+
+namespace proxy {
+struct ResolvedAddress {
+  struct sockaddr_storage Addr;
+  socklen_t AddrLen;
+};
+
+struct DNSAnswer {
+  std::vector<ResolvedAddress> Addresses;
+  // Minimum TTL of the returned records
+  uint32_t TTL = 0;
+  bool NameError = false;
+  // Set if a response didn't fit into a UDP datagram
+  bool Truncated = false;
+};
+
+// Minimal stub resolver querying A and AAAA records over UDP. Unlike
+// getaddrinfo() it reports record TTLs, so that the results can be cached
+// for as long as the zone allows. It knows nothing about search domains,
+// nsswitch or TCP, so it's only used for an explicitly given name server.
+class DNSClient {
+private:
+  struct sockaddr_storage ServerAddr;
+  socklen_t ServerAddrLen;
+
+public:
+  // NameServer is an IP address with an optional port, e.g. 127.0.0.1:5353
+  // or [::1]:53
+  explicit DNSClient(const std::string &NameServer);
+
+  // Blocks for up to ResolverTimeoutMSec per attempt, throws on transport
+  // failures
+  DNSAnswer Query(const std::string &Host);
+};
+} // namespace proxy
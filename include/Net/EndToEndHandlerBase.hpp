@@ -9,6 +9,8 @@ class EndToEndHandlerBase {
 public:
   virtual void HandleRemoteEndInput(RemoteHandler *RemHandler,
                                     std::vector<char> *Bytes) = 0;
+  // Called when the remote handler terminates, it must not be used afterwards.
+  virtual void HandleRemoteEndFinished(RemoteHandler *RemHandler) = 0;
   virtual ~EndToEndHandlerBase() = default;
 };
 } // namespace proxy
@@ -0,0 +1,26 @@
+#pragma once
+#include <Net/PollerBackend.hpp>
+#include <vector>
+
+#ifdef __linux__
+#include <sys/epoll.h>
+
+namespace proxy {
+class EpollBackend : public PollerBackend {
+private:
+  int EpollFD;
+  std::vector<struct epoll_event> Events;
+  std::size_t RegisteredNum = 0;
+
+  void Control(int Op, int FD, short Events, int Flags);
+
+public:
+  EpollBackend();
+  void Add(int FD, short Events, int Flags) override;
+  void Modify(int FD, short Events, int Flags) override;
+  void Remove(int FD) override;
+  int Wait(int TimeoutMSec, std::vector<PolledEvent> &Ready) override;
+  ~EpollBackend() override;
+};
+} // namespace proxy
+#endif
@@ -0,0 +1,96 @@
+#pragma once
+#include <Cache/CacheListener.hpp>
+#include <Common/Config.hpp>
+#include <Net/PollHandlerBase.hpp>
+#include <Net/Poller.hpp>
+#include <Net/TimerWheel.hpp>
+#include <Net/UpstreamPool.hpp>
+#include <Parallel/Mutex.hpp>
+#include <Parallel/ReadWriteLock.hpp>
+#include <Parallel/Thread.hpp>
+#include <cstddef>
+#include <set>
+#include <vector>
+
+namespace proxy {
+// A worker thread running a single Poller loop that multiplexes many
+// handlers. Handlers are owned by the loop they are attached to and are
+// deleted on the loop thread once marked dead.
+class EventLoop : public CacheWakeupQueue {
+private:
+  std::size_t Idx;
+  Thread LoopThread;
+  Poller Poll;
+  // Read and write ends, both are the same eventfd where it's available
+  int WakeupFDs[2] = {-1, -1};
+
+  ReadWriteLock IsTerminatedLock;
+  bool _IsTerminated = false;
+
+  // Guards handlers handed over from other threads.
+  Mutex PendingMutex;
+  std::vector<PollHandlerBase *> PendingHandlers;
+  std::set<PollHandlerBase *> WokenHandlers;
+  // Each listener is queued at most once, see CacheListener
+  std::vector<CacheListener *> WokenListeners;
+
+  // Accessed from the loop thread only.
+  std::set<PollHandlerBase *> Handlers;
+  std::set<PollHandlerBase *> DeadHandlers;
+  // Dead handlers waiting for their I/O requests to complete
+  std::set<PollHandlerBase *> DrainingHandlers;
+  TimerWheel Timers;
+  std::vector<Timer *> ExpiredTimers;
+  SocketBase::TimePointT LastUpstreamsCheck;
+  UpstreamPool Upstreams;
+
+  void LoopRoutine();
+  void SignalWakeup();
+  void DrainWakeups();
+  bool HasPendingWork() const;
+  void StartHandler(PollHandlerBase *HB);
+  void RunPending();
+  void RunCompletedIO();
+  void ExpireTimers();
+  void EraseDeadHandlers();
+
+public:
+  EventLoop(std::size_t Idx, PollerType Type);
+
+  EventLoop(const EventLoop &) = delete;
+  EventLoop &operator=(const EventLoop &) = delete;
+
+  void Start();
+  void Terminate();
+  bool IsTerminated();
+  void Join();
+
+  std::size_t GetIdx() const;
+  Poller *GetPoller();
+  // Must be used from the loop thread only.
+  UpstreamPool *GetUpstreamPool();
+  TimerWheel *GetTimers();
+  bool IsInLoopThread() const;
+
+  // Hands the handler over to this loop. Can be called from any thread, the
+  // handler is started on the loop thread.
+  void Attach(PollHandlerBase *HB);
+
+  // Schedules HB->HandleWakeup() on the loop thread. Can be called from any
+  // thread.
+  void Wakeup(PollHandlerBase *HB);
+
+  // Schedules OnCacheWakeup() of the listeners on the loop thread, taking
+  // the pending lock and signaling the loop once for the whole batch.
+  void WakeupListeners(CacheListener *const *Listeners,
+                       std::size_t Num) override;
+  // Drops the queued wakeup of a listener that is going away. Must be called
+  // after it's removed from its record.
+  void ForgetListener(CacheListener *Listener);
+
+  // Must be called from the loop thread.
+  void MarkDeadHandler(PollHandlerBase *HB);
+
+  ~EventLoop();
+};
+} // namespace proxy
@@ -0,0 +1,32 @@
+#pragma once
+#include <cstddef>
+
+namespace proxy {
+// Delimiter scanning of HTTP heads, 16 or 32 bytes at a time. The widest
+// kernel the CPU supports is picked at runtime, the scalar one is used on
+// other architectures.
+struct HttpScan {
+  enum class Level { Scalar, SSE2, AVX2 };
+
+  struct LineScan {
+    // The first LF, nullptr if the line doesn't end within the range
+    const char *LineEnd = nullptr;
+    // The first colon and the first control character other than HT and LF
+    // preceding LineEnd, nullptr if there are none
+    const char *Colon = nullptr;
+    const char *Ctl = nullptr;
+  };
+
+  static LineScan ScanLine(const char *Begin, const char *End);
+  // Returns the first LF or nullptr
+  static const char *FindLineEnd(const char *Begin, const char *End);
+  // Returns the position past the empty line ending the head or nullptr
+  static const char *FindHeadEnd(const char *Begin, const char *End);
+
+  static Level GetLevel();
+  // Allows comparing the kernels, returns false if the CPU lacks the
+  // instructions. Must be called before the scanning threads are started.
+  static bool SetLevel(Level L);
+  static const char *LevelToString(Level L);
+};
+} // namespace proxy
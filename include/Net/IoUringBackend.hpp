@@ -0,0 +1,80 @@
+#pragma once
+#include <Net/PollerBackend.hpp>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#define PROXY_HAS_IO_URING 1
+#include <linux/io_uring.h>
+#include <linux/time_types.h>
+
+namespace proxy {
+// Readiness notifications through io_uring poll requests. Registration
+// changes and re-arms are queued as SQEs and submitted together with the
+// wait, so a loop iteration costs a single io_uring_enter(2) no matter how
+// many sockets changed their interest set. Recvs and sends submitted as
+// IORequests go through the same ring.
+class IoUringBackend : public PollerBackend {
+private:
+  struct Registration {
+    short Events;
+    int Flags;
+    uint32_t Generation;
+    bool Armed;
+  };
+
+  int RingFD = -1;
+  void *SQRing = nullptr;
+  void *CQRing = nullptr;
+  std::size_t SQRingSize = 0;
+  std::size_t CQRingSize = 0;
+  struct io_uring_sqe *SQEs = nullptr;
+  std::size_t SQEsSize = 0;
+
+  unsigned *SQHead;
+  unsigned *SQTail;
+  unsigned *SQArray;
+  unsigned SQMask;
+  unsigned SQEntries;
+  unsigned *CQHead;
+  unsigned *CQTail;
+  unsigned CQMask;
+  struct io_uring_cqe *CQEs;
+
+  // Tail of the queued but not yet submitted SQEs
+  unsigned LocalSQTail = 0;
+
+  std::unordered_map<int, Registration> Registrations;
+  std::vector<int> RearmFDs;
+  uint32_t NextGeneration = 1;
+  struct __kernel_timespec Timeout {};
+  // Head of the list of the I/O requests in flight
+  IORequest *InFlightIO = nullptr;
+  std::vector<IORequest *> Completed;
+
+  struct io_uring_sqe *GetSQE();
+  void QueuePoll(int FD, Registration &R);
+  void QueuePollRemove(int FD, const Registration &R);
+  void QueueTimeout(int TimeoutMSec);
+  void QueueIO(IORequest *Req, struct io_uring_sqe *SQE);
+  int Enter(unsigned MinComplete);
+  void Reap(std::vector<PolledEvent> &Ready);
+  void Unmap();
+
+public:
+  IoUringBackend();
+  void Add(int FD, short Events, int Flags) override;
+  void Modify(int FD, short Events, int Flags) override;
+  void Remove(int FD) override;
+  int Wait(int TimeoutMSec, std::vector<PolledEvent> &Ready) override;
+  bool SupportsIO() const override;
+  void SubmitRecv(IORequest *Req, char *Buf, std::size_t Size) override;
+  void SubmitSend(IORequest *Req) override;
+  void Cancel(IORequest *Req) override;
+  void TakeCompleted(std::vector<IORequest *> &Done) override;
+  void DrainIO(std::vector<IORequest *> &Done) override;
+  ~IoUringBackend() override;
+};
+} // namespace proxy
+#endif
@@ -0,0 +1,32 @@
+#pragma once
+#include <Net/SocketBase.hpp>
+#include <cstddef>
+#include <sys/types.h>
+
+namespace proxy {
+// Kernel pipe used to relay bytes between sockets with splice(), so they
+// never get copied to user space. Only used from one event loop thread.
+class Pipe {
+private:
+  int FDs[2] = {-1, -1};
+  // Bytes spliced in, but not out yet
+  std::size_t Size = 0;
+
+public:
+  // Throws if pipes can't be created or splice() isn't supported
+  Pipe();
+
+  Pipe(const Pipe &) = delete;
+  Pipe &operator=(const Pipe &) = delete;
+
+  // Both return the number of bytes moved, 0 on EOF and -1 if the operation
+  // would block
+  ssize_t SpliceFrom(SocketBase *Sock, std::size_t MaxSize);
+  ssize_t SpliceTo(SocketBase *Sock);
+
+  std::size_t GetSize() const;
+  bool IsEmpty() const;
+
+  ~Pipe();
+};
+} // namespace proxy
@@ -0,0 +1,23 @@
+#pragma once
+#include <Net/PollerBackend.hpp>
+#include <poll.h>
+#include <unordered_map>
+#include <vector>
+
+namespace proxy {
+// poll(2) based backend. Edge-triggered flag is ignored, one-shot
+// registrations are emulated by ignoring the fd until it's re-armed.
+class PollBackend : public PollerBackend {
+private:
+  std::vector<struct pollfd> PollFDs;
+  std::vector<int> PollFlags;
+  // Index of each fd in PollFDs
+  std::unordered_map<int, std::size_t> FDIndices;
+
+public:
+  void Add(int FD, short Events, int Flags) override;
+  void Modify(int FD, short Events, int Flags) override;
+  void Remove(int FD) override;
+  int Wait(int TimeoutMSec, std::vector<PolledEvent> &Ready) override;
+};
+} // namespace proxy
@@ -1,21 +1,51 @@
 #pragma once
 
+#include <Common/Globals.hpp>
 #include <Net/Poller.hpp>
 #include <Net/SocketBase.hpp>
+#include <Net/TimerWheel.hpp>
+#include <cstddef>
 #include <optional>
 
 namespace proxy {
 
+class EventLoop;
 class PollClient;
 class Poller;
 
 class PollHandlerBase {
+protected:
+  EventLoop *Loop = nullptr;
+  // Deadline of the current phase of the connection, e.g. connecting or
+  // reading the headers
+  Timer PhaseTimer{this};
+  // Deadline of the whole request
+  Timer RequestTimer{this};
+
+  // Does nothing if the timer is armed for the same kind already, so that
+  // the deadline isn't pushed back. Must be called from the loop thread.
+  void ArmTimer(Timer &T, TimeoutKind Kind, std::size_t TimeoutSec);
+
 public:
+  void SetEventLoop(EventLoop *EL) { Loop = EL; }
+  EventLoop *GetEventLoop() { return Loop; }
+
   virtual SocketBase *GetSocket() = 0;
+  // Checked when an idle timer fires, the timer isn't re-armed on every
+  // read and write
   virtual std::optional<SocketBase::TimePointT> GetLastIOTimePoint() = 0;
   virtual void Terminate() = 0;
+  // Registers the handler's sockets, called on the event loop thread.
   virtual void Start() = 0;
   virtual void Handle(Poller *P, PollClient *Client) = 0;
+  // Called on the event loop thread after EventLoop::Wakeup().
+  virtual void HandleWakeup() {}
+  // Called on the event loop thread once a request submitted with
+  // Poller::SubmitRecv() or Poller::SubmitSend() completes.
+  virtual void HandleIO(IORequest *Req) {}
+  // Dead handlers are kept until their requests complete, the kernel may
+  // still be using the buffers
+  virtual bool HasIOInFlight() const { return false; }
   virtual ~PollHandlerBase() = default;
 };
 } // namespace proxy
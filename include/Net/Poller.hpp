@@ -1,6 +1,8 @@
 #pragma once
 
+#include <Common/Config.hpp>
 #include <Net/PollHandlerBase.hpp>
+#include <Net/PollerBackend.hpp>
 #include <Net/SocketBase.hpp>
 #include <Parallel/Mutex.hpp>
 #include <cstddef>
@@ -9,7 +11,6 @@
 #include <iterator>
 #include <memory>
 #include <poll.h>
-#include <set>
 #include <unordered_map>
 #include <vector>
 
@@ -22,12 +23,13 @@ class PollClient {
   short PollEvents;
   short ReceivedEvents;
   PollHandlerBase *Handler = nullptr;
+  int Flags;
 
 public:
   PollClient(int FD = -1, short PollEvents = 0, short ReceivedEvents = 0,
-             PollHandlerBase *Handler = nullptr)
+             PollHandlerBase *Handler = nullptr, int Flags = 0)
       : FD(FD), PollEvents(PollEvents), ReceivedEvents(ReceivedEvents),
-        Handler(Handler) {}
+        Handler(Handler), Flags(Flags) {}
 
   int GetFD() const { return FD; }
   short GetPollEvents() const { return PollEvents; }
@@ -37,12 +39,17 @@ public:
   void SetHandler(PollHandlerBase *HB) { Handler = HB; }
   PollHandlerBase *GetHandler() { return Handler; }
   const PollHandlerBase *GetHandler() const { return Handler; }
+  int GetFlags() const { return Flags; }
+  void SetFlags(int Flags) { this->Flags = Flags; }
 };
 
 class Poller {
 private:
-  std::vector<struct pollfd> PollFDs;
-  std::set<int> ResetReventsFDs;
+  std::unique_ptr<PollerBackend> Backend;
+  // Events returned by the last Poll() call
+  std::vector<PolledEvent> ReadyEvents;
+  // I/O requests completed during the last Poll() call
+  std::vector<IORequest *> CompletedIO;
 
   using ClientsMapT = std::unordered_map<int, PollClient>;
   ClientsMapT Clients;
@@ -55,7 +62,11 @@ private:
   void ResetReceivedEvents();
 
 public:
-  using PollFDsIterator = std::vector<struct pollfd>::iterator;
+  // Registration flags, see PollerBackend
+  static constexpr int EdgeTriggered = PollerBackend::EdgeTriggered;
+  static constexpr int OneShot = PollerBackend::OneShot;
+
+  using ReadyEventsIterator = std::vector<PolledEvent>::iterator;
 
   struct PolledClientsIterator {
     using iterator_category = std::forward_iterator_tag;
@@ -64,25 +75,23 @@ public:
     using pointer = value_type *;
     using reference = value_type &;
 
-    PolledClientsIterator(ClientsMapT &ClientsMap, PollFDsIterator Iter,
-                          PollFDsIterator End = PollFDsIterator())
-        : ClientsMap(ClientsMap), Iter(Iter), End(End) {}
+    PolledClientsIterator(ClientsMapT &ClientsMap, ReadyEventsIterator Iter)
+        : ClientsMap(ClientsMap), Iter(Iter) {}
 
     reference operator*() const {
-      reference Client = ClientsMap[Iter->fd];
-      Client.SetReceivedEvents(Iter->revents);
+      reference Client = ClientsMap[Iter->FD];
+      Client.SetReceivedEvents(Iter->Events);
       return Client;
     }
 
     pointer operator->() {
-      pointer Client = &ClientsMap[Iter->fd];
-      Client->SetReceivedEvents(Iter->revents);
+      pointer Client = &ClientsMap[Iter->FD];
+      Client->SetReceivedEvents(Iter->Events);
       return Client;
     }
 
     PolledClientsIterator &operator++() {
-      while (++Iter < End && Iter->revents == 0)
-        ;
+      ++Iter;
       return *this;
     }
 
@@ -104,14 +113,16 @@ public:
 
   private:
     ClientsMapT &ClientsMap;
-    PollFDsIterator Iter;
-    PollFDsIterator End;
+    ReadyEventsIterator Iter;
   };
 
-  explicit Poller(std::size_t InitialSize = 0) : Clients(InitialSize) {}
+  explicit Poller(PollerType Type = DefaultPollerType,
+                  std::size_t InitialSize = 0);
 
-  // Queues the pollfd client addition until flushed.
-  void Add(int FD, short Events, PollHandlerBase *Handler);
+  // Queues the pollfd client addition until flushed. Flags apply to the
+  // whole fd registration, the latest addition wins. Adding a one-shot client
+  // once again re-arms it.
+  void Add(int FD, short Events, PollHandlerBase *Handler, int Flags = 0);
 
   // Queues the pollfd client removal until flushed.
   void Remove(int FD, short Events = POLLIN | POLLPRI | POLLOUT | POLLERR |
@@ -120,12 +131,29 @@ public:
   // Flushes all the queued pollfd addition/removals.
   void Flush();
 
+  // Iterates over the clients that received events during the last poll
   PolledClientsIterator begin();
   PolledClientsIterator end();
 
   std::size_t GetPolledClientsNum() const;
   int Poll(int TimeoutMSec);
 
+  // Completion-based I/O, handlers use readiness notifications where it
+  // isn't supported. The buffers have to stay valid until the request is
+  // returned by GetCompletedIO(), see IORequest.
+  bool SupportsIO() const;
+  void SubmitRecv(IORequest *Req, int FD, char *Buf, std::size_t Size);
+  // Sends IOVecsNum buffers, the vectors are used until the request
+  // completes
+  void SubmitSend(IORequest *Req, int FD, struct iovec *IOVecs,
+                  std::size_t IOVecsNum);
+  void CancelIO(IORequest *Req);
+  // The requests are in flight until the caller clears the flag
+  const std::vector<IORequest *> &GetCompletedIO() const;
+  // Cancels the requests in flight and waits for them, their handlers are
+  // not notified
+  void DrainIO();
+
   ~Poller() = default;
 };
 } // namespace proxy
@@ -0,0 +1,64 @@
+#pragma once
+#include <cstddef>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <vector>
+
+namespace proxy {
+class PollHandlerBase;
+
+struct PolledEvent {
+  int FD;
+  short Events;
+};
+
+// A recv or a send queued to a completion-based backend. The request and
+// the buffers it points to belong to the handler, the event loop doesn't
+// delete the handler until the request completes.
+struct IORequest {
+  PollHandlerBase *Handler;
+  int FD = -1;
+  // Bytes transferred or a negated errno
+  int Result = 0;
+  bool InFlight = false;
+  // Sends gather the buffers the header points to
+  struct msghdr Msg {};
+  // Links the requests in flight, used by the backend
+  IORequest *Prev = nullptr;
+  IORequest *Next = nullptr;
+
+  explicit IORequest(PollHandlerBase *Handler) : Handler(Handler) {}
+};
+
+// OS specific readiness notification mechanism used by Poller. Events are
+// poll(2) flags, backends translate them to their own representation.
+class PollerBackend {
+public:
+  // Registration flags
+  static constexpr int EdgeTriggered = 1 << 0;
+  static constexpr int OneShot = 1 << 1;
+
+  virtual void Add(int FD, short Events, int Flags) = 0;
+  // Also re-arms one-shot registrations
+  virtual void Modify(int FD, short Events, int Flags) = 0;
+  virtual void Remove(int FD) = 0;
+  // Replaces the contents of Ready with the polled events, returns their
+  // number.
+  virtual int Wait(int TimeoutMSec, std::vector<PolledEvent> &Ready) = 0;
+
+  // Completion-based I/O, only backends that report SupportsIO() implement
+  // it. The buffers are used by the kernel until the request is returned by
+  // TakeCompleted().
+  virtual bool SupportsIO() const { return false; }
+  virtual void SubmitRecv(IORequest *Req, char *Buf, std::size_t Size) {}
+  // Sends the buffers of Req->Msg
+  virtual void SubmitSend(IORequest *Req) {}
+  // The request still completes, with -ECANCELED unless it finished first
+  virtual void Cancel(IORequest *Req) {}
+  // Appends the requests completed during the last Wait() to Done
+  virtual void TakeCompleted(std::vector<IORequest *> &Done) {}
+  // Cancels the requests in flight and waits until all of them complete
+  virtual void DrainIO(std::vector<IORequest *> &Done) {}
+  virtual ~PollerBackend() = default;
+};
+} // namespace proxy
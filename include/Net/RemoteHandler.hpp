@@ -1,15 +1,14 @@
 #pragma once
-#include <Functional/Function.hpp>
 #include <Net/EndToEndHandlerBase.hpp>
+#include <Net/Pipe.hpp>
 #include <Net/PollHandlerBase.hpp>
+#include <Net/RequestWriter.hpp>
+#include <Net/Resolver.hpp>
+#include <Net/ResponseFramer.hpp>
 #include <Net/Server.hpp>
 #include <Net/Socket.hpp>
 #include <Net/SocketBase.hpp>
-#include <Parallel/Condition.hpp>
 #include <Parallel/Mutex.hpp>
-#include <Parallel/Thread.hpp>
-#include <httpparser/httprequestparser.h>
-#include <httpparser/request.h>
 #include <memory>
 #include <optional>
 #include <vector>
@@ -17,56 +16,114 @@
 namespace proxy {
 class EndToEndHandlerBase;
 
-class RemoteHandler : public PollHandlerBase {
+class RemoteHandler : public PollHandlerBase, public ResolveListener {
 public:
   enum class Mode { Cache, EndToEnd };
 
   RemoteHandler(Server *Srv, std::string RemoteAddress,
-                const std::vector<char> &RequestBytes, Mode _Mode = Mode::Cache)
+                RequestBytesPtr RequestBytes, Mode _Mode = Mode::Cache)
       : Srv(Srv), RemoteAddress(std::move(RemoteAddress)),
-        RequestBytes(RequestBytes), _Mode(_Mode),
-        RemoteThread(Function(&RemoteHandler::RemoteRoutine, this)) {
-    Srv->RegisterHandler(this);
-  }
+        RequestBytes(std::move(RequestBytes)), _Mode(_Mode),
+        Framer(IsHeadRequest()) {}
 
+  // The connection is established once the handler is started and the host
+  // is resolved
   void ConnectTo(const std::string &Host, uint16_t Port);
 
+  // The record the response is cached to in cache mode
+  void SetCacheRecord(CacheRecordPtr Record);
   Mode GetRemoteMode() const;
   Socket *GetRemoteSocket();
+  // Resumes/stops reading the remote input in end-to-end mode
+  void Register();
   void Unregister();
   void Handle(Poller *P, PollClient *Client) override;
   void HandleRemoteInput(const PollClient &Client);
   void Terminate() override;
+  void Finish();
   void SetEndToEndBuffer(std::vector<char> *EndToEndBuffer);
+  // Body bytes are spliced into the pipe when it's set
+  void SetEndToEndPipe(Pipe *EndToEndPipe);
   void SetEndToEndWriteHandler(EndToEndHandlerBase *EndToEndWriteHandler);
   SocketBase *GetSocket() override;
   std::optional<SocketBase::TimePointT> GetLastIOTimePoint() override;
   void Start() override;
+  void HandleWakeup() override;
+  void HandleIO(IORequest *Req) override;
+  bool HasIOInFlight() const override;
+  void OnResolved(ResolvedHostPtr Host) override;
 
   virtual ~RemoteHandler();
 
 private:
-  Thread RemoteThread;
-
   Server *Srv;
-  CacheRecord *CR = nullptr;
+  CacheRecordPtr CR;
+  // Record revalidated with a conditional request, the response is held in
+  // HeaderBuffer until its status is known
+  CacheRecordPtr Stale;
+  std::vector<char> HeaderBuffer;
+  bool HasFreshness = false;
   Socket *RemoteSock = nullptr;
-  Poller Poll;
   std::string RemoteAddress;
+  std::string RemoteHost;
+  uint16_t RemotePort = 0;
+  bool IsResolving = false;
+  Mutex ResolvedMutex;
+  ResolvedHostPtr Resolved;
   bool HandledConnect = false;
   Mutex IsTerminatedMutex;
   bool _IsTerminated = false;
-  const std::vector<char> &RequestBytes;
-  std::vector<char> *EndToEndBuffer;
-  EndToEndHandlerBase *EndToEndWriteHandler;
+  // Owned copy, the requesting client may go away before the remote does
+  RequestBytesPtr RequestBytes;
+  std::size_t SentRequestBytes = 0;
+  std::vector<char> *EndToEndBuffer = nullptr;
+  Pipe *EndToEndPipe = nullptr;
+  EndToEndHandlerBase *EndToEndWriteHandler = nullptr;
   Mode _Mode;
+  ResponseFramer Framer;
+  // The connection came from the upstream pool
+  bool IsReused = false;
+  bool ReceivedResponse = false;
+  // Responses are received into the cache blocks with completion-based
+  // requests where the poller supports them
+  bool IsCompletionBased = false;
+  IORequest RecvRequest{this};
+  // Buffers of the request in flight, the record keeps its last block
+  CacheBlockPtr RecvBlock;
+  CacheRecordPtr RecvRecord;
 
-  void RemoteRoutine();
   bool IsTerminated();
-  void Finish();
 
+  void ResolveAndConnect();
+  void Connect(const ResolvedHost &Host);
+  void HandleEOF();
+  // The record must not be used afterwards, it may get evicted
+  void FinishRecord(bool IsComplete);
+  bool CanRetry() const;
+  void Retry();
+  // Returns the connection to the pool if it can carry another response
+  void ReleaseConnection(bool IsClean);
+  bool IsHeadRequest() const;
+  // RFC 7230, section 6.3.1
+  bool IsIdempotentRequest() const;
   void HandleConnect(const PollClient &Client);
+  void WriteRequest();
+  // Adds the validators of the stale record to the request, returns false
+  // if the request can't be made conditional
+  bool MakeConditionalRequest();
+  short GetPollEvents() const;
+  // Returns the block the input goes to, nullptr if none can be allocated
+  CacheBlock *GetFreeBlock(CacheBlockPtr &NewBlock);
   void ReadToCache();
+  void SubmitRecv();
+  // Stores the bytes received into the free space of the last block or of
+  // the new one
+  void HandleCacheInput(char *Free, std::size_t ReadBytes,
+                        CacheBlockPtr NewBlock);
+  void ReadRevalidation();
+  void HandleCacheProgress(bool IsClean, bool Fits);
+  std::size_t GetNextBlockSize();
   void ReadEndToEnd();
+  ssize_t SpliceEndToEnd(uint64_t Size);
 };
 } // namespace proxy
@@ -0,0 +1,104 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+namespace proxy {
+// Incrementally parses the head of an HTTP/1.x request accumulated in a
+// growing buffer. The scan position is kept across calls, so every byte is
+// looked at once however the request is split between reads. Chunked bodies
+// are framed as well, without decoding, to find where the request ends. The
+// parsed parts are views into the buffer passed to the last Parse() call,
+// they are valid until the buffer changes.
+class RequestParser {
+public:
+  enum class Status { Incomplete, Complete, Error };
+
+  struct Header {
+    std::string_view Name;
+    std::string_view Value;
+  };
+
+private:
+  enum class State {
+    RequestLine,
+    Headers,
+    ChunkSize,
+    ChunkData,
+    ChunkDataEnd,
+    Trailers,
+    Done,
+    Error
+  };
+  // Offsets into the buffer, it may be reallocated between the calls
+  struct Span {
+    std::size_t Offset = 0;
+    std::size_t Size = 0;
+  };
+  struct HeaderSpan {
+    Span Name;
+    Span Value;
+  };
+
+  State _State = State::RequestLine;
+  const char *Buf = nullptr;
+  // Bytes scanned so far and the start of the current line
+  std::size_t Pos = 0;
+  std::size_t LineStart = 0;
+  // Start of the head, of the trailers or of a chunk line, each of them is
+  // limited by MaxRequestHeaderSize
+  std::size_t SectionStart = 0;
+  std::size_t HeaderSize = 0;
+  uint64_t ChunkRemaining = 0;
+  // The first colon and control character of the current line, if found
+  std::optional<std::size_t> LineColon;
+  std::optional<std::size_t> LineCtl;
+  Span Method;
+  Span URI;
+  int VersionMajor = 0;
+  int VersionMinor = 0;
+  std::vector<HeaderSpan> Headers;
+  std::optional<uint64_t> ContentLength;
+  bool HasTransferEncoding = false;
+  // The final transfer coding is chunked
+  bool IsChunked = false;
+  const char *Error = nullptr;
+
+  Status Fail(const char *Message);
+  bool ParseRequestLine(std::size_t Begin, std::size_t End);
+  bool ParseHeader(std::size_t Begin, std::size_t End,
+                   std::optional<std::size_t> ColonPos);
+  // Checks the framing headers once the head is parsed
+  bool FinishHead();
+  bool ParseChunkSize(std::size_t Begin, std::size_t End);
+  const char *GetSizeError() const;
+  std::string_view View(Span S) const;
+
+public:
+  RequestParser() = default;
+  // Starts over with the next request, keeps the allocated memory
+  void Reset();
+
+  // Parses the bytes past the ones seen before. The buffer has to start with
+  // the same bytes as in the previous calls.
+  Status Parse(const char *Bytes, std::size_t Size);
+
+  // Size of the request line and headers, including the empty line
+  std::size_t GetHeaderSize() const;
+  // Size of the whole request. The body delimited by Content-Length may not
+  // be received yet, a chunked one ends where the parsing has stopped.
+  std::size_t GetRequestSize() const;
+  const char *GetError() const;
+
+  std::string_view GetMethod() const;
+  std::string_view GetURI() const;
+  int GetVersionMajor() const;
+  int GetVersionMinor() const;
+  std::size_t GetHeadersNum() const;
+  Header GetHeader(std::size_t Idx) const;
+  // Value of the first header with the name, compared case-insensitively
+  std::optional<std::string_view> FindHeader(std::string_view Name) const;
+};
+} // namespace proxy
@@ -0,0 +1,42 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+namespace proxy {
+// A serialized request is shared by the client handler and the remote
+// handlers sending it rather than copied to each of them
+using RequestBytesPtr = std::shared_ptr<const std::vector<char>>;
+
+// Serializes a request into a buffer in a single pass over its parts, which
+// are usually views into the client input. The buffer keeps its capacity
+// between requests, so only a request larger than the ones before it makes
+// the writer allocate.
+class RequestWriter {
+private:
+  std::vector<char> &Out;
+
+  void Append(std::string_view Bytes);
+
+public:
+  // Clears the buffer, SizeHint is the expected request size
+  explicit RequestWriter(std::vector<char> &Out, std::size_t SizeHint = 0);
+
+  void WriteRequestLine(std::string_view Method, std::string_view URI,
+                        int VersionMajor, int VersionMinor);
+  void WriteHeader(std::string_view Name, std::string_view Value);
+  // The port is left out if it's the default one
+  void WriteHostHeader(std::string_view Host, uint16_t Port);
+  // Ends the head, returns its size
+  std::size_t EndHead();
+  void WriteBody(std::string_view Body);
+
+  // Copies a serialized request to Out with a header added to the end of
+  // its head
+  static void InsertHeader(const std::vector<char> &Request,
+                           std::size_t HeadSize, std::string_view Name,
+                           std::string_view Value, std::vector<char> &Out);
+};
+} // namespace proxy
@@ -0,0 +1,86 @@
+#pragma once
+#include <Net/DNSClient.hpp>
+#include <Parallel/Mutex.hpp>
+#include <Parallel/ThreadPool.hpp>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace proxy {
+struct ResolvedHost {
+  // Empty if the host couldn't be resolved
+  std::vector<ResolvedAddress> Addresses;
+  std::string Error;
+};
+
+using ResolvedHostPtr = std::shared_ptr<const ResolvedHost>;
+
+class ResolveListener {
+public:
+  // Called from a thread pool worker
+  virtual void OnResolved(ResolvedHostPtr Host) = 0;
+  virtual ~ResolveListener() = default;
+};
+
+struct ResolverConfig {
+  std::string HostsFile = "/etc/hosts";
+  // Queried directly for the record TTLs if set. Otherwise, and whenever
+  // the name server fails to give an answer, lookups go through
+  // getaddrinfo() with the default TTL.
+  std::string NameServer;
+};
+
+// Resolves host names off the event loops and caches the results for the
+// TTL of their records. Concurrent lookups of the same host share a single
+// query.
+class Resolver {
+public:
+  struct Stats {
+    std::size_t Hits;
+    std::size_t Misses;
+    // Lookups that joined a query already in flight
+    std::size_t Joined;
+  };
+
+private:
+  using ClockT = std::chrono::steady_clock;
+
+  struct CacheEntry {
+    ResolvedHostPtr Host;
+    ClockT::time_point Expiry;
+    bool IsResolving = false;
+    std::vector<ResolveListener *> Listeners;
+  };
+
+  ThreadPool *Pool;
+  std::unordered_map<std::string, ResolvedHostPtr> Hosts;
+  std::optional<DNSClient> DNS;
+  Mutex CacheMutex;
+  std::unordered_map<std::string, CacheEntry> Cache;
+  std::atomic<std::size_t> HitsNum{0};
+  std::atomic<std::size_t> MissesNum{0};
+  std::atomic<std::size_t> JoinedNum{0};
+
+  void LoadHostsFile(const std::string &Path);
+  void ResolveTask(std::string Host);
+  ResolvedHostPtr Lookup(const std::string &Host, uint32_t &TTL);
+  // Returns nullptr if the answer should come from getaddrinfo() instead
+  ResolvedHostPtr LookupWithDNS(const std::string &Host, uint32_t &TTL);
+  ResolvedHostPtr LookupWithGAI(const std::string &Host, uint32_t &TTL);
+  void PurgeExpired(ClockT::time_point Now);
+
+public:
+  Resolver(ThreadPool *Pool, const ResolverConfig &Cfg);
+
+  // Returns the cached result, or nullptr if the lookup is in progress and
+  // Listener is going to be notified once it's done
+  ResolvedHostPtr Resolve(const std::string &Host, ResolveListener *Listener);
+  // Listener won't be notified after this returns
+  void Cancel(const std::string &Host, ResolveListener *Listener);
+  Stats GetStats() const;
+};
+} // namespace proxy
@@ -0,0 +1,71 @@
+#pragma once
+#include <Cache/Freshness.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+
+namespace proxy {
+// Incrementally finds the end of an HTTP/1.x response, so that persistent
+// connections can be reused once the response is over. Responses that
+// can't be framed are treated as delimited by connection close.
+class ResponseFramer {
+private:
+  enum class State {
+    StatusLine,
+    Headers,
+    Body,
+    ChunkSize,
+    ChunkData,
+    ChunkDataEnd,
+    Trailers,
+    UntilClose,
+    Done
+  };
+
+  State _State = State::StatusLine;
+  bool IsHeadRequest;
+  std::string Line;
+  std::size_t HeaderSize = 0;
+  uint64_t Remaining = 0;
+  int StatusCode = 0;
+  bool KeepAlive = false;
+  bool HasContentLength = false;
+  bool IsChunked = false;
+  CacheHeaders _CacheHeaders;
+
+  void ParseStatusLine();
+  void ParseHeader();
+  void StartBody();
+  void StartUntilClose();
+  // Returns true once a whole line is accumulated in Line
+  bool ReadLine(const char *&Bytes, const char *End);
+
+public:
+  explicit ResponseFramer(bool IsHeadRequest = false);
+  void Reset(bool IsHeadRequest);
+
+  // Consumes the response bytes, returns the number of bytes that belong to
+  // the response. Bytes past the end of the response are left unconsumed.
+  std::size_t Feed(const char *Bytes, std::size_t Size);
+  // Number of the following bytes that are body data and don't have to be
+  // fed, they are accounted with Skip() instead
+  uint64_t GetPassThroughSize() const;
+  void Skip(uint64_t Size);
+  // Size of the rest of the response if it's known from Content-Length
+  std::optional<uint64_t> GetRemainingSize() const;
+
+  // Whether the status line and headers of the final response are consumed
+  bool HasHeaders() const;
+  const CacheHeaders &GetCacheHeaders() const;
+  bool IsDone() const;
+  bool IsDelimitedByClose() const;
+  // Whether the connection may carry another response after this one
+  bool IsKeepAlive() const;
+  int GetStatusCode() const;
+  // Size of the status line and headers consumed so far
+  std::size_t GetHeaderSize() const;
+
+  static bool IsHeadRequestBytes(const char *Bytes, std::size_t Size);
+};
+} // namespace proxy
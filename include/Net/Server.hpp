@@ -2,7 +2,12 @@
 
 #include <Cache/Cache.hpp>
 #include <Cache/CacheListener.hpp>
+#include <Cache/DiskCache.hpp>
+#include <Common/Config.hpp>
+#include <Net/EventLoop.hpp>
 #include <Net/PollHandlerBase.hpp>
+#include <Net/RequestWriter.hpp>
+#include <Net/Resolver.hpp>
 #include <Net/Poller.hpp>
 #include <Net/ServerHandler.hpp>
 #include <Net/ServerSocket.hpp>
@@ -10,9 +15,11 @@
 #include <Parallel/Mutex.hpp>
 #include <Parallel/Semaphore.hpp>
 #include <Parallel/ReadWriteLock.hpp>
+#include <Parallel/ThreadPool.hpp>
 #include <deque>
 #include <tuple>
 #include <memory>
+#include <vector>
 
 namespace proxy {
 
@@ -22,38 +29,42 @@ struct CacheListenerInfo {
   std::string CacheAddress;
   std::string RemoteHostName;
   uint16_t RemotePort;
-  const std::vector<char> &RequestBytes;
+  RequestBytesPtr RequestBytes;
   CacheListener *Listener;
+  // Loop the remote handler is attached to on a cache miss.
+  EventLoop *Loop;
 };
 
 class Server {
 private:
-  ServerSocket *SrvSock = nullptr;
-  ServerHandler *SrvHandler = nullptr;
+  Config Cfg;
+  // Listener handlers that aren't attached to their loops yet
+  std::vector<ServerHandler *> SrvHandlers;
   std::unique_ptr<Cache> SrvCache;
-  std::unique_ptr<Poller> Poll;
+  // Null unless the disk tier is enabled
+  std::unique_ptr<DiskCache> Disk;
+  std::vector<std::unique_ptr<EventLoop>> Loops;
+  std::unique_ptr<ThreadPool> Pool;
+  std::unique_ptr<Resolver> DNSResolver;
   ReadWriteLock IsTerminatedLock;
   bool _IsTerminated = false;
-  Mutex HandlersMutex;
-  Mutex DeadHandlersMutex;
   Semaphore ServerTasksSemaphore;
-  Mutex CacheMutex;
-  std::set<PollHandlerBase *> Handlers;
-  std::set<PollHandlerBase *> DeadHandlers;
 
-  void TerminateTimedOutHandlers();
-  void EraseDeadHandlers();
   void StartImpl();
+  void StopLoops();
 
 public:
-  explicit Server(uint16_t Port);
+  explicit Server(const Config &Cfg);
   void Start();
-  ServerSocket *GetServerSocket();
+  const Config &GetConfig() const;
   Cache *GetCache();
-  void AddCacheListener(CacheListenerInfo CLI);
-  void RegisterHandler(PollHandlerBase *HB);
-  void RemoveHandler(PollHandlerBase *HB);
-  void MarkDeadHandler(PollHandlerBase *HB);
+  DiskCache *GetDiskCache();
+  ThreadPool *GetThreadPool();
+  Resolver *GetResolver();
+  std::size_t GetEventLoopsNum() const;
+  EventLoop *GetEventLoop(std::size_t Idx);
+  // Returns false if the request has to bypass the cache
+  bool AddCacheListener(CacheListenerInfo CLI);
   bool IsTerminated();
   void Terminate();
 
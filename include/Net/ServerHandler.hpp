@@ -3,8 +3,6 @@
 #include <Net/Poller.hpp>
 #include <Net/Server.hpp>
 #include <Net/ServerSocket.hpp>
-#include <Parallel/Thread.hpp>
-#include <Parallel/ReadWriteLock.hpp>
 #include <memory>
 #include <optional>
 
@@ -15,16 +13,18 @@ private:
   Server *Srv = nullptr;
   ServerSocket *Sock = nullptr;
   int SockFD;
-  Poller Poll;
-  Thread ServerThread;
-  ReadWriteLock IsTerminatedLock;
+  std::size_t NextLoopIdx = 0;
+  // Sharded listeners keep accepted connections in their own loop instead
+  // of distributing them among all loops.
+  bool IsSharded;
   bool _IsTerminated = false;
-  void ServerRoutine();
   void Finish();
+  EventLoop *NextEventLoop();
 
 public:
-  explicit ServerHandler(Server *Server);
-  void Handle(Poller *P, PollClient *Client);
+  // Takes ownership of Sock
+  ServerHandler(Server *Server, ServerSocket *Sock, bool IsSharded = false);
+  void Handle(Poller *P, PollClient *Client) override;
   void Terminate() override;
   void Start() override;
   bool IsTerminated();
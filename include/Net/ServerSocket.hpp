@@ -10,7 +10,10 @@ private:
   uint16_t Port;
 
 public:
-  explicit ServerSocket(uint16_t Port);
+  // Sockets created with ReusePort may be bound to the same port several
+  // times, the kernel balances incoming connections between them.
+  explicit ServerSocket(uint16_t Port, bool ReusePort = false);
+  // Puts the socket into non-blocking listening mode
   void Listen();
   Socket *Accept();
   int GetPort() const;
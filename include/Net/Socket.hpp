@@ -1,5 +1,6 @@
 #pragma once
 #include <Common/Utils.hpp>
+#include <Net/DNSClient.hpp>
 #include <Net/ServerSocket.hpp>
 #include <Net/SocketBase.hpp>
 #include <Parallel/Mutex.hpp>
@@ -8,6 +9,7 @@
 #include <netdb.h>
 #include <string>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <sys/types.h>
 #include <unistd.h>
 
@@ -27,9 +29,12 @@ private:
   struct addrinfo *GetAddrInfo();
 
 public:
+  // Accepted sockets are non-blocking. Returns nullptr if SB is non-blocking
+  // and has no pending connections.
   static Socket *AcceptFrom(SocketBase *SB);
 
-  static Socket *ConnectTo(const std::string &Host, uint16_t Port);
+  // Starts a non-blocking connect to the resolved address
+  static Socket *ConnectTo(const ResolvedAddress &Address, uint16_t Port);
 
   Socket(const Socket &) = delete;
   Socket(Socket &&) = default;
@@ -38,6 +43,10 @@ public:
 
   ssize_t Write(const std::vector<char> &Bytes);
   ssize_t Write(const char *Bytes, std::size_t Size);
+  // Gathers the buffers into a single send
+  ssize_t Write(const struct iovec *IOVecs, std::size_t IOVecsNum);
+  // Sends Size bytes of the file starting at Offset
+  ssize_t SendFile(int FileFD, uint64_t Offset, std::size_t Size);
   ssize_t ReadAppend(std::vector<char> &Bytes);
   ssize_t Read(std::vector<char> &Bytes);
   ssize_t Read(char *Bytes, std::size_t Size);
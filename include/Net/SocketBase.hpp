@@ -1,12 +1,11 @@
 #pragma once
-#include <Parallel/LockGuard.hpp>
-#include <Parallel/ReadWriteLock.hpp>
 #include <chrono>
 
 namespace proxy {
 class SocketBase {
 public:
-  using ClockT = std::chrono::system_clock;
+  // Monotonic, timeouts aren't affected by the wall clock being adjusted
+  using ClockT = std::chrono::steady_clock;
   using TimePointT = ClockT::time_point;
 
   SocketBase(int Fd = -1) : Fd(Fd) { LastIOTimePoint = ClockT::now(); }
@@ -26,7 +25,7 @@ protected:
 
 private:
   bool _IsNonBlocking;
-  ReadWriteLock LastIOTimeLock;
+  // Sockets are only used from the thread of their event loop
   TimePointT LastIOTimePoint;
 };
 } // namespace proxy
@@ -0,0 +1,94 @@
+#pragma once
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace proxy {
+class PollHandlerBase;
+class TimerWheel;
+
+enum class TimeoutKind { Connect, HeaderRead, KeepAlive, Idle, Request };
+
+const char *TimeoutKindToString(TimeoutKind Kind);
+
+// Intrusive list node, the wheel slots are empty lists of these
+class TimerLink {
+protected:
+  TimerLink *Prev = this;
+  TimerLink *Next = this;
+
+  void Unlink();
+  void LinkBefore(TimerLink *Link);
+
+  friend class TimerWheel;
+
+public:
+  TimerLink() = default;
+  TimerLink(const TimerLink &) = delete;
+  TimerLink &operator=(const TimerLink &) = delete;
+};
+
+// Deadline of a handler. It's unlinked from the wheel when cancelled or
+// destroyed, so handlers may be deleted with their timers armed.
+class Timer : public TimerLink {
+private:
+  PollHandlerBase *Handler;
+  TimerWheel *Wheel = nullptr;
+  TimeoutKind Kind = TimeoutKind::Idle;
+  std::chrono::milliseconds Timeout{0};
+  uint64_t ExpiryTick = 0;
+
+  friend class TimerWheel;
+
+public:
+  explicit Timer(PollHandlerBase *Handler) : Handler(Handler) {}
+
+  PollHandlerBase *GetHandler() const { return Handler; }
+  TimeoutKind GetKind() const { return Kind; }
+  std::chrono::milliseconds GetTimeout() const { return Timeout; }
+  bool IsArmed() const { return Wheel != nullptr; }
+  void Cancel();
+  ~Timer() { Cancel(); }
+};
+
+// Hierarchical timing wheel of an event loop. Arming and cancelling take
+// constant time, and advancing only touches the slots that come due, so
+// timeouts fire without scanning every connection. Used from the loop thread
+// only.
+class TimerWheel {
+public:
+  using ClockT = std::chrono::steady_clock;
+
+  static constexpr std::size_t LevelBits = 6;
+  static constexpr std::size_t SlotsNum = std::size_t(1) << LevelBits;
+  // With 100 ms ticks the wheel covers about 19 days, later deadlines are
+  // cascaded down until they come due
+  static constexpr std::size_t LevelsNum = 4;
+
+private:
+  TimerLink Slots[LevelsNum][SlotsNum];
+  ClockT::time_point StartTime;
+  std::chrono::milliseconds Tick;
+  // The last tick whose timers have been expired
+  uint64_t CurTick = 0;
+  std::size_t ArmedNum = 0;
+
+  uint64_t ToTick(ClockT::time_point Time) const;
+  void Insert(Timer *T);
+  void Cascade(std::size_t Level);
+
+  friend class Timer;
+
+public:
+  explicit TimerWheel(std::chrono::milliseconds Tick);
+  TimerWheel(const TimerWheel &) = delete;
+  TimerWheel &operator=(const TimerWheel &) = delete;
+
+  // Re-arms the timer if it's armed already
+  void Arm(Timer *T, TimeoutKind Kind, std::chrono::milliseconds Timeout);
+  // Unlinks the timers that are due by Now and appends them to Expired
+  void Advance(ClockT::time_point Now, std::vector<Timer *> &Expired);
+  std::size_t GetArmedNum() const;
+};
+} // namespace proxy
@@ -0,0 +1,46 @@
+#pragma once
+#include <Net/Socket.hpp>
+#include <cstdint>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace proxy {
+// Idle persistent connections to origins, keyed by host:port. Every event
+// loop owns a pool, so it's only used from the loop thread and idle sockets
+// never move between pollers.
+class UpstreamPool {
+private:
+  struct IdleConnection {
+    std::string Key;
+    Socket *Sock;
+    SocketBase::TimePointT ReleaseTime;
+  };
+  using IdleIterator = std::list<IdleConnection>::iterator;
+
+  // Oldest first
+  std::list<IdleConnection> Idle;
+  // Most recently released last
+  std::unordered_map<std::string, std::vector<IdleIterator>> ByOrigin;
+
+  void Close(IdleIterator It);
+  static bool IsAlive(Socket *Sock);
+
+public:
+  UpstreamPool() = default;
+  UpstreamPool(const UpstreamPool &) = delete;
+  UpstreamPool &operator=(const UpstreamPool &) = delete;
+
+  static std::string MakeKey(const std::string &Host, uint16_t Port);
+
+  // Returns an idle connection to the origin or nullptr. The caller owns the
+  // returned socket.
+  Socket *Acquire(const std::string &Key);
+  // Takes ownership of the socket, which must not be polled anymore
+  void Release(const std::string &Key, Socket *Sock);
+  void CloseExpired();
+  std::size_t GetIdleNum() const;
+  ~UpstreamPool();
+};
+} // namespace proxy
@@ -1,4 +1,5 @@
 #pragma once
+#include <utility>
 
 namespace proxy {
 template <typename LockT> class Locker {
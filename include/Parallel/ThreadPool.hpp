@@ -2,16 +2,82 @@
 
 #include <Logging/Logger.hpp>
 #include <Parallel/Thread.hpp>
+#include <Parallel/WorkStealingDeque.hpp>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
 namespace proxy {
+class ThreadPoolTask {
+private:
+  // Link in the global injection queue
+  ThreadPoolTask *Next = nullptr;
+
+  friend class ThreadPool;
+
+public:
+  virtual void Run() = 0;
+  virtual ~ThreadPoolTask() = default;
+};
+
+template <typename F> class FunctionTask : public ThreadPoolTask {
+private:
+  F Func;
+
+public:
+  explicit FunctionTask(F Func) : Func(std::move(Func)) {}
+
+  void Run() override { Func.Run(); }
+};
+
+// Work-stealing pool for blocking jobs that shouldn't run on event loops.
+// Tasks submitted by a worker go to its own deque, the ones submitted by
+// other threads go to a global lock-free queue that idle workers pick up
+// from. Workers without work steal from each other and then park on a
+// futex until a new task is submitted.
 class ThreadPool {
 private:
-  std::vector<Thread> Threads;
-  size_t InitialThreadsNum;
+  struct Worker {
+    WorkStealingDeque<ThreadPoolTask> Tasks;
+    Thread WorkerThread;
+  };
+
+  std::vector<std::unique_ptr<Worker>> Workers;
+  std::atomic<ThreadPoolTask *> Injected{nullptr};
+  // Bumped on every submission, idle workers wait for it to change
+  alignas(64) std::atomic<uint32_t> WakeupSeq{0};
+  std::atomic<uint32_t> SleepersNum{0};
+  std::atomic<bool> IsStopping{false};
+
+  void WorkerRoutine(std::size_t Idx);
+  ThreadPoolTask *FindTask(std::size_t Idx, std::size_t &NextVictim);
+  ThreadPoolTask *TakeInjected(Worker &W);
+  bool HasTasks() const;
+  void Push(ThreadPoolTask *Task);
+  // INT_MAX wakes every sleeper
+  void NotifyWorkers(int WaitersNum);
+  static void RunTask(ThreadPoolTask *Task);
 
 public:
-  ThreadPool(size_t InitialThreadsNum);
+  // 0 means one thread per online CPU
+  explicit ThreadPool(std::size_t ThreadsNum = 0);
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  // Takes ownership of the task
+  void SubmitTask(ThreadPoolTask *Task);
+
+  // Accepts proxy::Function or any other object with a Run() method
+  template <typename F> void Submit(F &&Func) {
+    SubmitTask(new FunctionTask<std::decay_t<F>>(std::forward<F>(Func)));
+  }
+
+  std::size_t GetThreadsNum() const;
+  // Runs the tasks that are already queued and joins the workers
+  void Stop();
   ~ThreadPool();
 };
 } // namespace proxy
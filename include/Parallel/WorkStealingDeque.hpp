@@ -0,0 +1,118 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace proxy {
+// Chase-Lev deque of pointers. Push and Pop may only be called by the owner
+// thread and work on the bottom end, Steal may be called by any thread and
+// takes from the top.
+template <typename ItemT> class WorkStealingDeque {
+private:
+  class Array {
+  private:
+    int64_t Capacity;
+    int64_t Mask;
+    std::unique_ptr<std::atomic<ItemT *>[]> Items;
+
+  public:
+    explicit Array(int64_t Capacity)
+        : Capacity(Capacity), Mask(Capacity - 1),
+          Items(new std::atomic<ItemT *>[Capacity]) {}
+
+    int64_t GetCapacity() const { return Capacity; }
+
+    ItemT *Get(int64_t Idx) const {
+      return Items[Idx & Mask].load(std::memory_order_relaxed);
+    }
+
+    void Put(int64_t Idx, ItemT *Item) {
+      Items[Idx & Mask].store(Item, std::memory_order_relaxed);
+    }
+
+    Array *Grow(int64_t Bottom, int64_t Top) const {
+      auto *NewArray = new Array(Capacity * 2);
+      for (int64_t i = Top; i != Bottom; i++)
+        NewArray->Put(i, Get(i));
+      return NewArray;
+    }
+  };
+
+  alignas(64) std::atomic<int64_t> Top{0};
+  alignas(64) std::atomic<int64_t> Bottom{0};
+  std::atomic<Array *> Items;
+  // Thieves may still read from replaced arrays, so they live as long as
+  // the deque does
+  std::vector<std::unique_ptr<Array>> Arrays;
+
+public:
+  // Capacity has to be a power of two
+  explicit WorkStealingDeque(int64_t Capacity = 256) {
+    Arrays.emplace_back(new Array(Capacity));
+    Items.store(Arrays.back().get(), std::memory_order_relaxed);
+  }
+
+  WorkStealingDeque(const WorkStealingDeque &) = delete;
+  WorkStealingDeque &operator=(const WorkStealingDeque &) = delete;
+
+  bool Empty() const {
+    int64_t B = Bottom.load(std::memory_order_relaxed);
+    int64_t T = Top.load(std::memory_order_relaxed);
+    return B <= T;
+  }
+
+  void Push(ItemT *Item) {
+    int64_t B = Bottom.load(std::memory_order_relaxed);
+    int64_t T = Top.load(std::memory_order_acquire);
+    Array *A = Items.load(std::memory_order_relaxed);
+    if (B - T > A->GetCapacity() - 1) {
+      Arrays.emplace_back(A->Grow(B, T));
+      A = Arrays.back().get();
+      Items.store(A, std::memory_order_release);
+    }
+    A->Put(B, Item);
+    std::atomic_thread_fence(std::memory_order_release);
+    Bottom.store(B + 1, std::memory_order_relaxed);
+  }
+
+  ItemT *Pop() {
+    int64_t B = Bottom.load(std::memory_order_relaxed) - 1;
+    Array *A = Items.load(std::memory_order_relaxed);
+    Bottom.store(B, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t T = Top.load(std::memory_order_relaxed);
+
+    if (T > B) {
+      Bottom.store(B + 1, std::memory_order_relaxed);
+      return nullptr;
+    }
+
+    ItemT *Item = A->Get(B);
+    if (T == B) {
+      // The last item, race against thieves for it
+      if (!Top.compare_exchange_strong(T, T + 1, std::memory_order_seq_cst,
+                                       std::memory_order_relaxed))
+        Item = nullptr;
+      Bottom.store(B + 1, std::memory_order_relaxed);
+    }
+    return Item;
+  }
+
+  // Returns nullptr if the deque is empty or another thread won the race
+  ItemT *Steal() {
+    int64_t T = Top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t B = Bottom.load(std::memory_order_acquire);
+    if (T >= B)
+      return nullptr;
+
+    Array *A = Items.load(std::memory_order_acquire);
+    ItemT *Item = A->Get(T);
+    if (!Top.compare_exchange_strong(T, T + 1, std::memory_order_seq_cst,
+                                     std::memory_order_relaxed))
+      return nullptr;
+    return Item;
+  }
+};
+} // namespace proxy
@@ -0,0 +1,134 @@
+#include <Cache/BlockAllocator.hpp>
+#include <Common/Globals.hpp>
+#include <Logging/Logger.hpp>
+#include <Parallel/LockGuard.hpp>
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <new>
+#include <sys/mman.h>
+
+namespace proxy {
+static std::atomic<std::size_t> AllocatorsNum{0};
+
+BlockAllocator::ThreadCache::~ThreadCache() {
+  if (Owner && Head)
+    Owner->Drain(*this, Num);
+}
+
+BlockAllocator::BlockAllocator(std::size_t SlotSize)
+    : Idx(AllocatorsNum++), SlotSize(SlotSize),
+      SlabSize(std::max(Globals::BlockSlabSize, SlotSize)),
+      SlotsPerSlab(SlabSize / SlotSize),
+      BatchNum(std::max<std::size_t>(
+          Globals::BlockAllocatorBatchSize / SlotSize, 1)) {
+  assert(Idx < Globals::MaxBlockAllocatorsNum);
+  assert(SlotSize >= sizeof(FreeSlot) && SlotsPerSlab > 0);
+}
+
+BlockAllocator::ThreadCache &BlockAllocator::GetThreadCache() {
+  static thread_local ThreadCache Caches[Globals::MaxBlockAllocatorsNum];
+  auto &TC = Caches[Idx];
+  TC.Owner = this;
+  return TC;
+}
+
+void BlockAllocator::MapSlab() {
+  // Slabs are aligned to huge pages so that they can be backed by them
+  std::size_t MapSize = SlabSize + Globals::BlockSlabSize;
+  void *Map = mmap(nullptr, MapSize, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (Map == MAP_FAILED)
+    throw std::bad_alloc();
+  auto Addr = reinterpret_cast<uintptr_t>(Map);
+  auto Aligned = (Addr + Globals::BlockSlabSize - 1) &
+                 ~(uintptr_t(Globals::BlockSlabSize) - 1);
+  if (Aligned > Addr)
+    munmap(Map, Aligned - Addr);
+  if (Aligned + SlabSize < Addr + MapSize)
+    munmap(reinterpret_cast<void *>(Aligned + SlabSize),
+           Addr + MapSize - Aligned - SlabSize);
+  auto *Slab = reinterpret_cast<char *>(Aligned);
+#ifdef MADV_HUGEPAGE
+  // Only a hint, slabs work with regular pages as well
+  madvise(Slab, SlabSize, MADV_HUGEPAGE);
+#endif
+  Slabs.push_back(Slab);
+  SlabCursor = Slab;
+  SlabEnd = Slab + SlotsPerSlab * SlotSize;
+  Log::DefaultLogger.LogDebug("[BlockAllocator] Mapped slab #", Slabs.size(),
+                              " for ", SlotSize, " byte slots");
+}
+
+void BlockAllocator::Refill(ThreadCache &TC) {
+  LockGuard<MutexLocker> G(&Lock);
+  while (TC.Num < BatchNum) {
+    FreeSlot *Slot = FreeSlots;
+    if (Slot) {
+      FreeSlots = Slot->Next;
+    } else {
+      // Slots are carved lazily, so slab pages are touched only when used
+      if (SlabCursor == SlabEnd) {
+        if (TC.Num > 0)
+          return;
+        MapSlab();
+      }
+      Slot = reinterpret_cast<FreeSlot *>(SlabCursor);
+      SlabCursor += SlotSize;
+    }
+    Slot->Next = TC.Head;
+    TC.Head = Slot;
+    TC.Num++;
+  }
+}
+
+void BlockAllocator::Drain(ThreadCache &TC, std::size_t Num) {
+  LockGuard<MutexLocker> G(&Lock, false);
+  for (std::size_t i = 0; i < Num && TC.Head; i++) {
+    FreeSlot *Slot = TC.Head;
+    TC.Head = Slot->Next;
+    TC.Num--;
+    Slot->Next = FreeSlots;
+    FreeSlots = Slot;
+  }
+}
+
+void *BlockAllocator::Allocate() {
+  auto &TC = GetThreadCache();
+  if (!TC.Head)
+    Refill(TC);
+  FreeSlot *Slot = TC.Head;
+  TC.Head = Slot->Next;
+  TC.Num--;
+  UsedSlotsNum.fetch_add(1, std::memory_order_relaxed);
+  return Slot;
+}
+
+void BlockAllocator::Deallocate(void *Ptr) {
+  if (!Ptr)
+    return;
+  // Slots may be freed by any thread, they join the freeing thread's list
+  auto &TC = GetThreadCache();
+  auto *Slot = static_cast<FreeSlot *>(Ptr);
+  Slot->Next = TC.Head;
+  TC.Head = Slot;
+  TC.Num++;
+  UsedSlotsNum.fetch_sub(1, std::memory_order_relaxed);
+  if (TC.Num >= 2 * BatchNum)
+    Drain(TC, BatchNum);
+}
+
+std::size_t BlockAllocator::GetSlotSize() const { return SlotSize; }
+
+BlockAllocatorStats BlockAllocator::GetStats() {
+  LockGuard<MutexLocker> G(&Lock, false);
+  return {Slabs.size(), Slabs.size() * SlotsPerSlab,
+          UsedSlotsNum.load(std::memory_order_relaxed),
+          Slabs.size() * SlabSize};
+}
+
+BlockAllocator::~BlockAllocator() {
+  for (auto *Slab : Slabs)
+    munmap(Slab, SlabSize);
+}
+} // namespace proxy
@@ -1,81 +1,270 @@
 #include <Cache/Cache.hpp>
+#include <Logging/Logger.hpp>
 #include <Parallel/LockGuard.hpp>
-#include <algorithm>
+#include <functional>
 
 namespace proxy {
-void Cache::PutRecord(const std::string &URI, CacheRecord *Record) {
-  {
-    LockGuard<WriteLocker> G(&RecordsLock);
-    Records[URI] = Record;
+// The key is kept by both the index and the eviction policy
+static std::size_t GetRecordOverhead(const std::string &URI) {
+  return sizeof(CacheRecord) + 2 * URI.size() + Globals::CacheEntryOverhead;
+}
+
+Cache::Cache(std::size_t Capacity, EvictionPolicyType PolicyType,
+             DiskCache *Disk)
+    : Shards(new Shard[Globals::CacheShardsNum]), Capacity(Capacity),
+      MaxRecordSize(Capacity / 100 * Globals::CacheMaxRecordPercent),
+      Disk(Disk) {
+  for (std::size_t i = 0; i < Globals::CacheShardsNum; i++)
+    Shards[i].Policy = EvictionPolicy::Create(
+        PolicyType, Capacity / Globals::CacheShardsNum);
+}
+
+std::size_t Cache::GetKeyHash(const std::string &URI) {
+  return std::hash<std::string>()(URI);
+}
+
+Cache::Shard &Cache::GetShard(std::size_t KeyHash) {
+  // The low bits pick the bucket within the shard map
+  uint64_t Mixed = KeyHash * 0x9E3779B97F4A7C15ULL;
+  return Shards[(Mixed >> 32) & (Globals::CacheShardsNum - 1)];
+}
+
+void Cache::DropRefresh(Entry &E) {
+  // The remote keeps downloading it, but it won't be swapped in
+  if (E.Refresh)
+    E.Refresh->Unref();
+  E.Refresh = nullptr;
+}
+
+CacheRecord *Cache::GetOrCreateRecord(Shard &S, const std::string &URI,
+                                      std::size_t KeyHash,
+                                      CacheRecordPtr &Download) {
+  auto It = S.Records.find(URI);
+  int64_t Now = Freshness::Now();
+  if (It != S.Records.end()) {
+    auto *Record = It->second.Record;
+    // Records being downloaded are as fresh as it gets, but they're only
+    // shared once the headers say the response may be stored. Until then
+    // it may turn out to be private, so other requests go to the origin.
+    if (!Record->IsFinished()) {
+      if (!Record->HasFreshness() || !Record->GetFreshness().IsStorable)
+        return nullptr;
+      S.Policy->OnAccess(URI);
+      return Record;
+    }
+    const auto *Fresh = &Record->GetFreshness();
+    if (Fresh->IsFresh(Now)) {
+      S.Policy->OnAccess(URI);
+      return Record;
+    }
+    // Only complete records can be served while they're refreshed, the
+    // rest of an incomplete one would be fetched from the new version
+    if (Record->IsComplete() && Fresh->CanServeStale(Now)) {
+      S.Policy->OnAccess(URI);
+      if (It->second.Refresh)
+        return Record;
+      Log::DefaultLogger.LogDebug("[Cache] Refreshing stale ", URI);
+      auto *Refresh = new CacheRecord(URI, this, KeyHash, true);
+      if (Fresh->HasValidators())
+        Refresh->SetStale(CacheRecordPtr(Record));
+      It->second.Refresh = Refresh;
+      Download = CacheRecordPtr(Refresh);
+      return Record;
+    }
   }
 
-  LockGuard<ReadLocker> G(&URIListenersLock);
-  auto ListenersIt = URIListeners.find(URI);
-  if (ListenersIt == URIListeners.end())
-    return;
+  auto *CR = new CacheRecord(URI, this, KeyHash);
+  std::size_t Size = GetRecordOverhead(URI);
+  Download = CacheRecordPtr(CR);
+  if (It == S.Records.end()) {
+    S.Records.emplace(URI, Entry{CR, Size});
+    S.Policy->OnInsert(URI, Size);
+    UsedSize += Size;
+    return CR;
+  }
 
-  for (CacheListener *CL : ListenersIt->second)
-    Record->AddListener(CL);
+  // The stale record is replaced, its readers keep it until they're done
+  auto *StaleRecord = It->second.Record;
+  Log::DefaultLogger.LogDebug("[Cache] Replacing stale ", URI);
+  if (StaleRecord->IsComplete() &&
+      StaleRecord->GetFreshness().HasValidators())
+    CR->SetStale(CacheRecordPtr(StaleRecord));
+  UsedSize -= It->second.Size;
+  UsedSize += Size;
+  StaleRecord->Unref();
+  DropRefresh(It->second);
+  It->second = Entry{CR, Size};
+  S.Policy->OnResize(URI, Size);
+  S.Policy->OnAccess(URI);
+  return CR;
 }
 
-CacheRecord *Cache::GetRecord(const std::string &URI) {
+bool Cache::AddListener(const std::string &URI, CacheListener *Listener,
+                        CacheRecordPtr &Download) {
+  std::size_t KeyHash = GetKeyHash(URI);
   {
-    LockGuard<ReadLocker> G(&RecordsLock);
-    auto It = Records.find(URI);
-    if (It != Records.end())
-      return It->second;
+    auto &S = GetShard(KeyHash);
+    LockGuard<MutexLocker> G(&S.Lock);
+    auto *Record = GetOrCreateRecord(S, URI, KeyHash, Download);
+    if (!Record)
+      return false;
+    // Attached under the lock, so the record can't be evicted meanwhile
+    Record->AddListener(Listener);
   }
-  auto *CR = new CacheRecord(URI);
-  PutRecord(URI, CR);
-  return CR;
+  Evict();
+  return true;
 }
 
 bool Cache::HasRecord(const std::string &URI) {
-  LockGuard<ReadLocker> G(&RecordsLock);
-  return Records.find(URI) != Records.end();
+  auto &S = GetShard(GetKeyHash(URI));
+  LockGuard<MutexLocker> G(&S.Lock);
+  return S.Records.find(URI) != S.Records.end();
 }
 
-CacheRecord *Cache::TryGetRecord(const std::string &URI) {
-  LockGuard<ReadLocker> G(&RecordsLock);
-  auto It = Records.find(URI);
-  if (It != Records.end())
-    return It->second;
-  return nullptr;
+bool Cache::ChargeRecord(CacheRecord *Record, std::size_t Size) {
+  bool Fits = true;
+  {
+    auto &S = GetShard(Record->GetKeyHash());
+    LockGuard<MutexLocker> G(&S.Lock);
+    auto It = S.Records.find(Record->GetAddress());
+    // Refreshes and evicted records aren't charged, but are still limited
+    if (It == S.Records.end() || It->second.Record != Record)
+      return Record->GetMemorySize() <= MaxRecordSize;
+    if (It->second.IsSpilling)
+      return Record->GetMemorySize() <= Globals::DiskSegmentSize;
+    It->second.Size += Size;
+    S.Policy->OnResize(It->first, It->second.Size);
+    UsedSize += Size;
+    Fits = It->second.Size <= MaxRecordSize ||
+           StartSpill(It->first, S, It->second);
+  }
+  Evict();
+  return Fits;
+}
+
+bool Cache::StartSpill(const std::string &URI, Shard &S, Entry &E) {
+  if (!Disk || E.Record->GetMemorySize() > Globals::DiskSegmentSize)
+    return false;
+  if (SpillingNum.fetch_add(1) >= Globals::DiskMaxSpillingRecords) {
+    SpillingNum--;
+    return false;
+  }
+  Log::DefaultLogger.LogDebug("[Cache] Spilling ", URI, " to disk");
+  // Still in the index, so that other requests join the download
+  std::size_t Size = GetRecordOverhead(URI);
+  UsedSize -= E.Size;
+  UsedSize += Size;
+  E.Size = Size;
+  E.IsSpilling = true;
+  S.Policy->OnResize(URI, Size);
+  E.Record->SetSpilling();
+  return true;
 }
 
-void Cache::AddListener(const std::string &URI, CacheListener *Listener) {
+void Cache::CommitSpill(CacheRecord *Record) {
+  CacheRecordPtr Spilled;
   {
-    LockGuard<WriteLocker> G(&URIListenersLock);
-    auto It = URIListeners.find(URI);
-    if (It == URIListeners.end())
-      URIListeners[URI] = {Listener};
-    else
-      It->second.insert(Listener);
+    auto &S = GetShard(Record->GetKeyHash());
+    LockGuard<MutexLocker> G(&S.Lock);
+    auto It = S.Records.find(Record->GetAddress());
+    // The record may have been evicted or replaced meanwhile
+    if (It != S.Records.end() && It->second.Record == Record) {
+      UsedSize -= It->second.Size;
+      if (Record->IsComplete())
+        Spilled = CacheRecordPtr(Record);
+      // The writer still holds the record
+      Record->Unref();
+      DropRefresh(It->second);
+      S.Records.erase(It);
+      S.Policy->OnRemove(Record->GetAddress());
+    }
   }
+  SpillingNum--;
+  // Requests coming before the write is done download the record again
+  if (Spilled)
+    Disk->Store(Record->GetAddress(), std::move(Spilled));
+}
 
-  if (auto *Record = TryGetRecord(URI))
-    Record->AddListener(Listener);
+void Cache::CommitRefresh(CacheRecord *Record) {
+  {
+    auto &S = GetShard(Record->GetKeyHash());
+    LockGuard<MutexLocker> G(&S.Lock);
+    auto It = S.Records.find(Record->GetAddress());
+    // The stale record may have been evicted or replaced meanwhile
+    if (It == S.Records.end() || It->second.Refresh != Record)
+      return;
+    It->second.Refresh = nullptr;
+    // A failed refresh is retried by a later request
+    if (!Record->IsComplete()) {
+      Record->Unref();
+      return;
+    }
+    Log::DefaultLogger.LogDebug("[Cache] Refreshed ", It->first);
+    // The index takes over the refresh reference, readers of the stale
+    // record keep it until they're done
+    std::size_t Size = GetRecordOverhead(It->first) + Record->GetMemorySize();
+    UsedSize -= It->second.Size;
+    UsedSize += Size;
+    It->second.Record->Unref();
+    It->second.Record = Record;
+    It->second.Size = Size;
+    S.Policy->OnResize(It->first, Size);
+  }
+  Evict();
 }
 
-void Cache::RemoveListener(const std::string &URI, CacheListener *Listener) {
+void Cache::EvictFrom(Shard &S) {
+  auto CanEvict = [&S](const std::string &URI) {
+    auto *Record = S.Records.find(URI)->second.Record;
+    return Record->IsFinished();
+  };
+
+  std::string Victim;
+  CacheRecordPtr Spilled;
   {
-    LockGuard<ReadLocker> G(&URIListenersLock);
-    auto ListenersIt = URIListeners.find(URI);
-    if (ListenersIt == URIListeners.end())
+    LockGuard<MutexLocker> G(&S.Lock);
+    if (!S.Policy->SelectVictim(CanEvict, Victim))
       return;
-    auto &Vec = ListenersIt->second;
-    auto It = std::find(Vec.begin(), Vec.end(), Listener);
-    if (It != Vec.end())
-      Vec.erase(It);
+    Log::DefaultLogger.LogDebug("[Cache] Evicting ", Victim);
+    auto It = S.Records.find(Victim);
+    UsedSize -= It->second.Size;
+    if (Disk && It->second.Record->IsComplete())
+      Spilled = CacheRecordPtr(It->second.Record);
+    // Readers may still hold the record
+    It->second.Record->Unref();
+    DropRefresh(It->second);
+    S.Records.erase(It);
+    S.Policy->OnRemove(Victim);
+    S.EvictionsNum++;
   }
+  // Handed over to the disk tier without holding up the shard
+  if (Spilled)
+    Disk->Store(Victim, std::move(Spilled));
+}
 
-  if (auto *Record = TryGetRecord(URI))
-    Record->RemoveListener(Listener);
+void Cache::Evict() {
+  // Every shard gets a chance to give up its coldest record, a single lock
+  // is held at a time
+  for (std::size_t i = 0; i < Globals::CacheShardsNum && UsedSize > Capacity;
+       i++)
+    EvictFrom(Shards[EvictionCursor++ & (Globals::CacheShardsNum - 1)]);
+}
+
+CacheStats Cache::GetStats() {
+  CacheStats Stats{UsedSize, 0, 0};
+  for (std::size_t i = 0; i < Globals::CacheShardsNum; i++) {
+    LockGuard<MutexLocker> G(&Shards[i].Lock);
+    Stats.RecordsNum += Shards[i].Records.size();
+    Stats.EvictionsNum += Shards[i].EvictionsNum;
+  }
+  return Stats;
 }
 
 Cache::~Cache() {
-  LockGuard<WriteLocker> G(&RecordsLock, false);
-  for (auto &It : Records)
-    delete It.second;
+  for (std::size_t i = 0; i < Globals::CacheShardsNum; i++)
+    for (auto &It : Shards[i].Records) {
+      It.second.Record->Unref();
+      DropRefresh(It.second);
+    }
 }
 } // namespace proxy
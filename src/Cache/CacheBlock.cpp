@@ -1,18 +1,108 @@
 #include <Cache/CacheBlock.hpp>
-#include <Parallel/LockGuard.hpp>
+#include <cassert>
+#include <new>
 
 namespace proxy {
-std::vector<char> &CacheBlock::GetBytes() { return Bytes; }
+static_assert(sizeof(CacheBlock) <= CacheBlock::HeaderSize,
+              "Cache block header doesn't fit its slot");
 
-const std::vector<char> &CacheBlock::GetBytes() const { return Bytes; }
+static constexpr std::size_t GetClassesNum() {
+  std::size_t Num = 1;
+  while ((Globals::MinCacheBlockSize << (Num - 1)) <
+         Globals::CacheBlockSizeLimit)
+    Num++;
+  return Num;
+}
+
+static constexpr std::size_t ClassesNum = GetClassesNum();
+static_assert(ClassesNum <= Globals::MaxBlockAllocatorsNum,
+              "Too many cache block sizes");
+
+static std::size_t GetSlotSize(std::size_t ClassIdx) {
+  return Globals::MinCacheBlockSize << ClassIdx;
+}
+
+static BlockAllocator &GetAllocator(std::size_t ClassIdx) {
+  static struct Allocators {
+    std::unique_ptr<BlockAllocator> Items[ClassesNum];
+
+    Allocators() {
+      for (std::size_t i = 0; i < ClassesNum; i++)
+        Items[i] = std::make_unique<BlockAllocator>(GetSlotSize(i));
+    }
+  } Instance;
+  return *Instance.Items[ClassIdx];
+}
+
+CacheBlock *CacheBlock::Create(std::size_t MinCapacity) {
+  std::size_t ClassIdx = 0;
+  while (ClassIdx + 1 < ClassesNum &&
+         GetSlotSize(ClassIdx) - HeaderSize < MinCapacity)
+    ClassIdx++;
+  void *Slot = GetAllocator(ClassIdx).Allocate();
+  return new (Slot) CacheBlock(ClassIdx);
+}
+
+void CacheBlock::Destroy(CacheBlock *Block) {
+  if (!Block)
+    return;
+  std::size_t ClassIdx = Block->ClassIdx;
+  Block->~CacheBlock();
+  GetAllocator(ClassIdx).Deallocate(Block);
+}
+
+BlockAllocatorStats CacheBlock::GetAllocatorStats() {
+  BlockAllocatorStats Total{0, 0, 0, 0};
+  for (std::size_t i = 0; i < ClassesNum; i++) {
+    auto Stats = GetAllocator(i).GetStats();
+    Total.SlabsNum += Stats.SlabsNum;
+    Total.SlotsNum += Stats.SlotsNum;
+    Total.UsedSlotsNum += Stats.UsedSlotsNum;
+    Total.Size += Stats.Size;
+  }
+  return Total;
+}
+
+char *CacheBlock::GetData() { return reinterpret_cast<char *>(this) + HeaderSize; }
+
+const char *CacheBlock::GetData() const {
+  return reinterpret_cast<const char *>(this) + HeaderSize;
+}
+
+std::size_t CacheBlock::GetSize() const {
+  return Size.load(std::memory_order_acquire);
+}
+
+void CacheBlock::Grow(std::size_t Size) {
+  // Only the writer changes the size
+  std::size_t NewSize = this->Size.load(std::memory_order_relaxed) + Size;
+  assert(NewSize <= GetCapacity());
+  this->Size.store(NewSize, std::memory_order_release);
+}
+
+std::size_t CacheBlock::GetCapacity() const {
+  return GetSlotSize(ClassIdx) - HeaderSize;
+}
+
+std::size_t CacheBlock::GetFreeSpace() const {
+  return GetCapacity() - Size.load(std::memory_order_relaxed);
+}
+
+std::size_t CacheBlock::GetMemorySize() const { return GetSlotSize(ClassIdx); }
+
+CacheBlock *CacheBlock::GetNext() const {
+  return Next.load(std::memory_order_acquire);
+}
+
+void CacheBlock::SetNext(CacheBlock *Block) {
+  Next.store(Block, std::memory_order_release);
+}
 
 void CacheBlock::SetFinal(bool Final) {
-  LockGuard<MutexLocker> G(&IsFinalMutex);
-  _IsFinal = Final;
+  _IsFinal.store(Final, std::memory_order_release);
 }
 
-bool CacheBlock::IsFinal() {
-  LockGuard<MutexLocker> G(&IsFinalMutex);
-  return _IsFinal;
+bool CacheBlock::IsFinal() const {
+  return _IsFinal.load(std::memory_order_acquire);
 }
 } // namespace proxy
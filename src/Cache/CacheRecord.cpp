@@ -1,3 +1,4 @@
+#include <Cache/Cache.hpp>
 #include <Cache/CacheRecord.hpp>
 #include <Logging/Logger.hpp>
 #include <Parallel/LockGuard.hpp>
@@ -6,83 +7,161 @@
 namespace proxy {
 void CacheRecord::NotifyRecordUpdate() {
   LockGuard<MutexLocker> G(&ListenersMutex);
-  for (auto *L : Listeners)
-    L->OnCacheRecordUpdate(this);
+  for (auto &[Queue, QueueListeners] : Listeners)
+    Queue->WakeupListeners(QueueListeners.data(), QueueListeners.size());
 }
 
-void CacheRecord::AppendBlock(CacheBlock *Block) {
-  {
-    LockGuard<MutexLocker> G(&BlocksMutex);
-    Blocks.push_back(Block);
-  }
-  {
-    LockGuard<MutexLocker> G(&TotalSizeMutex);
-    TotalSize += Block->GetBytes().size();
-  }
+const std::string &CacheRecord::GetAddress() const { return Address; }
+
+std::size_t CacheRecord::GetKeyHash() const { return KeyHash; }
+
+bool CacheRecord::AppendBlock(CacheBlock *Block) {
+  TotalSize.fetch_add(Block->GetSize(), std::memory_order_relaxed);
+  // The block bytes become visible to readers along with the link
+  if (LastBlock)
+    LastBlock->SetNext(Block);
+  else
+    FirstBlock.store(Block, std::memory_order_release);
+  LastBlock = Block;
+  MemorySize += Block->GetMemorySize();
+  bool Fits = !Owner || Owner->ChargeRecord(this, Block->GetMemorySize());
   NotifyRecordUpdate();
+  return Fits;
 }
 
-void CacheRecord::SetComplete(bool Complete) {
-  LockGuard<MutexLocker> G(&IsCompleteMutex);
-  _IsComplete = Complete;
+CacheBlock *CacheRecord::GetLastBlock() { return LastBlock; }
+
+void CacheRecord::GrowLastBlock(std::size_t Size) {
+  TotalSize.fetch_add(Size, std::memory_order_relaxed);
+  LastBlock->Grow(Size);
+  NotifyRecordUpdate();
 }
 
-bool CacheRecord::IsComplete() {
-  LockGuard<MutexLocker> G(&IsCompleteMutex);
-  return _IsComplete;
+void CacheRecord::SetComplete(bool Complete) {
+  _IsComplete.store(Complete, std::memory_order_relaxed);
 }
 
-bool CacheRecord::IsFinished() {
-  LockGuard<MutexLocker> G(&IsFinishedMutex);
-  return _IsFinished;
+bool CacheRecord::IsComplete() const {
+  return _IsComplete.load(std::memory_order_relaxed);
 }
 
-std::size_t CacheRecord::GetTotalSize() {
-  LockGuard<MutexLocker> G(&TotalSizeMutex);
-  return TotalSize;
+bool CacheRecord::IsFinished() const {
+  return _IsFinished.load(std::memory_order_acquire);
 }
 
-std::size_t CacheRecord::GetNumBlocks() {
-  LockGuard<MutexLocker> G(&BlocksMutex);
-  return Blocks.size();
+std::size_t CacheRecord::GetTotalSize() const {
+  return TotalSize.load(std::memory_order_relaxed);
 }
 
+std::size_t CacheRecord::GetMemorySize() const { return MemorySize; }
+
+void CacheRecord::SetSpilling() { IsSpilling = true; }
+
 void CacheRecord::AddListener(CacheListener *Listener) {
   {
+    auto *Queue = Listener->GetWakeupQueue();
     LockGuard<MutexLocker> G(&ListenersMutex);
-    Listeners.insert(Listener);
+    auto It = std::find_if(Listeners.begin(), Listeners.end(),
+                           [Queue](const auto &P) { return P.first == Queue; });
+    if (It == Listeners.end())
+      It = Listeners.emplace(Listeners.end(), Queue,
+                             std::vector<CacheListener *>());
+    It->second.push_back(Listener);
   }
-  Listener->OnCacheRecordUpdate(this);
+  Listener->OnCacheRecordAttach(this);
 }
 
 void CacheRecord::RemoveListener(CacheListener *Listener) {
+  auto *Queue = Listener->GetWakeupQueue();
   LockGuard<MutexLocker> G(&ListenersMutex);
-  auto It = std::find(Listeners.begin(), Listeners.end(), Listener);
-  Listeners.erase(It);
+  auto It = std::find_if(Listeners.begin(), Listeners.end(),
+                         [Queue](const auto &P) { return P.first == Queue; });
+  if (It == Listeners.end())
+    return;
+  auto &QueueListeners = It->second;
+  auto LIt = std::find(QueueListeners.begin(), QueueListeners.end(), Listener);
+  if (LIt == QueueListeners.end())
+    return;
+  // The order doesn't matter
+  *LIt = QueueListeners.back();
+  QueueListeners.pop_back();
+  if (QueueListeners.empty())
+    Listeners.erase(It);
 }
 
-CacheBlock *CacheRecord::GetBlock(std::size_t Idx) {
-  LockGuard<MutexLocker> G(&BlocksMutex);
-  return Blocks.size() > Idx ? Blocks[Idx] : nullptr;
+void CacheRecord::SetStale(RefPtr<CacheRecord> Record) {
+  Stale = std::move(Record);
 }
 
-bool CacheRecord::HasBlock(std::size_t Idx) {
-  LockGuard<MutexLocker> G(&BlocksMutex);
-  return Blocks.size() > Idx;
+RefPtr<CacheRecord> CacheRecord::TakeStale() {
+  RefPtr<CacheRecord> Record;
+  Record.Swap(Stale);
+  return Record;
 }
 
-void CacheRecord::Finish() {
-  LockGuard<MutexLocker> G(&BlocksMutex);
-  if (Blocks.size() > 0) {
-    (*Blocks.rbegin())->SetFinal(true);
-    LockGuard<MutexLocker> G(&IsFinishedMutex);
-    _IsFinished = true;
+void CacheRecord::SetFreshness(Freshness NewFresh) {
+  Fresh = std::move(NewFresh);
+  // Readers joining the download check it before the record is finished
+  _HasFreshness.store(true, std::memory_order_release);
+}
+
+bool CacheRecord::HasFreshness() const {
+  return _HasFreshness.load(std::memory_order_acquire);
+}
+
+const Freshness &CacheRecord::GetFreshness() const { return Fresh; }
+
+bool CacheRecord::ServeFrom(CacheRecord *Validated) {
+  // Records aren't chained, the one holding the blocks is shared
+  CacheRecord *Content = Validated->Source.load(std::memory_order_acquire);
+  if (!Content)
+    Content = Validated;
+  Content->Ref();
+  TotalSize.store(Content->GetTotalSize(), std::memory_order_relaxed);
+  MemorySize = Content->MemorySize;
+  Source.store(Content, std::memory_order_release);
+  bool Fits = !Owner || Owner->ChargeRecord(this, MemorySize);
+  NotifyRecordUpdate();
+  return Fits;
+}
+
+std::size_t CacheRecord::GetBlocks(const CacheBlock *After,
+                                   CacheBlockSpan *Out, std::size_t MaxNum) {
+  if (auto *Content = Source.load(std::memory_order_acquire))
+    return Content->GetBlocks(After, Out, MaxNum);
+  CacheBlock *Block =
+      After ? After->GetNext() : FirstBlock.load(std::memory_order_acquire);
+  std::size_t Num = 0;
+  while (Block && Num < MaxNum) {
+    // The size is read last, it's final if the block is sealed
+    bool IsFinal = Block->IsFinal();
+    CacheBlock *Next = Block->GetNext();
+    Out[Num++] = {Block, Block->GetSize(), IsFinal || Next, IsFinal};
+    Block = Next;
   }
+  return Num;
+}
+
+void CacheRecord::Finish() {
+  // The completeness is published along with the finished flag
+  if (LastBlock)
+    LastBlock->SetFinal(true);
+  _IsFinished.store(true, std::memory_order_release);
+  NotifyRecordUpdate();
+  if (Owner && IsRefresh)
+    Owner->CommitRefresh(this);
+  else if (Owner && IsSpilling)
+    Owner->CommitSpill(this);
 }
 
 CacheRecord::~CacheRecord() {
-  LockGuard<MutexLocker> G(&BlocksMutex, false);
-  for (auto *B : Blocks)
-    delete B;
+  if (auto *Content = Source.load(std::memory_order_relaxed))
+    Content->Unref();
+  CacheBlock *Block = FirstBlock.load(std::memory_order_relaxed);
+  while (Block) {
+    auto *Next = Block->GetNext();
+    CacheBlock::Destroy(Block);
+    Block = Next;
+  }
 }
 } // namespace proxy
@@ -0,0 +1,335 @@
+#include <Cache/DiskCache.hpp>
+#include <Common/Globals.hpp>
+#include <Common/ProxyException.hpp>
+#include <Common/Utils.hpp>
+#include <Functional/Function.hpp>
+#include <Logging/Logger.hpp>
+#include <Parallel/LockGuard.hpp>
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <dirent.h>
+#include <map>
+#include <optional>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_set>
+
+namespace proxy {
+static const std::string SegmentSuffix = ".seg";
+static const std::string JournalName = "index.log";
+
+static bool IsSegmentName(const std::string &Name) {
+  return Name.size() > SegmentSuffix.size() &&
+         Name.compare(Name.size() - SegmentSuffix.size(), SegmentSuffix.size(),
+                      SegmentSuffix) == 0;
+}
+
+DiskCache::DiskCache(std::string Dir, std::size_t Capacity, ThreadPool *Pool)
+    : Dir(std::move(Dir)), Capacity(Capacity), Pool(Pool),
+      Journal(this->Dir + "/" + JournalName) {
+  if (mkdir(this->Dir.c_str(), 0700) < 0 && errno != EEXIST)
+    Exception::ThrowSystemError("mkdir() " + this->Dir);
+  LoadSegments();
+}
+
+void DiskCache::LoadSegments() {
+  // Later entries of a key replace the earlier ones
+  std::unordered_map<std::string, DiskJournalEntry> Latest;
+  for (auto &Entry : Journal.Load())
+    Latest[Entry.Key] = std::move(Entry);
+  std::map<uint64_t, std::vector<DiskJournalEntry>> Entries;
+  for (auto &It : Latest) {
+    auto &Entry = It.second;
+    // Stale records wouldn't be served anyway
+    if (Entry.IsComplete && Entry.Size > 0 &&
+        Entry.ExpiresAt > Freshness::Now() &&
+        Entry.Offset + Entry.Size <= Globals::DiskSegmentSize)
+      Entries[Entry.SegmentId].push_back(std::move(Entry));
+  }
+
+  DIR *D = opendir(Dir.c_str());
+  if (!D)
+    Exception::ThrowSystemError("opendir() " + Dir);
+  std::map<uint64_t, DiskSegmentPtr> Files;
+  while (auto *DirEntry = readdir(D)) {
+    std::string Name = DirEntry->d_name;
+    if (!IsSegmentName(Name))
+      continue;
+    auto Path = Dir + "/" + Name;
+    char *IdEnd;
+    uint64_t Id = strtoull(Name.c_str(), &IdEnd, 10);
+    // Segments without journaled records are of no use
+    if (IdEnd != Name.c_str() + Name.size() - SegmentSuffix.size() ||
+        Entries.find(Id) == Entries.end()) {
+      unlink(Path.c_str());
+      continue;
+    }
+    try {
+      Files[Id] = DiskSegmentPtr::Adopt(
+          new DiskSegment(Path, Globals::DiskSegmentSize, false));
+    } catch (const std::system_error &E) {
+      Log::DefaultLogger.LogError("[DiskCache] ", E.what());
+      unlink(Path.c_str());
+    }
+  }
+  closedir(D);
+
+  for (auto &It : Files)
+    Segments.push_back({It.second, It.first, {}});
+  while (!Segments.empty() &&
+         Segments.size() * Globals::DiskSegmentSize > Capacity) {
+    Files.erase(Segments.front().Id);
+    DropOldestSegment()->Unlink();
+  }
+  if (!Segments.empty())
+    NextSegmentId = Segments.back().Id + 1;
+  // New records go to a fresh segment, the loaded ones may have been cut off
+  WriteOffset = Globals::DiskSegmentSize;
+
+  std::vector<DiskJournalEntry> Kept;
+  for (auto &It : Files)
+    for (auto &Entry : Entries[It.first])
+      Kept.push_back(Entry);
+  Journal.Rewrite(Kept);
+  JournalEntriesNum = Kept.size();
+  if (!Kept.empty())
+    Log::DefaultLogger.LogInfo("[DiskCache] Found ", Kept.size(),
+                               " records in ", Files.size(), " segments");
+
+  // The records become available as their segments are verified
+  for (auto &It : Files)
+    Pool->Submit(Function(&DiskCache::VerifySegment, this,
+                          std::move(It.second),
+                          std::move(Entries[It.first])));
+}
+
+void DiskCache::VerifySegment(DiskSegmentPtr File,
+                              std::vector<DiskJournalEntry> Entries) {
+  std::size_t VerifiedNum = 0;
+  for (auto &Entry : Entries) {
+    const char *Bytes = File->GetData() + Entry.Offset;
+    if (Utils::Checksum(Bytes, Entry.Size) != Entry.DataChecksum) {
+      Log::DefaultLogger.LogError("[DiskCache] Damaged record ", Entry.Key,
+                                  " in ", File->GetPath());
+      continue;
+    }
+    LockGuard<MutexLocker> G(&Lock, false);
+    auto *S = FindSegment(File.Get());
+    // The segment may have been dropped meanwhile
+    if (!S)
+      break;
+    // A fresh copy of the record may have been written meanwhile
+    if (Index.find(Entry.Key) != Index.end())
+      continue;
+    Index[Entry.Key] = {File,
+                        Entry.Offset,
+                        Entry.Size,
+                        Entry.DataChecksum,
+                        Entry.ExpiresAt,
+                        std::move(Entry.ETag),
+                        std::move(Entry.LastModified)};
+    S->Keys.push_back(std::move(Entry.Key));
+    VerifiedNum++;
+  }
+  Log::DefaultLogger.LogDebug("[DiskCache] Loaded ", VerifiedNum, " of ",
+                              Entries.size(), " records from ",
+                              File->GetPath());
+}
+
+DiskCache::Segment *DiskCache::FindSegment(const DiskSegment *File) {
+  for (auto &S : Segments)
+    if (S.File.Get() == File)
+      return &S;
+  return nullptr;
+}
+
+std::vector<DiskJournalEntry> DiskCache::SnapshotJournal() {
+  std::vector<DiskJournalEntry> Entries;
+  std::unordered_set<std::string> Written;
+  for (const auto &S : Segments) {
+    for (const auto &Key : S.Keys) {
+      auto It = Index.find(Key);
+      // Skips the overwritten records and the repeated keys
+      if (It == Index.end() || It->second.Segment.Get() != S.File.Get() ||
+          !Written.insert(Key).second)
+        continue;
+      const auto &Entry = It->second;
+      Entries.push_back({Key, S.Id, Entry.Offset, Entry.Size,
+                         Entry.DataChecksum, true, Entry.ExpiresAt,
+                         Entry.ETag, Entry.LastModified});
+    }
+  }
+  // Records journaled from now on go to the new journal as well
+  Journal.StartRewrite();
+  JournalEntriesNum = Entries.size();
+  IsCompacting = true;
+  return Entries;
+}
+
+void DiskCache::CompactJournal(std::vector<DiskJournalEntry> Entries) {
+  try {
+    Journal.Rewrite(Entries);
+  } catch (const std::system_error &E) {
+    Log::DefaultLogger.LogError("[DiskCache] ", E.what());
+  }
+  LockGuard<MutexLocker> G(&Lock, false);
+  IsCompacting = false;
+}
+
+DiskSegmentPtr DiskCache::DropOldestSegment() {
+  auto &Oldest = Segments.front();
+  for (const auto &Key : Oldest.Keys) {
+    auto It = Index.find(Key);
+    if (It != Index.end() && It->second.Segment.Get() == Oldest.File.Get())
+      Index.erase(It);
+  }
+  Log::DefaultLogger.LogDebug("[DiskCache] Dropping ", Oldest.File->GetPath());
+  auto File = std::move(Oldest.File);
+  Segments.pop_front();
+  return File;
+}
+
+bool DiskCache::Reserve(std::size_t Size, DiskSegmentPtr &File,
+                        uint64_t &Offset) {
+  LockGuard<MutexLocker> RG(&ReserveLock, false);
+  if (WriteOffset + Size <= Globals::DiskSegmentSize) {
+    LockGuard<MutexLocker> G(&Lock, false);
+    if (!Segments.empty()) {
+      File = Segments.back().File;
+      Offset = WriteOffset;
+      WriteOffset += Size;
+      return true;
+    }
+  }
+
+  uint64_t Id = NextSegmentId++;
+  auto Path = Dir + "/" + std::to_string(Id) + SegmentSuffix;
+  try {
+    File = DiskSegmentPtr::Adopt(
+        new DiskSegment(Path, Globals::DiskSegmentSize));
+  } catch (const std::system_error &E) {
+    Log::DefaultLogger.LogError("[DiskCache] ", E.what());
+    return false;
+  }
+  std::vector<DiskSegmentPtr> Dropped;
+  {
+    LockGuard<MutexLocker> G(&Lock, false);
+    Segments.push_back({File, Id, {}});
+    while (Segments.size() > 1 &&
+           Segments.size() * Globals::DiskSegmentSize > Capacity)
+      Dropped.push_back(DropOldestSegment());
+  }
+  // Clients still reading from the dropped segments keep them mapped
+  for (auto &Old : Dropped)
+    Old->Unlink();
+  Offset = 0;
+  WriteOffset = Size;
+  return true;
+}
+
+void DiskCache::Store(const std::string &URI, CacheRecordPtr Record) {
+  std::size_t Size = Record->GetTotalSize();
+  const auto &Fresh = Record->GetFreshness();
+  if (Size == 0 || Size > Globals::DiskSegmentSize ||
+      !Fresh.IsFresh(Freshness::Now()))
+    return;
+  // Queued records are out of the memory budget, so their number is bounded
+  if (PendingWritesNum.fetch_add(1) >= Globals::DiskMaxPendingWrites) {
+    PendingWritesNum--;
+    return;
+  }
+  Pool->Submit(Function(&DiskCache::WriteRecord, this, std::string(URI),
+                        std::move(Record)));
+}
+
+void DiskCache::WriteRecord(std::string URI, CacheRecordPtr Record) {
+  const auto &Fresh = Record->GetFreshness();
+  {
+    LockGuard<MutexLocker> G(&Lock, false);
+    // Copies expiring later than this one are kept
+    auto It = Index.find(URI);
+    if (It != Index.end() && It->second.ExpiresAt >= Fresh.ExpiresAt) {
+      PendingWritesNum--;
+      return;
+    }
+  }
+  DiskSegmentPtr File;
+  uint64_t Offset;
+  if (!Reserve(Record->GetTotalSize(), File, Offset)) {
+    PendingWritesNum--;
+    return;
+  }
+
+  DiskCacheEntry Entry{File, Offset, 0, Utils::Checksum(nullptr, 0),
+                       Fresh.ExpiresAt, Fresh.ETag, Fresh.LastModified};
+  try {
+    CacheBlockSpan Blocks[Globals::MaxWriteBlocksNum];
+    const CacheBlock *Last = nullptr;
+    while (std::size_t Num = Record->GetBlocks(Last, Blocks,
+                                               Globals::MaxWriteBlocksNum)) {
+      for (std::size_t i = 0; i < Num; i++) {
+        const char *Bytes = Blocks[i].Block->GetData();
+        File->Write(Offset + Entry.Size, Bytes, Blocks[i].Size);
+        Entry.DataChecksum =
+            Utils::Checksum(Bytes, Blocks[i].Size, Entry.DataChecksum);
+        Entry.Size += Blocks[i].Size;
+      }
+      Last = Blocks[Num - 1].Block;
+    }
+  } catch (const std::system_error &E) {
+    Log::DefaultLogger.LogError("[DiskCache] ", E.what());
+    PendingWritesNum--;
+    return;
+  }
+  std::size_t Size = Entry.Size;
+  std::optional<std::vector<DiskJournalEntry>> Compacted;
+  {
+    LockGuard<MutexLocker> G(&Lock, false);
+    // The segment may have been dropped while being written
+    if (auto *S = FindSegment(File.Get())) {
+      // Journaled only once the data is in place
+      try {
+        Journal.Append({URI, S->Id, Entry.Offset, Entry.Size,
+                        Entry.DataChecksum, Record->IsComplete(),
+                        Entry.ExpiresAt, Entry.ETag, Entry.LastModified});
+        JournalEntriesNum++;
+      } catch (const std::system_error &E) {
+        Log::DefaultLogger.LogError("[DiskCache] ", E.what());
+      }
+      S->Keys.push_back(URI);
+      Index[URI] = std::move(Entry);
+      if (!IsCompacting &&
+          JournalEntriesNum >
+              Index.size() * 2 + Globals::DiskJournalMaxStaleEntries)
+        Compacted = SnapshotJournal();
+    }
+  }
+  if (Compacted)
+    CompactJournal(std::move(*Compacted));
+  WritesNum++;
+  PendingWritesNum--;
+  Log::DefaultLogger.LogDebug("[DiskCache] Stored ", URI, ", ", Size,
+                              " bytes");
+}
+
+bool DiskCache::Find(const std::string &URI, DiskCacheEntry &Entry) {
+  LockGuard<MutexLocker> G(&Lock);
+  auto It = Index.find(URI);
+  if (It == Index.end() || It->second.ExpiresAt <= Freshness::Now())
+    return false;
+  Entry = It->second;
+  HitsNum++;
+  return true;
+}
+
+DiskCacheStats DiskCache::GetStats() {
+  LockGuard<MutexLocker> G(&Lock, false);
+  std::size_t Size = 0;
+  for (const auto &It : Index)
+    Size += It.second.Size;
+  return {Size, Index.size(), Segments.size(), WritesNum, HitsNum};
+}
+
+DiskCache::~DiskCache() = default;
+} // namespace proxy
@@ -0,0 +1,207 @@
+#include <Cache/DiskJournal.hpp>
+#include <Common/Globals.hpp>
+#include <Common/ProxyException.hpp>
+#include <Common/Utils.hpp>
+#include <Logging/Logger.hpp>
+#include <Parallel/LockGuard.hpp>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace proxy {
+namespace {
+constexpr uint32_t EntryMagic = 0x45495850; // "PXIE"
+
+struct EntryHeader {
+  uint32_t Magic;
+  uint32_t Reserved;
+  // Covers the rest of the header and the strings that follow it
+  uint64_t Checksum;
+  uint64_t SegmentId;
+  uint64_t Offset;
+  uint64_t Size;
+  uint64_t DataChecksum;
+  int64_t ExpiresAt;
+  uint16_t KeySize;
+  uint16_t ETagSize;
+  uint16_t LastModifiedSize;
+  uint8_t IsComplete;
+  uint8_t Padding;
+};
+
+uint64_t GetEntryChecksum(EntryHeader Header, const char *Strings,
+                          std::size_t StringsSize) {
+  Header.Checksum = 0;
+  uint64_t Hash = Utils::Checksum(reinterpret_cast<const char *>(&Header),
+                                  sizeof(Header));
+  return Utils::Checksum(Strings, StringsSize, Hash);
+}
+
+std::string SerializeEntry(const DiskJournalEntry &Entry) {
+  EntryHeader Header;
+  memset(&Header, 0, sizeof(Header));
+  Header.Magic = EntryMagic;
+  Header.SegmentId = Entry.SegmentId;
+  Header.Offset = Entry.Offset;
+  Header.Size = Entry.Size;
+  Header.DataChecksum = Entry.DataChecksum;
+  Header.ExpiresAt = Entry.ExpiresAt;
+  Header.KeySize = Entry.Key.size();
+  Header.ETagSize = Entry.ETag.size();
+  Header.LastModifiedSize = Entry.LastModified.size();
+  Header.IsComplete = Entry.IsComplete;
+  std::string Strings = Entry.Key + Entry.ETag + Entry.LastModified;
+  Header.Checksum = GetEntryChecksum(Header, Strings.data(), Strings.size());
+  return std::string(reinterpret_cast<const char *>(&Header), sizeof(Header)) +
+         Strings;
+}
+
+void WriteAll(int FD, const std::string &Bytes, const std::string &Path) {
+  std::size_t Written = 0;
+  while (Written < Bytes.size()) {
+    ssize_t Status = write(FD, Bytes.data() + Written, Bytes.size() - Written);
+    if (Status < 0) {
+      if (errno == EINTR)
+        continue;
+      Exception::ThrowSystemError("write() " + Path);
+    }
+    Written += Status;
+  }
+}
+} // namespace
+
+DiskJournal::DiskJournal(std::string Path) : Path(std::move(Path)) {}
+
+std::vector<DiskJournalEntry> DiskJournal::Load() {
+  std::vector<DiskJournalEntry> Entries;
+  int ReadFD = open(Path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (ReadFD < 0) {
+    if (errno == ENOENT)
+      return Entries;
+    Exception::ThrowSystemError("open() " + Path);
+  }
+  std::string Bytes;
+  char Buf[Globals::DefaultReadBufferSize];
+  ssize_t ReadBytes;
+  while ((ReadBytes = read(ReadFD, Buf, sizeof(Buf))) != 0) {
+    if (ReadBytes < 0) {
+      if (errno == EINTR)
+        continue;
+      int Error = errno;
+      close(ReadFD);
+      Exception::ThrowSystemError(Error, "read() " + Path);
+    }
+    Bytes.append(Buf, ReadBytes);
+  }
+  close(ReadFD);
+
+  std::size_t Pos = 0;
+  while (Pos + sizeof(EntryHeader) <= Bytes.size()) {
+    EntryHeader Header;
+    memcpy(&Header, Bytes.data() + Pos, sizeof(Header));
+    std::size_t StringsSize =
+        Header.KeySize + Header.ETagSize + Header.LastModifiedSize;
+    const char *Strings = Bytes.data() + Pos + sizeof(Header);
+    if (Header.Magic != EntryMagic ||
+        Pos + sizeof(Header) + StringsSize > Bytes.size() ||
+        GetEntryChecksum(Header, Strings, StringsSize) != Header.Checksum)
+      break;
+    DiskJournalEntry Entry;
+    Entry.Key.assign(Strings, Header.KeySize);
+    Entry.ETag.assign(Strings + Header.KeySize, Header.ETagSize);
+    Entry.LastModified.assign(Strings + Header.KeySize + Header.ETagSize,
+                              Header.LastModifiedSize);
+    Entry.SegmentId = Header.SegmentId;
+    Entry.Offset = Header.Offset;
+    Entry.Size = Header.Size;
+    Entry.DataChecksum = Header.DataChecksum;
+    Entry.ExpiresAt = Header.ExpiresAt;
+    Entry.IsComplete = Header.IsComplete;
+    Entries.push_back(std::move(Entry));
+    Pos += sizeof(Header) + StringsSize;
+  }
+  if (Pos < Bytes.size())
+    Log::DefaultLogger.LogError("[DiskJournal] Ignoring ", Bytes.size() - Pos,
+                                " damaged bytes at the end of ", Path);
+  return Entries;
+}
+
+void DiskJournal::StartRewrite() {
+  LockGuard<MutexLocker> G(&Lock, false);
+  IsRewriting = true;
+  Backlog.clear();
+}
+
+void DiskJournal::Rewrite(const std::vector<DiskJournalEntry> &Entries) {
+  std::string Bytes;
+  for (const auto &Entry : Entries)
+    Bytes += SerializeEntry(Entry);
+
+  // The old journal stays intact until the new one is complete and on disk
+  std::string TmpPath = Path + ".tmp";
+  int TmpFD = -1;
+  try {
+    TmpFD = open(TmpPath.c_str(),
+                 O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0600);
+    if (TmpFD < 0)
+      Exception::ThrowSystemError("open() " + TmpPath);
+    // Flushed without holding up the appends, a crash right after the rename
+    // must not leave a journal that lost the entries
+    WriteAll(TmpFD, Bytes, TmpPath);
+    if (fsync(TmpFD) < 0)
+      Exception::ThrowSystemError("fsync() " + TmpPath);
+
+    // The entries appended meanwhile are as durable as any other append
+    LockGuard<MutexLocker> G(&Lock, false);
+    WriteAll(TmpFD, Backlog, TmpPath);
+    if (rename(TmpPath.c_str(), Path.c_str()) < 0)
+      Exception::ThrowSystemError("rename() " + TmpPath);
+    if (FD >= 0)
+      close(FD);
+    FD = TmpFD;
+    TmpFD = -1;
+    IsRewriting = false;
+    Backlog.clear();
+  } catch (...) {
+    if (TmpFD >= 0)
+      close(TmpFD);
+    LockGuard<MutexLocker> G(&Lock, false);
+    IsRewriting = false;
+    Backlog.clear();
+    throw;
+  }
+  SyncDir();
+}
+
+void DiskJournal::SyncDir() {
+  // The rename only survives a crash once the directory is flushed
+  auto Slash = Path.rfind('/');
+  std::string Dir = Slash == std::string::npos ? "." : Path.substr(0, Slash);
+  if (Dir.empty())
+    Dir = "/";
+  int DirFD = open(Dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (DirFD < 0)
+    Exception::ThrowSystemError("open() " + Dir);
+  int Status = fsync(DirFD);
+  int Error = errno;
+  close(DirFD);
+  if (Status < 0)
+    Exception::ThrowSystemError(Error, "fsync() " + Dir);
+}
+
+void DiskJournal::Append(const DiskJournalEntry &Entry) {
+  auto Bytes = SerializeEntry(Entry);
+  LockGuard<MutexLocker> G(&Lock);
+  if (IsRewriting)
+    Backlog += Bytes;
+  if (FD < 0)
+    return;
+  WriteAll(FD, Bytes, Path);
+}
+
+DiskJournal::~DiskJournal() {
+  if (FD >= 0)
+    close(FD);
+}
+} // namespace proxy
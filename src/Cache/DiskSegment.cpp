@@ -0,0 +1,67 @@
+#include <Cache/DiskSegment.hpp>
+#include <Common/ProxyException.hpp>
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace proxy {
+DiskSegment::DiskSegment(std::string Path, std::size_t Size, bool Create)
+    : Path(std::move(Path)), Size(Size) {
+  int Flags = O_RDWR | O_CLOEXEC | (Create ? O_CREAT | O_TRUNC : 0);
+  FD = open(this->Path.c_str(), Flags, 0600);
+  if (FD < 0)
+    Exception::ThrowSystemError("open() " + this->Path);
+  struct stat Stat;
+  if (!Create && (fstat(FD, &Stat) < 0 || Stat.st_size != off_t(Size))) {
+    close(FD);
+    Exception::ThrowSystemError(EINVAL, "Damaged segment " + this->Path);
+  }
+  // The file is sparse, space is taken as the responses are written
+  if (Create && ftruncate(FD, Size) < 0) {
+    int Error = errno;
+    close(FD);
+    unlink(this->Path.c_str());
+    Exception::ThrowSystemError(Error, "ftruncate() " + this->Path);
+  }
+  void *Map = mmap(nullptr, Size, PROT_READ, MAP_SHARED, FD, 0);
+  if (Map == MAP_FAILED) {
+    int Error = errno;
+    close(FD);
+    if (Create)
+      unlink(this->Path.c_str());
+    Exception::ThrowSystemError(Error, "mmap() " + this->Path);
+  }
+  Data = static_cast<char *>(Map);
+}
+
+const std::string &DiskSegment::GetPath() const { return Path; }
+
+int DiskSegment::GetFD() const { return FD; }
+
+const char *DiskSegment::GetData() const { return Data; }
+
+std::size_t DiskSegment::GetSize() const { return Size; }
+
+void DiskSegment::Write(uint64_t Offset, const char *Bytes, std::size_t Size) {
+  while (Size > 0) {
+    ssize_t Written = pwrite(FD, Bytes, Size, Offset);
+    if (Written < 0) {
+      if (errno == EINTR)
+        continue;
+      Exception::ThrowSystemError("pwrite() " + Path);
+    }
+    Bytes += Written;
+    Size -= Written;
+    Offset += Written;
+  }
+}
+
+void DiskSegment::Unlink() { unlink(Path.c_str()); }
+
+DiskSegment::~DiskSegment() {
+  munmap(Data, Size);
+  close(FD);
+}
+} // namespace proxy
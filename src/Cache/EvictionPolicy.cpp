@@ -0,0 +1,19 @@
+#include <Cache/EvictionPolicy.hpp>
+#include <Cache/LRUPolicy.hpp>
+#include <Cache/SLRUPolicy.hpp>
+#include <Cache/TinyLFUPolicy.hpp>
+
+namespace proxy {
+std::unique_ptr<EvictionPolicy>
+EvictionPolicy::Create(EvictionPolicyType Type, std::size_t Capacity) {
+  switch (Type) {
+  case EvictionPolicyType::SLRU:
+    return std::make_unique<SLRUPolicy>(Capacity);
+  case EvictionPolicyType::TinyLFU:
+    return std::make_unique<TinyLFUPolicy>(Capacity);
+  case EvictionPolicyType::LRU:
+  default:
+    return std::make_unique<LRUPolicy>();
+  }
+}
+} // namespace proxy
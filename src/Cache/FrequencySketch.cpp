@@ -0,0 +1,52 @@
+#include <Cache/FrequencySketch.hpp>
+#include <algorithm>
+#include <functional>
+
+namespace proxy {
+static std::size_t RoundUpToPowerOf2(std::size_t N) {
+  std::size_t Result = 1;
+  while (Result < N)
+    Result <<= 1;
+  return Result;
+}
+
+FrequencySketch::FrequencySketch(std::size_t Width) {
+  Width = RoundUpToPowerOf2(std::max<std::size_t>(Width, 64));
+  Counters.assign(Width * DepthNum, 0);
+  WidthMask = Width - 1;
+  SampleSize = Width * 10;
+}
+
+std::size_t FrequencySketch::GetCounterIdx(std::size_t Hash,
+                                           std::size_t Depth) const {
+  // Every row uses its own mix of the key hash
+  uint64_t H = (Hash + Depth) * 0x9E3779B97F4A7C15ULL;
+  H ^= H >> 32;
+  return Depth * (WidthMask + 1) + (H & WidthMask);
+}
+
+void FrequencySketch::Increment(const std::string &Key) {
+  std::size_t Hash = std::hash<std::string>()(Key);
+  for (std::size_t d = 0; d < DepthNum; d++) {
+    auto &Counter = Counters[GetCounterIdx(Hash, d)];
+    if (Counter < MaxCount)
+      Counter++;
+  }
+  if (++AdditionsNum >= SampleSize)
+    Age();
+}
+
+unsigned FrequencySketch::Estimate(const std::string &Key) const {
+  std::size_t Hash = std::hash<std::string>()(Key);
+  unsigned Result = MaxCount;
+  for (std::size_t d = 0; d < DepthNum; d++)
+    Result = std::min<unsigned>(Result, Counters[GetCounterIdx(Hash, d)]);
+  return Result;
+}
+
+void FrequencySketch::Age() {
+  for (auto &Counter : Counters)
+    Counter >>= 1;
+  AdditionsNum /= 2;
+}
+} // namespace proxy
@@ -0,0 +1,208 @@
+#include <Cache/Freshness.hpp>
+#include <Common/Globals.hpp>
+#include <Common/Utils.hpp>
+#include <algorithm>
+#include <cstdlib>
+#include <ctime>
+#include <optional>
+
+namespace proxy {
+namespace {
+struct CacheDirectives {
+  bool NoStore = false;
+  bool NoCache = false;
+  bool Private = false;
+  // Stale responses must not be served without revalidation
+  bool MustRevalidate = false;
+  std::optional<int64_t> MaxAge;
+  std::optional<int64_t> SharedMaxAge;
+  std::optional<int64_t> StaleWhileRevalidate;
+};
+
+std::optional<int64_t> ParseSeconds(const std::string &Value) {
+  auto Digits = Value;
+  // Quoted values are allowed by the grammar, though not recommended
+  if (Digits.size() >= 2 && Digits.front() == '"' && Digits.back() == '"')
+    Digits = Digits.substr(1, Digits.size() - 2);
+  char *End;
+  long long Seconds = strtoll(Digits.c_str(), &End, 10);
+  if (Digits.empty() || *End != '\0' || Seconds < 0)
+    return {};
+  return Seconds;
+}
+
+CacheDirectives ParseCacheControl(const std::string &Value) {
+  CacheDirectives Directives;
+  std::size_t Pos = 0;
+  while (Pos <= Value.size()) {
+    auto Comma = Value.find(',', Pos);
+    if (Comma == std::string::npos)
+      Comma = Value.size();
+    auto Directive = Utils::TrimString(Value.substr(Pos, Comma - Pos));
+    Pos = Comma + 1;
+    auto Equals = Directive.find('=');
+    auto Name = Utils::TrimString(Directive.substr(0, Equals));
+    auto Argument = Equals == std::string::npos
+                        ? std::string()
+                        : Utils::TrimString(Directive.substr(Equals + 1));
+    if (Utils::EqualsIgnoreCase(Name, "no-store"))
+      Directives.NoStore = true;
+    else if (Utils::EqualsIgnoreCase(Name, "no-cache"))
+      Directives.NoCache = true;
+    else if (Utils::EqualsIgnoreCase(Name, "private"))
+      Directives.Private = true;
+    else if (Utils::EqualsIgnoreCase(Name, "must-revalidate") ||
+             Utils::EqualsIgnoreCase(Name, "proxy-revalidate"))
+      Directives.MustRevalidate = true;
+    else if (Utils::EqualsIgnoreCase(Name, "max-age"))
+      Directives.MaxAge = ParseSeconds(Argument).value_or(0);
+    else if (Utils::EqualsIgnoreCase(Name, "s-maxage"))
+      Directives.SharedMaxAge = ParseSeconds(Argument).value_or(0);
+    else if (Utils::EqualsIgnoreCase(Name, "stale-while-revalidate"))
+      Directives.StaleWhileRevalidate = ParseSeconds(Argument).value_or(0);
+  }
+  return Directives;
+}
+
+// Only the preferred IMF-fixdate format is accepted, the obsolete ones are
+// treated as invalid dates
+std::optional<int64_t> ParseHTTPDate(const std::string &Value) {
+  struct tm Time = {};
+  const char *End = strptime(Value.c_str(), "%a, %d %b %Y %H:%M:%S GMT", &Time);
+  if (!End || *End != '\0')
+    return {};
+  return static_cast<int64_t>(timegm(&Time));
+}
+
+// Statuses that are cacheable without explicit freshness information
+bool IsHeuristicallyCacheable(int StatusCode) {
+  switch (StatusCode) {
+  case 200:
+  case 203:
+  case 204:
+  case 300:
+  case 301:
+  case 308:
+  case 404:
+  case 405:
+  case 410:
+  case 414:
+  case 501:
+    return true;
+  default:
+    return false;
+  }
+}
+
+// Returns the explicit lifetime given by the headers, if there's any
+std::optional<int64_t> GetExplicitLifetime(const CacheHeaders &Headers,
+                                           const CacheDirectives &Directives,
+                                           int64_t Date) {
+  // Stored responses are served to many clients, so the shared limit wins
+  if (Directives.SharedMaxAge.has_value())
+    return Directives.SharedMaxAge;
+  if (Directives.MaxAge.has_value())
+    return Directives.MaxAge;
+  if (!Headers.Expires.empty()) {
+    // Invalid dates, such as "0", mean the response has already expired
+    auto Expires = ParseHTTPDate(Headers.Expires);
+    return Expires.has_value() ? std::max<int64_t>(*Expires - Date, 0) : 0;
+  }
+  return {};
+}
+
+int64_t GetStaleWindow(const CacheDirectives &Directives,
+                       int64_t DefaultStaleWindow) {
+  if (Directives.NoCache || Directives.MustRevalidate)
+    return 0;
+  return Directives.StaleWhileRevalidate.value_or(DefaultStaleWindow);
+}
+
+// Age the response already had when it was received
+int64_t GetInitialAge(const CacheHeaders &Headers, int64_t Date,
+                      int64_t ResponseTime) {
+  int64_t ApparentAge = std::max<int64_t>(ResponseTime - Date, 0);
+  return std::max(ApparentAge, ParseSeconds(Headers.Age).value_or(0));
+}
+} // namespace
+
+int64_t Freshness::Now() { return static_cast<int64_t>(time(nullptr)); }
+
+Freshness Freshness::FromHeaders(const CacheHeaders &Headers, int StatusCode,
+                                 int64_t ResponseTime,
+                                 int64_t DefaultStaleWindow) {
+  Freshness Result;
+  auto Directives = ParseCacheControl(Headers.CacheControl);
+  // Pragma is only looked at by HTTP/1.0 caches
+  if (Headers.CacheControl.empty() &&
+      Headers.Pragma.find("no-cache") != std::string::npos)
+    Directives.NoCache = true;
+  int64_t Date = ParseHTTPDate(Headers.Date).value_or(ResponseTime);
+  auto Lifetime = GetExplicitLifetime(Headers, Directives, Date);
+  // Responses are keyed by the address only, so the ones that vary with
+  // the request headers can't be told apart
+  if (Directives.NoStore || Directives.Private || Headers.HasVary ||
+      (!Lifetime.has_value() && !IsHeuristicallyCacheable(StatusCode)) ||
+      StatusCode == 206 || StatusCode == 304)
+    return Result;
+
+  Result.IsStorable = true;
+  Result.ETag = Headers.ETag;
+  Result.LastModified = Headers.LastModified;
+  Result.StaleWindow = GetStaleWindow(Directives, DefaultStaleWindow);
+  if (Directives.NoCache) {
+    Result.Lifetime = 0;
+  } else if (Lifetime.has_value()) {
+    Result.Lifetime = *Lifetime;
+  } else if (auto Modified = ParseHTTPDate(Headers.LastModified)) {
+    Result.Lifetime = std::min(std::max<int64_t>(Date - *Modified, 0) *
+                                   Globals::HeuristicFreshnessPercent / 100,
+                               Globals::MaxHeuristicFreshnessSec);
+  }
+  Result.ExpiresAt = ResponseTime -
+                     GetInitialAge(Headers, Date, ResponseTime) +
+                     Result.Lifetime;
+  return Result;
+}
+
+Freshness Freshness::FromNotModified(const Freshness &Stored,
+                                     const CacheHeaders &Headers,
+                                     int64_t ResponseTime) {
+  Freshness Result = Stored;
+  auto Directives = ParseCacheControl(Headers.CacheControl);
+  if (Directives.NoStore || Directives.Private) {
+    Result.IsStorable = false;
+    Result.ExpiresAt = 0;
+    return Result;
+  }
+  int64_t Date = ParseHTTPDate(Headers.Date).value_or(ResponseTime);
+  // The stored lifetime holds unless the new headers replace it
+  auto Lifetime = GetExplicitLifetime(Headers, Directives, Date);
+  if (Directives.NoCache)
+    Result.Lifetime = 0;
+  else if (Lifetime.has_value())
+    Result.Lifetime = *Lifetime;
+  if (!Headers.CacheControl.empty())
+    Result.StaleWindow = GetStaleWindow(Directives, Stored.StaleWindow);
+  if (!Headers.ETag.empty())
+    Result.ETag = Headers.ETag;
+  if (!Headers.LastModified.empty())
+    Result.LastModified = Headers.LastModified;
+  Result.ExpiresAt = ResponseTime -
+                     GetInitialAge(Headers, Date, ResponseTime) +
+                     Result.Lifetime;
+  return Result;
+}
+
+bool Freshness::IsFresh(int64_t Time) const {
+  return IsStorable && Time < ExpiresAt;
+}
+
+bool Freshness::CanServeStale(int64_t Time) const {
+  return IsStorable && Time < ExpiresAt + StaleWindow;
+}
+
+bool Freshness::HasValidators() const {
+  return IsStorable && (!ETag.empty() || !LastModified.empty());
+}
+} // namespace proxy
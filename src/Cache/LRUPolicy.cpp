@@ -0,0 +1,43 @@
+#include <Cache/LRUPolicy.hpp>
+
+namespace proxy {
+void LRUPolicy::OnInsert(const std::string &Key, std::size_t Size) {
+  if (Index.count(Key)) {
+    OnResize(Key, Size);
+    OnAccess(Key);
+    return;
+  }
+  Entries.push_front(Entry{Key, Size});
+  Index[Key] = Entries.begin();
+}
+
+void LRUPolicy::OnAccess(const std::string &Key) {
+  auto It = Index.find(Key);
+  if (It != Index.end())
+    Entries.splice(Entries.begin(), Entries, It->second);
+}
+
+void LRUPolicy::OnResize(const std::string &Key, std::size_t Size) {
+  auto It = Index.find(Key);
+  if (It != Index.end())
+    It->second->Size = Size;
+}
+
+void LRUPolicy::OnRemove(const std::string &Key) {
+  auto It = Index.find(Key);
+  if (It == Index.end())
+    return;
+  Entries.erase(It->second);
+  Index.erase(It);
+}
+
+bool LRUPolicy::SelectVictim(const CanEvictFn &CanEvict, std::string &Victim) {
+  for (auto It = Entries.rbegin(); It != Entries.rend(); ++It) {
+    if (CanEvict(It->Key)) {
+      Victim = It->Key;
+      return true;
+    }
+  }
+  return false;
+}
+} // namespace proxy
@@ -0,0 +1,75 @@
+#include <Cache/SLRUPolicy.hpp>
+#include <Common/Globals.hpp>
+
+namespace proxy {
+SLRUPolicy::SLRUPolicy(std::size_t Capacity)
+    : ProtectedCapacity(Capacity / 100 * Globals::SLRUProtectedPercent) {}
+
+void SLRUPolicy::OnInsert(const std::string &Key, std::size_t Size) {
+  if (Index.count(Key)) {
+    OnResize(Key, Size);
+    OnAccess(Key);
+    return;
+  }
+  Probation.push_front(Entry{Key, Size, false});
+  Index[Key] = Probation.begin();
+}
+
+void SLRUPolicy::Promote(EntryIterator It) {
+  It->IsProtected = true;
+  ProtectedSize += It->Size;
+  Protected.splice(Protected.begin(), Probation, It);
+  // The least recently used protected records get another chance in
+  // probation
+  while (ProtectedSize > ProtectedCapacity && Protected.size() > 1) {
+    auto Demoted = std::prev(Protected.end());
+    Demoted->IsProtected = false;
+    ProtectedSize -= Demoted->Size;
+    Probation.splice(Probation.begin(), Protected, Demoted);
+  }
+}
+
+void SLRUPolicy::OnAccess(const std::string &Key) {
+  auto It = Index.find(Key);
+  if (It == Index.end())
+    return;
+  if (It->second->IsProtected)
+    Protected.splice(Protected.begin(), Protected, It->second);
+  else
+    Promote(It->second);
+}
+
+void SLRUPolicy::OnResize(const std::string &Key, std::size_t Size) {
+  auto It = Index.find(Key);
+  if (It == Index.end())
+    return;
+  if (It->second->IsProtected)
+    ProtectedSize = ProtectedSize - It->second->Size + Size;
+  It->second->Size = Size;
+}
+
+void SLRUPolicy::OnRemove(const std::string &Key) {
+  auto It = Index.find(Key);
+  if (It == Index.end())
+    return;
+  if (It->second->IsProtected) {
+    ProtectedSize -= It->second->Size;
+    Protected.erase(It->second);
+  } else {
+    Probation.erase(It->second);
+  }
+  Index.erase(It);
+}
+
+bool SLRUPolicy::SelectVictim(const CanEvictFn &CanEvict, std::string &Victim) {
+  for (auto *Segment : {&Probation, &Protected}) {
+    for (auto It = Segment->rbegin(); It != Segment->rend(); ++It) {
+      if (CanEvict(It->Key)) {
+        Victim = It->Key;
+        return true;
+      }
+    }
+  }
+  return false;
+}
+} // namespace proxy
@@ -0,0 +1,87 @@
+#include <Cache/TinyLFUPolicy.hpp>
+#include <Common/Globals.hpp>
+
+namespace proxy {
+TinyLFUPolicy::TinyLFUPolicy(std::size_t Capacity)
+    : WindowCapacity(Capacity / 100 * Globals::TinyLFUWindowPercent),
+      Main(Capacity - WindowCapacity),
+      Sketch(Capacity / Globals::TinyLFUAverageRecordSize) {}
+
+void TinyLFUPolicy::OnInsert(const std::string &Key, std::size_t Size) {
+  Sketch.Increment(Key);
+  if (WindowIndex.count(Key)) {
+    OnResize(Key, Size);
+    OnAccess(Key);
+    return;
+  }
+  Window.push_front(Entry{Key, Size});
+  WindowIndex[Key] = Window.begin();
+  WindowSize += Size;
+}
+
+void TinyLFUPolicy::OnAccess(const std::string &Key) {
+  Sketch.Increment(Key);
+  auto It = WindowIndex.find(Key);
+  if (It != WindowIndex.end())
+    Window.splice(Window.begin(), Window, It->second);
+  else
+    Main.OnAccess(Key);
+}
+
+void TinyLFUPolicy::OnResize(const std::string &Key, std::size_t Size) {
+  auto It = WindowIndex.find(Key);
+  if (It == WindowIndex.end()) {
+    Main.OnResize(Key, Size);
+    return;
+  }
+  WindowSize = WindowSize - It->second->Size + Size;
+  It->second->Size = Size;
+}
+
+void TinyLFUPolicy::OnRemove(const std::string &Key) {
+  auto It = WindowIndex.find(Key);
+  if (It == WindowIndex.end()) {
+    Main.OnRemove(Key);
+    return;
+  }
+  WindowSize -= It->second->Size;
+  Window.erase(It->second);
+  WindowIndex.erase(It);
+}
+
+void TinyLFUPolicy::Admit(std::list<Entry>::iterator It) {
+  Main.OnInsert(It->Key, It->Size);
+  WindowSize -= It->Size;
+  WindowIndex.erase(It->Key);
+  Window.erase(It);
+}
+
+bool TinyLFUPolicy::SelectVictim(const CanEvictFn &CanEvict,
+                                 std::string &Victim) {
+  while (WindowSize > WindowCapacity && !Window.empty()) {
+    auto Candidate = std::prev(Window.end());
+    std::string MainVictim;
+    bool HasMainVictim = Main.SelectVictim(CanEvict, MainVictim);
+    if (HasMainVictim && CanEvict(Candidate->Key) &&
+        Sketch.Estimate(Candidate->Key) <= Sketch.Estimate(MainVictim)) {
+      Victim = Candidate->Key;
+      return true;
+    }
+    Admit(Candidate);
+    if (HasMainVictim) {
+      Victim = MainVictim;
+      return true;
+    }
+  }
+
+  if (Main.SelectVictim(CanEvict, Victim))
+    return true;
+  for (auto It = Window.rbegin(); It != Window.rend(); ++It) {
+    if (CanEvict(It->Key)) {
+      Victim = It->Key;
+      return true;
+    }
+  }
+  return false;
+}
+} // namespace proxy
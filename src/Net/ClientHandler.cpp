@@ -2,15 +2,16 @@
 #include <Common/Utils.hpp>
 #include <Logging/Logger.hpp>
 #include <Net/ClientHandler.hpp>
+#include <Net/EventLoop.hpp>
+#include <Net/HttpScan.hpp>
 #include <Net/RemoteHandler.hpp>
+#include <Net/RequestWriter.hpp>
 #include <Parallel/LockGuard.hpp>
-#include <Parallel/ThreadInterruptedException.hpp>
 #include <cassert>
 #include <cerrno>
+#include <charconv>
 #include <cstring>
-#include <httpparser/httprequestparser.h>
 #include <httpparser/httpresponseparser.h>
-#include <httpparser/request.h>
 #include <httpparser/urlparser.h>
 
 namespace proxy {
@@ -22,9 +23,19 @@ std::optional<SocketBase::TimePointT> ClientHandler::GetLastIOTimePoint() {
   return {};
 }
 
+void ClientHandler::ArmWaitTimer() {
+  // Idle persistent connections are reaped sooner
+  if (RequestBytes.empty())
+    ArmTimer(PhaseTimer, TimeoutKind::KeepAlive,
+             Globals::ClientKeepAliveTimeoutSec);
+  else
+    ArmTimer(PhaseTimer, TimeoutKind::HeaderRead,
+             Globals::HeaderReadTimeoutSec);
+}
+
 void ClientHandler::Finish() {
   Terminate();
-  Srv->MarkDeadHandler(this);
+  Loop->MarkDeadHandler(this);
 }
 
 void ClientHandler::Terminate() {
@@ -34,10 +45,19 @@ void ClientHandler::Terminate() {
       return;
     _IsTerminated = true;
   }
-  if (!CacheAddress.empty())
-    Srv->GetCache()->RemoveListener(CacheAddress, this);
-  if (EndToEndHandler)
-    EndToEndHandler->Terminate();
+  if (Loop) {
+    Loop->GetPoller()->Remove(SockFD);
+    Loop->GetPoller()->CancelIO(&SendRequest);
+  }
+  DetachFromRecord();
+  if (Loop)
+    Loop->ForgetListener(this);
+  if (EndToEndHandler) {
+    auto *Handler = EndToEndHandler;
+    EndToEndHandler = nullptr;
+    Handler->SetEndToEndWriteHandler(nullptr);
+    Handler->Finish();
+  }
 }
 
 void ClientHandler::HandleWriteEvents() {
@@ -45,110 +65,337 @@ void ClientHandler::HandleWriteEvents() {
     HandleEndToEndWrite();
     return;
   }
-  std::size_t BlocksNum;
-  {
-    LockGuard<MutexLocker> G(&CacheEventMutex);
-    BlocksNum = CacheBlocksNum;
+  if (DiskRecord.Segment) {
+    SendRecordFromDisk();
+    return;
   }
-  if (BlocksNum > 0)
+  if (ResponseCacheRecord)
     SendRecordFromCache();
+  else
+    Loop->GetPoller()->Remove(SockFD, POLLOUT);
 }
 
 void ClientHandler::SendRecordFromCache() {
-  LockGuard<MutexLocker> G(&CacheEventMutex);
-  std::size_t CurCacheBlocksNum = CacheBlocksNum;
-  auto *CurBlock = ResponseCacheRecord->GetBlock(CurBlockIdx);
-  if (!CurBlock) {
-    Poll.Remove(ClientSock->GetFD(), POLLOUT);
+  // The send in flight goes on by itself once it completes
+  if (SendRequest.InFlight) {
+    Loop->GetPoller()->Remove(SockFD, POLLOUT);
+    return;
+  }
+  // The record is only released by this thread, so it's safe to use
+  // without holding an extra reference
+  CacheRecord *Record = ResponseCacheRecord.Get();
+
+  // Checked before walking the chain, so that no block appended right
+  // before the record is finished is missed
+  bool IsFinished = Record->IsFinished();
+  CacheBlockSpan Blocks[Globals::MaxWriteBlocksNum];
+  std::size_t BlocksNum =
+      Record->GetBlocks(LastSentBlock, Blocks, Globals::MaxWriteBlocksNum);
+  if (BlocksNum == 0) {
+    if (IsFinished) {
+      HandleCacheRecordEnd();
+      return;
+    }
+    // Wait until new cache block arrives
+    Loop->GetPoller()->Remove(SockFD, POLLOUT);
+    return;
+  }
+  // The final block can only be the last one in the record
+  bool HasFinalBlock = Blocks[BlocksNum - 1].IsFinal;
+
+  struct iovec IOVecs[Globals::MaxWriteBlocksNum];
+  std::size_t IOVecsNum = 0;
+  for (std::size_t i = 0; i < BlocksNum; i++) {
+    std::size_t Offset = i == 0 ? CurBlockPos : 0;
+    if (Blocks[i].Size == Offset)
+      continue;
+    IOVecs[IOVecsNum].iov_base = Blocks[i].Block->GetData() + Offset;
+    IOVecs[IOVecsNum].iov_len = Blocks[i].Size - Offset;
+    IOVecsNum++;
+  }
+  if (IsHead)
+    IOVecsNum = ClipToResponse(IOVecs, IOVecsNum);
+
+  std::size_t WrittenBytesNum = 0;
+  if (IOVecsNum > 0 && Loop->GetPoller()->SupportsIO()) {
+    std::copy(Blocks, Blocks + BlocksNum, SendBlocks);
+    SendBlocksNum = BlocksNum;
+    std::copy(IOVecs, IOVecs + IOVecsNum, SendIOVecs);
+    SendIOVecsNum = IOVecsNum;
+    SendRecord = ResponseCacheRecord;
+    Loop->GetPoller()->SubmitSend(&SendRequest, SockFD, SendIOVecs,
+                                  SendIOVecsNum);
+    Loop->GetPoller()->Remove(SockFD, POLLOUT);
+    return;
+  }
+  if (IOVecsNum > 0) {
+    ssize_t Written = ClientSock->Write(IOVecs, IOVecsNum);
+    if (Written < 0)
+      return;
+    WrittenBytesNum = Written;
+    Log::DefaultLogger.LogDebug("[Client #", SockFD, "] Sent ", Written,
+                                " bytes from cache");
+  }
+
+  bool IsAdvanced = AdvanceCacheSend(Blocks, BlocksNum, IOVecs, IOVecsNum,
+                                     WrittenBytesNum);
+  if (IsHead && ClientFramer.IsDone()) {
+    HandleResponseEnd();
+    return;
+  }
+  if (!IsAdvanced)
     return;
+  if (HasFinalBlock)
+    HandleCacheRecordEnd();
+  else if (BlocksNum < Globals::MaxWriteBlocksNum)
+    Loop->GetPoller()->Remove(SockFD, POLLOUT);
+}
+
+bool ClientHandler::AdvanceCacheSend(const CacheBlockSpan *Blocks,
+                                     std::size_t BlocksNum,
+                                     const struct iovec *IOVecs,
+                                     std::size_t IOVecsNum,
+                                     std::size_t WrittenBytesNum) {
+  // Bytes past the end of the response would desync the next one
+  std::size_t Left = WrittenBytesNum;
+  for (std::size_t i = 0; i < IOVecsNum && Left > 0; i++) {
+    auto Size = std::min(Left, IOVecs[i].iov_len);
+    if (ClientFramer.Feed(static_cast<const char *>(IOVecs[i].iov_base),
+                          Size) != Size)
+      KeepAlive = false;
+    Left -= Size;
+  }
+
+  Left = WrittenBytesNum;
+  for (std::size_t i = 0; i < BlocksNum; i++) {
+    std::size_t BlockLeft = Blocks[i].Size - CurBlockPos;
+    if (Left < BlockLeft) {
+      CurBlockPos += Left;
+      return false;
+    }
+    Left -= BlockLeft;
+    // The last block may still be filled by the remote
+    if (!Blocks[i].IsSealed) {
+      CurBlockPos = Blocks[i].Size;
+      break;
+    }
+    LastSentBlock = Blocks[i].Block;
+    CurBlockPos = 0;
   }
-  G.Unlock();
+  return true;
+}
 
-  const auto &CurBlockBytes = CurBlock->GetBytes();
-  if (CurBlockBytes.size() == 0 && !CurBlock->IsFinal()) {
-    Poll.Remove(ClientSock->GetFD(), POLLOUT);
+void ClientHandler::HandleIO(IORequest *Req) {
+  CacheRecordPtr Record = std::move(SendRecord);
+  if (Req->Result < 0)
+    Exception::ThrowSystemError(-Req->Result, "sendmsg()");
+  ClientSock->UpdateLastIOTimePoint();
+  Log::DefaultLogger.LogDebug("[Client #", SockFD, "] Sent ", Req->Result,
+                              " bytes from cache");
+  bool IsAdvanced = AdvanceCacheSend(SendBlocks, SendBlocksNum, SendIOVecs,
+                                     SendIOVecsNum, Req->Result);
+  if (IsHead && ClientFramer.IsDone()) {
+    HandleResponseEnd();
+    return;
+  }
+  if (IsAdvanced && SendBlocks[SendBlocksNum - 1].IsFinal) {
+    HandleCacheRecordEnd();
     return;
   }
+  SendRecordFromCache();
+}
+
+std::size_t ClientHandler::ClipToResponse(struct iovec *IOVecs,
+                                          std::size_t IOVecsNum) const {
+  // The framer itself only gets the bytes that went out
+  ResponseFramer Probe = ClientFramer;
+  for (std::size_t i = 0; i < IOVecsNum; i++) {
+    std::size_t Size = Probe.Feed(static_cast<const char *>(IOVecs[i].iov_base),
+                                  IOVecs[i].iov_len);
+    if (Size < IOVecs[i].iov_len) {
+      IOVecs[i].iov_len = Size;
+      return Size > 0 ? i + 1 : i;
+    }
+  }
+  return IOVecsNum;
+}
 
-  auto BytesStartIt = CurBlockBytes.begin() + CurBlockPos;
-  std::size_t BytesNum = CurBlockBytes.size() - CurBlockPos;
+bool ClientHandler::HasIOInFlight() const { return SendRequest.InFlight; }
 
-  auto *NextBlock = ResponseCacheRecord->GetBlock(CurBlockIdx + 1);
-  std::vector<char> Concat;
-  if (NextBlock && BytesNum < Globals::BufferConcatSizeThreshold) {
-    const auto &NextBlockBytes = NextBlock->GetBytes();
-    Utils::ConcatRanges(BytesStartIt, CurBlockBytes.end(),
-                        NextBlockBytes.begin(), NextBlockBytes.end(),
-                        std::back_inserter(Concat));
-    BytesStartIt = Concat.begin();
-    BytesNum = Concat.size();
+bool ClientHandler::TryStartDiskResponse() {
+  // Records in memory are preferred, they may be newer
+  auto *Disk = Srv->GetDiskCache();
+  if (!Disk || Srv->GetCache()->HasRecord(CacheAddress) ||
+      !Disk->Find(CacheAddress, DiskRecord))
+    return false;
+  Log::DefaultLogger.LogInfo("[Client #", SockFD, "] Serving ", CacheAddress,
+                             " from disk");
+  if (IsHead) {
+    ResponseFramer Probe = ClientFramer;
+    DiskRecord.Size = Probe.Feed(
+        DiskRecord.Segment->GetData() + DiskRecord.Offset, DiskRecord.Size);
   }
+  DiskRecordPos = 0;
+  Loop->GetPoller()->Add(SockFD, POLLOUT, this);
+  return true;
+}
 
-  ssize_t WrittenBytesNum = ClientSock->Write(&*BytesStartIt, BytesNum);
+void ClientHandler::SendRecordFromDisk() {
+  uint64_t Offset = DiskRecord.Offset + DiskRecordPos;
+  ssize_t Written = ClientSock->SendFile(DiskRecord.Segment->GetFD(), Offset,
+                                         DiskRecord.Size - DiskRecordPos);
+  if (Written < 0)
+    return;
+  Log::DefaultLogger.LogDebug("[Client #", SockFD, "] Sent ", Written,
+                              " bytes from disk");
+  // The segment is mapped, so the framer gets the bytes without copying
+  const char *Bytes = DiskRecord.Segment->GetData() + Offset;
+  if (ClientFramer.Feed(Bytes, Written) != static_cast<std::size_t>(Written))
+    KeepAlive = false;
+  DiskRecordPos += Written;
+  if (DiskRecordPos == DiskRecord.Size)
+    HandleResponseEnd();
+}
 
-  Log::DefaultLogger.LogDebug("[Client #", ClientSock->GetFD(), "] Sent ",
-                              WrittenBytesNum, " bytes from cache");
+void ClientHandler::HandleCacheRecordEnd() {
+  if (ResponseCacheRecord->IsComplete()) {
+    Log::DefaultLogger.LogInfo("[Client #", SockFD,
+                               "] Finished reading from cache");
+    HandleResponseEnd();
+    return;
+  }
 
-  CurBlockPos += WrittenBytesNum;
-  bool FinishedCurBlock = CurBlockPos >= CurBlockBytes.size();
-  if (FinishedCurBlock) {
-    CurBlockPos -= CurBlockBytes.size();
-    CurBlockIdx++;
-    if (CurBlockIdx == CurCacheBlocksNum)
-      Poll.Remove(ClientSock->GetFD(), POLLOUT);
+  // The body offset to resume from is only known with the whole head sent
+  // and the body sent as is. Chunked bodies carry their framing, so the
+  // client can't get the rest of one.
+  if (!ClientFramer.HasHeaders() || !ClientFramer.GetRemainingSize()) {
+    Log::DefaultLogger.LogInfo("[Client #", SockFD,
+                               "] Cache record is truncated, closing");
+    Finish();
+    return;
   }
 
-  if (CurBlock->IsFinal() && FinishedCurBlock) {
-    if (ResponseCacheRecord->IsComplete()) {
-      Poll.Remove(SockFD, POLLOUT);
-      Log::DefaultLogger.LogInfo("[Client #", SockFD,
-                                 "] Finished reading from cache");
-      Finish();
-      return;
+  // Cache record is finished, but response is not complete. Need
+  // to establish a new connection to remote to get the remaining response.
+  Loop->GetPoller()->Remove(SockFD, POLLOUT);
+  // The resumed response isn't framed, so the connection ends with it
+  KeepAlive = false;
+  // The record holds the response headers, the range is for the body only
+  char Range[32] = "bytes=";
+  auto Res = std::to_chars(
+      Range + 6, Range + sizeof(Range) - 1,
+      ResponseCacheRecord->GetTotalSize() - ClientFramer.GetHeaderSize());
+  *Res.ptr++ = '-';
+  // The handler that sent the request may still hold it
+  auto Resumed = std::make_shared<std::vector<char>>();
+  RequestWriter::InsertHeader(*UpstreamRequestBytes, UpstreamHeadSize, "Range",
+                              std::string_view(Range, Res.ptr - Range),
+                              *Resumed);
+  UpstreamRequestBytes = std::move(Resumed);
+  StartEndToEnd();
+}
+
+void ClientHandler::StartEndToEnd() {
+  IsEndToEnd = true;
+  ResponseBuffer.reserve(Globals::DefaultResponseBufferSize);
+  // Kept for the following responses on the connection
+  if (!ResponsePipe) {
+    try {
+      ResponsePipe = std::make_unique<Pipe>();
+    } catch (const std::system_error &E) {
+      Log::DefaultLogger.LogDebug("[Client #", SockFD,
+                                  "] Relaying without splice(): ", E.what());
     }
+  }
+  auto Handler = std::make_unique<RemoteHandler>(
+      Srv, CacheAddress, UpstreamRequestBytes, RemoteHandler::Mode::EndToEnd);
+  Handler->SetEndToEndBuffer(&ResponseBuffer);
+  Handler->SetEndToEndPipe(ResponsePipe.get());
+  Handler->SetEndToEndWriteHandler(this);
+  Handler->ConnectTo(RemoteHostName, RemoteHostPort);
+  EndToEndHandler = Handler.release();
+  Loop->Attach(EndToEndHandler);
+}
+
+void ClientHandler::StartPassThrough() {
+  IsPassThrough = true;
+  // The response goes to the client as it is
+  ReadHeader = true;
+  StartEndToEnd();
+}
 
-    // Cache record is finished, but response is not complete. Need
-    // to establish a new connection to remote to get the remaining response.
-    IsEndToEnd = true;
-    auto RangeValue = std::string("bytes=") +
-                      std::to_string(ResponseCacheRecord->GetTotalSize()) + "-";
-    auto RangeHeader =
-        httpparser::Request::HeaderItem{.name = "Range", .value = RangeValue};
-    ClientRequest.headers.push_back(RangeHeader);
-    RequestBytes.clear();
-    auto RequestStr = Utils::RequestToString(ClientRequest);
-    RequestBytes.insert(RequestBytes.begin(), RequestStr.begin(),
-                        RequestStr.end());
-    EndToEndHandler = new RemoteHandler(Srv, CacheAddress, RequestBytes,
-                                        RemoteHandler::Mode::EndToEnd);
-    EndToEndHandler->SetEndToEndBuffer(&ResponseBuffer);
-    EndToEndHandler->ConnectTo(RemoteHostName, RemoteHostPort);
-    EndToEndHandler->Start();
+void ClientHandler::HandleResponseEnd() {
+  if (!KeepAlive || !ClientFramer.IsDone() || !ClientFramer.IsKeepAlive()) {
+    Finish();
     return;
   }
 
-  // Wait until new cache block arrives
-  WaitForCacheRecordUpdate(CurBlockIdx);
+  Log::DefaultLogger.LogDebug("[Client #", SockFD,
+                              "] Response sent, waiting for next request");
+  DetachFromRecord();
+  DiskRecord = DiskCacheEntry();
+  CacheAddress.clear();
+  LastSentBlock = nullptr;
+  CurBlockPos = 0;
+  RequestFinished = false;
+  RequestTimer.Cancel();
+  Loop->GetPoller()->Remove(SockFD, POLLOUT);
+  if (!InputClosed)
+    Loop->GetPoller()->Add(SockFD, POLLIN, this);
+
+  // Pipelined requests are already buffered
+  if (TryStartRequest())
+    return;
+  if (InputClosed)
+    Finish();
+  else
+    ArmWaitTimer();
 }
 
 void ClientHandler::HandleRemoteEndInput(RemoteHandler *RemHandler,
                                          std::vector<char> *Bytes) {
-  Poll.Add(SockFD, POLLOUT, this);
+  Loop->GetPoller()->Add(SockFD, POLLOUT, this);
   RemoteInput = Bytes;
 }
 
+void ClientHandler::HandleRemoteEndFinished(RemoteHandler *RemHandler) {
+  EndToEndHandler = nullptr;
+  // Let the pending response bytes go out first
+  if (!HasEndToEndInput())
+    FinishEndToEnd();
+}
+
+void ClientHandler::FinishEndToEnd() {
+  // A relayed response that ended where its framing says leaves the
+  // connection usable for the next request
+  if (!IsPassThrough || EndToEndHandler || !ClientFramer.IsDone()) {
+    Finish();
+    return;
+  }
+  IsEndToEnd = false;
+  IsPassThrough = false;
+  ReadHeader = false;
+  RemoteInput = nullptr;
+  HandleResponseEnd();
+}
+
+bool ClientHandler::HasEndToEndInput() const {
+  return (RemoteInput && !RemoteInput->empty()) ||
+         (ResponsePipe && !ResponsePipe->IsEmpty());
+}
+
 void ClientHandler::HandleEndToEndWrite() {
-  if (RemoteInput->size() == 0) {
+  if (!HasEndToEndInput()) {
     Log::DefaultLogger.LogInfo("[Client #", SockFD,
                                "] Terminating end-to-end connection");
-    Finish();
+    FinishEndToEnd();
     return;
   }
-  if (!ReadHeader) {
-    const char *CRLF = "\r\n\r\n";
-    auto HeadersEndIt = std::search(RemoteInput->begin(), RemoteInput->end(),
-                                    CRLF, CRLF + strlen(CRLF));
-    if (HeadersEndIt == RemoteInput->end()) {
+  if (!ReadHeader && !RemoteInput->empty()) {
+    const char *Input = RemoteInput->data();
+    const char *HeadersEnd =
+        HttpScan::FindHeadEnd(Input, Input + RemoteInput->size());
+    if (!HeadersEnd) {
       Log::DefaultLogger.LogInfo(
           "[Client #", SockFD,
           "] No response header in end-to-end mode. Terminating");
@@ -157,9 +404,9 @@ void ClientHandler::HandleEndToEndWrite() {
     }
 
     httpparser::HttpResponseParser Parser;
-    auto Res = Parser.parse(EndToEndResponse, RemoteInput->data(),
-                            HeadersEndIt.base() + strlen(CRLF));
-    if (Res != httpparser::HttpResponseParser::ParsingCompleted) {
+    auto Res = Parser.parse(EndToEndResponse, Input, HeadersEnd);
+    // Only the headers are parsed, so the body is expected to be missing
+    if (Res == httpparser::HttpResponseParser::ParsingError) {
       Log::DefaultLogger.LogError("[Client #", SockFD, "] HTTP Parsing failed");
       Finish();
       return;
@@ -173,144 +420,275 @@ void ClientHandler::HandleEndToEndWrite() {
       return;
     }
     // Erase header part
-    RemoteInput->erase(RemoteInput->begin(), HeadersEndIt + 4);
+    RemoteInput->erase(RemoteInput->begin(),
+                       RemoteInput->begin() + (HeadersEnd - Input));
     ReadHeader = true;
   }
-  ssize_t WrittenBytes = ClientSock->Write(*RemoteInput);
-  Log::DefaultLogger.LogInfo("[Client #", SockFD, "] Sent ", WrittenBytes,
-                             " bytes in end-to-end mode");
-  EndToEndHandler->Start();
-  Poll.Remove(SockFD, POLLOUT);
-}
-
-void ClientHandler::OnCacheRecordUpdate(CacheRecord *Record) {
-  std::size_t UpdatesNum = 0;
-  {
-    LockGuard<MutexLocker> G(&CacheEventMutex);
-    ResponseCacheRecord = Record;
-    PrevCacheBlocksNum = CacheBlocksNum;
-    CacheBlocksNum = Record->GetNumBlocks();
-    UpdatesNum = CacheBlocksNum - PrevCacheBlocksNum;
+  if (!RemoteInput->empty()) {
+    ssize_t WrittenBytes = ClientSock->Write(*RemoteInput);
+    if (WrittenBytes < 0)
+      return;
+    Log::DefaultLogger.LogInfo("[Client #", SockFD, "] Sent ", WrittenBytes,
+                               " bytes in end-to-end mode");
+    if (IsPassThrough &&
+        ClientFramer.Feed(RemoteInput->data(), WrittenBytes) !=
+            static_cast<std::size_t>(WrittenBytes))
+      KeepAlive = false;
+    RemoteInput->erase(RemoteInput->begin(),
+                       RemoteInput->begin() + WrittenBytes);
+    if (!RemoteInput->empty())
+      return;
+  }
+  if (ResponsePipe && !ResponsePipe->IsEmpty()) {
+    ssize_t SplicedBytes = ResponsePipe->SpliceTo(ClientSock);
+    if (SplicedBytes < 0)
+      return;
+    Log::DefaultLogger.LogInfo("[Client #", SockFD, "] Spliced ", SplicedBytes,
+                               " bytes in end-to-end mode");
+    // Only the body bytes the framer passes through are spliced
+    if (IsPassThrough)
+      ClientFramer.Skip(SplicedBytes);
+    if (!ResponsePipe->IsEmpty())
+      return;
   }
-  for (std::size_t i = 0; i < UpdatesNum; i++)
-    CacheEventSemaphore.Release();
-}
 
-void ClientHandler::WaitForCacheRecordUpdate(std::size_t LastBlocksNum) {
-  Log::DefaultLogger.LogDebug("[Client #", SockFD,
-                              "] Waiting for cache record...");
+  Loop->GetPoller()->Remove(SockFD, POLLOUT);
+  if (EndToEndHandler)
+    EndToEndHandler->Register();
+  else
+    FinishEndToEnd();
+}
 
-  // Wait until cache record arrives
-  CacheEventSemaphore.Acquire();
+void ClientHandler::DetachFromRecord() {
+  if (!ResponseCacheRecord)
+    return;
+  // A wakeup queued before this is harmless, the handler just finds no
+  // record to send
+  ResponseCacheRecord->RemoveListener(this);
+  ResponseCacheRecord.Reset();
+}
 
-  Log::DefaultLogger.LogDebug("[Client #", SockFD,
-                              "] Finished waiting for cache record");
+void ClientHandler::OnCacheRecordAttach(CacheRecord *Record) {
+  // Attached from the loop thread, the cache keeps the record alive until
+  // it's pinned here
+  ResponseCacheRecord = CacheRecordPtr(Record);
+  Loop->GetPoller()->Add(SockFD, POLLOUT, this);
+}
 
-  Poll.Add(SockFD, POLLOUT, this);
+void ClientHandler::OnCacheWakeup() {
+  if (!IsTerminated() && !IsEndToEnd && ResponseCacheRecord)
+    Loop->GetPoller()->Add(SockFD, POLLOUT, this);
 }
 
+CacheWakeupQueue *ClientHandler::GetWakeupQueue() { return Loop; }
+
 static uint16_t ParsePort(std::string &HostHeader) {
   uint16_t DefaultPort = 80;
+  std::size_t ColonPos = HostHeader.find_last_of(':');
+  if (ColonPos == HostHeader.npos)
+    return DefaultPort;
   uint16_t Port;
-  std::size_t SemicolonPos = HostHeader.find_last_of(':');
-  if (SemicolonPos != HostHeader.npos) {
-    std::stringstream ss(HostHeader.substr(SemicolonPos + 1));
-    ss >> Port;
-    if (ss.fail() || ss.bad())
-      return DefaultPort;
-    HostHeader = HostHeader.substr(0, SemicolonPos);
-    return Port;
-  }
-  return DefaultPort;
-}
-
-static bool TryGetHostHeader(const httpparser::Request &Req,
-                             std::string &Host) {
-  std::string HostHeader = "Host";
-  auto IsHostHeader = [&](const auto &Header) {
-    return std::equal(Header.name.begin(), Header.name.end(),
-                      HostHeader.begin());
-  };
-
-  auto HostIt =
-      std::find_if(Req.headers.begin(), Req.headers.end(), IsHostHeader);
-  if (HostIt == Req.headers.end())
+  const char *End = HostHeader.data() + HostHeader.size();
+  auto Res = std::from_chars(HostHeader.data() + ColonPos + 1, End, Port);
+  if (Res.ec != std::errc() || Res.ptr != End)
+    return DefaultPort;
+  HostHeader.resize(ColonPos);
+  return Port;
+}
+
+static bool TryGetHostHeader(const RequestParser &Parser, std::string &Host) {
+  auto Value = Parser.FindHeader("Host");
+  if (!Value)
     return false;
+  Host.assign(Value->begin(), Value->end());
+  return true;
+}
+
+static bool IsHopByHopHeader(std::string_view Name) {
+  static const char *HopByHopHeaders[] = {
+      "Connection", "Proxy-Connection", "Keep-Alive", "TE",
+      "Trailer",    "Upgrade",          "Proxy-Authorization"};
+  for (const char *Header : HopByHopHeaders)
+    if (Utils::EqualsIgnoreCase(Name, Header))
+      return true;
+  return false;
+}
+
+void ClientHandler::PrepareUpstreamRequest(bool HasHostHeader,
+                                           std::string_view Method,
+                                           std::string_view Body) {
+  // The buffer is reused once no remote handler sends it
+  if (!UpstreamRequestBytes || UpstreamRequestBytes.use_count() > 1)
+    UpstreamRequestBytes = std::make_shared<std::vector<char>>();
+  RequestWriter Writer(*UpstreamRequestBytes,
+                       ReqParser.GetHeaderSize() + Body.size() +
+                           Globals::UpstreamRequestHeadroom);
+  // Upstream connections are persistent, so the response has to be framed
+  // by its length rather than by connection close
+  Writer.WriteRequestLine(Method, ReqParser.GetURI(), 1, 1);
+  for (std::size_t i = 0; i < ReqParser.GetHeadersNum(); i++) {
+    auto Header = ReqParser.GetHeader(i);
+    if (!IsHopByHopHeader(Header.Name))
+      Writer.WriteHeader(Header.Name, Header.Value);
+  }
+  if (!HasHostHeader)
+    Writer.WriteHostHeader(RemoteHostName, RemoteHostPort);
+  Writer.WriteHeader("Connection", "keep-alive");
+  UpstreamHeadSize = Writer.EndHead();
+  Writer.WriteBody(Body);
+}
 
-  Host = HostIt->value;
+// Connection options are a comma-separated list of tokens, RFC 7230 6.1
+static bool HasConnectionOption(std::string_view Value,
+                                std::string_view Option) {
+  while (!Value.empty()) {
+    std::size_t Comma = Value.find(',');
+    auto Token = Value.substr(0, Comma);
+    while (!Token.empty() && (Token.front() == ' ' || Token.front() == '\t'))
+      Token.remove_prefix(1);
+    while (!Token.empty() && (Token.back() == ' ' || Token.back() == '\t'))
+      Token.remove_suffix(1);
+    if (Utils::EqualsIgnoreCase(Token, Option))
+      return true;
+    if (Comma == std::string_view::npos)
+      break;
+    Value.remove_prefix(Comma + 1);
+  }
+  return false;
+}
+
+static bool WantsKeepAlive(const RequestParser &Parser) {
+  int Major = Parser.GetVersionMajor();
+  if (Major < 1 || (Major == 1 && Parser.GetVersionMinor() < 1))
+    return false;
+  for (std::size_t i = 0; i < Parser.GetHeadersNum(); i++) {
+    auto Header = Parser.GetHeader(i);
+    if (!Utils::EqualsIgnoreCase(Header.Name, "Connection") &&
+        !Utils::EqualsIgnoreCase(Header.Name, "Proxy-Connection"))
+      continue;
+    if (HasConnectionOption(Header.Value, "close"))
+      return false;
+  }
   return true;
 }
 
 void ClientHandler::HandleClientInput() {
   ssize_t ReceivedBytes = ClientSock->ReadAppend(RequestBytes);
+  if (ReceivedBytes < 0)
+    return;
 
   Log::DefaultLogger.LogInfo("[Client #", SockFD, "] Received ", ReceivedBytes,
                              " bytes");
 
   if (ReceivedBytes == 0) {
-    Finish();
+    // The client may half-close the connection after its last request
+    InputClosed = true;
+    Loop->GetPoller()->Remove(SockFD, POLLIN);
+    if (!RequestFinished)
+      Finish();
     return;
   }
 
-  if (RequestFinished)
-    return;
-
-  const char *CRLF = "\r\n\r\n";
-  if (std::search(RequestBytes.begin(), RequestBytes.end(), CRLF,
-                  CRLF + strlen(CRLF)) == RequestBytes.end())
+  if (RequestFinished) {
+    // Pipelined requests wait until the current response is sent
+    if (RequestBytes.size() >= Globals::MaxPipelinedInputSize)
+      Loop->GetPoller()->Remove(SockFD, POLLIN);
     return;
+  }
 
-  httpparser::HttpRequestParser HttpParser;
-  httpparser::HttpRequestParser::ParseResult res =
-      HttpParser.parse(ClientRequest, RequestBytes.data(),
-                       RequestBytes.data() + RequestBytes.size());
+  if (!TryStartRequest())
+    ArmWaitTimer();
+}
 
-  if (res != httpparser::HttpRequestParser::ParsingCompleted) {
-    Log::DefaultLogger.LogError("[Client #", SockFD, "] HTTP Parsing failed");
+bool ClientHandler::TryStartRequest() {
+  auto Status = ReqParser.Parse(RequestBytes.data(), RequestBytes.size());
+  if (Status == RequestParser::Status::Incomplete)
+    return false;
+  if (Status == RequestParser::Status::Error) {
+    Log::DefaultLogger.LogError("[Client #", SockFD, "] HTTP Parsing failed: ",
+                                ReqParser.GetError());
     Finish();
-    return;
+    return false;
   }
 
-  Log::DefaultLogger.LogInfo(
-      "[Client #", SockFD, "] ", ClientRequest.method, " ", ClientRequest.uri,
-      " HTTP/", ClientRequest.versionMajor, ".", ClientRequest.versionMinor);
+  std::size_t ParseSize = ReqParser.GetRequestSize();
+  if (ParseSize > RequestBytes.size())
+    return false;
 
-  if (ClientRequest.versionMajor >= 1 && ClientRequest.versionMinor >= 1) {
-    Log::DefaultLogger.LogDebug(
-        "[Client #", SockFD, "] ",
-        "Unsupported HTTP version, falling back to HTTP/1.0");
-    ClientRequest.versionMajor = 1;
-    ClientRequest.versionMinor = 0;
-    auto NewRequestStr = Utils::RequestToString(ClientRequest);
-    RequestBytes.clear();
-    RequestBytes.insert(RequestBytes.begin(), NewRequestStr.begin(),
-                        NewRequestStr.end());
-  }
+  KeepAlive = WantsKeepAlive(ReqParser);
+  bool HasHostHeader = TryGetHostHeader(ReqParser, RemoteHostName);
+  auto Method = ReqParser.GetMethod();
+  auto URI = ReqParser.GetURI();
 
-  bool HasHostHeader = TryGetHostHeader(ClientRequest, RemoteHostName);
+  Log::DefaultLogger.LogInfo("[Client #", SockFD, "] ", Method, " ", URI,
+                             " HTTP/", ReqParser.GetVersionMajor(), ".",
+                             ReqParser.GetVersionMinor());
 
-  CacheAddress = "";
+  CacheAddress.clear();
   if (!HasHostHeader) {
-    httpparser::UrlParser UrlParser(ClientRequest.uri);
+    std::string URIString(URI);
+    httpparser::UrlParser UrlParser(URIString);
     if (!UrlParser.isValid())
-      throw std::runtime_error("Invalid URI: " + ClientRequest.uri);
+      throw std::runtime_error("Invalid URI: " + URIString);
     RemoteHostPort = UrlParser.httpPort();
     RemoteHostName = UrlParser.hostname();
-    CacheAddress = ClientRequest.uri;
+    CacheAddress = std::move(URIString);
   } else {
     RemoteHostPort = ParsePort(RemoteHostName);
-    CacheAddress += RemoteHostName + ClientRequest.uri + ":" +
-                    std::to_string(RemoteHostPort);
+    char Port[8];
+    auto Res = std::to_chars(Port, Port + sizeof(Port), RemoteHostPort);
+    CacheAddress.append(RemoteHostName)
+        .append(URI)
+        .append(":")
+        .append(Port, Res.ptr - Port);
   }
 
-  CacheListenerInfo CLI{CacheAddress, RemoteHostName, RemoteHostPort,
-                        RequestBytes, this};
-  Srv->AddCacheListener(CLI);
-  // Don't listen for client input anymore
-  Poll.Remove(SockFD, POLLIN);
+  IsHead = Method == "HEAD";
+  // Only GET responses are cached, HEAD requests get the heads of them.
+  // Responses to requests with credentials may only be shared if the origin
+  // says so (RFC 7234, section 3.2), so such requests are relayed as they
+  // are, like any other method.
+  bool UseCache = (Method == "GET" || IsHead) &&
+                  !ReqParser.FindHeader("Authorization");
+  ClientFramer.Reset(IsHead);
+  std::size_t HeaderSize = ReqParser.GetHeaderSize();
+  PrepareUpstreamRequest(HasHostHeader, UseCache ? "GET" : Method,
+                         std::string_view(RequestBytes.data() + HeaderSize,
+                                          ParseSize - HeaderSize));
+  // The views point into the bytes erased here
+  ReqParser.Reset();
+  RequestBytes.erase(RequestBytes.begin(), RequestBytes.begin() + ParseSize);
+
   RequestFinished = true;
+  ArmTimer(PhaseTimer, TimeoutKind::Idle, Globals::ClientTimeoutSec);
+  ArmTimer(RequestTimer, TimeoutKind::Request, Globals::RequestTimeoutSec);
+  if (RequestBytes.size() >= Globals::MaxPipelinedInputSize)
+    Loop->GetPoller()->Remove(SockFD, POLLIN);
+
+  if (!UseCache) {
+    StartPassThrough();
+    return true;
+  }
+  if (TryStartDiskResponse())
+    return true;
 
-  WaitForCacheRecordUpdate(0);
+  // Response is sent once the cache record notifies about its blocks
+  CacheListenerInfo CLI{CacheAddress, RemoteHostName, RemoteHostPort,
+                        UpstreamRequestBytes, this, Loop};
+  if (Srv->AddCacheListener(CLI))
+    return true;
+
+  Log::DefaultLogger.LogDebug("[Client #", SockFD, "] ", CacheAddress,
+                              " may not be shared yet, relaying");
+  // HEAD requests are sent as GET to be cached, this one isn't
+  if (IsHead) {
+    auto &Bytes = *UpstreamRequestBytes;
+    Bytes.erase(Bytes.begin(), Bytes.begin() + 3);
+    Bytes.insert(Bytes.begin(), {'H', 'E', 'A', 'D'});
+    UpstreamHeadSize++;
+  }
+  StartPassThrough();
+  return true;
 }
 
 bool ClientHandler::IsTerminated() {
@@ -318,43 +696,11 @@ bool ClientHandler::IsTerminated() {
   return _IsTerminated;
 }
 
-void ClientHandler::ClientRoutine() {
-  ThisThread::BlockInterruptionSignals();
-  Poll.Add(SockFD, POLLIN, this);
-  while (!IsTerminated()) {
-    Log::DefaultLogger.LogDebug("[Client #", SockFD, "] Waiting for events...");
-    int NumPolled = Poll.Poll(Globals::ClientTimeoutMSec);
-    if (NumPolled == 0) {
-      if (Poll.GetPolledClientsNum() == 0) {
-        WaitForCacheRecordUpdate(0);
-        continue;
-      }
-      Finish();
-      break;
-    }
-
-    for (auto &Client : Poll) {
-      Log::DefaultLogger.LogDebug(
-          "FD ", Client.GetFD(), " received ",
-          Utils::EventsToString(Client.GetReceivedEvents()));
-
-      try {
-        Handle(&Poll, &Client);
-      } catch (std::system_error &E) {
-        Log::DefaultLogger.LogFatal("[Remote #", Client.GetFD(),
-                                    "]: ", E.what());
-        Finish();
-        break;
-      }
-      ThisThread::InterruptionPoint();
-    }
-  }
-
-  Log::DefaultLogger.LogDebug("[Client #", SockFD, "] Terminating");
+void ClientHandler::Start() {
+  Loop->GetPoller()->Add(SockFD, POLLIN, this);
+  ArmWaitTimer();
 }
 
-void ClientHandler::Start() { ClientThread.StartThread(); }
-
 void ClientHandler::Handle(Poller *P, PollClient *Client) {
   assert(Client->GetFD() == SockFD);
   auto Events = Client->GetReceivedEvents();
@@ -375,8 +721,6 @@ void ClientHandler::Handle(Poller *P, PollClient *Client) {
 
 ClientHandler::~ClientHandler() {
   Terminate();
-  ClientThread.Interrupt();
-  ClientThread.Join();
   if (ClientSock)
     delete ClientSock;
 }
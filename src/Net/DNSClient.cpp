@@ -0,0 +1,270 @@
+#include <Common/Globals.hpp>
+#include <Common/ProxyException.hpp>
+#include <Common/Utils.hpp>
+#include <Net/DNSClient.hpp>
+#include <algorithm>
+#include <arpa/inet.h>
+#include <chrono>
+#include <cstring>
+#include <netinet/in.h>
+#include <poll.h>
+#include <random>
+#include <stdexcept>
+#include <unistd.h>
+
+namespace proxy {
+namespace {
+constexpr uint16_t TypeA = 1;
+constexpr uint16_t TypeAAAA = 28;
+constexpr uint16_t ClassIN = 1;
+constexpr std::size_t HeaderSize = 12;
+constexpr std::size_t MaxMessageSize = 512;
+constexpr uint16_t DefaultPort = 53;
+
+uint16_t ReadU16(const uint8_t *Bytes) {
+  return static_cast<uint16_t>((Bytes[0] << 8) | Bytes[1]);
+}
+
+uint32_t ReadU32(const uint8_t *Bytes) {
+  return (static_cast<uint32_t>(ReadU16(Bytes)) << 16) | ReadU16(Bytes + 2);
+}
+
+void AppendU16(std::vector<uint8_t> &Bytes, uint16_t Value) {
+  Bytes.push_back(static_cast<uint8_t>(Value >> 8));
+  Bytes.push_back(static_cast<uint8_t>(Value & 0xff));
+}
+
+uint16_t NextQueryId() {
+  static thread_local std::mt19937 Generator{std::random_device{}()};
+  return static_cast<uint16_t>(Generator());
+}
+
+std::vector<uint8_t> MakeQuery(uint16_t Id, const std::string &Host,
+                               uint16_t Type) {
+  std::vector<uint8_t> Query;
+  AppendU16(Query, Id);
+  AppendU16(Query, 0x0100); // Recursion desired
+  AppendU16(Query, 1);      // Questions
+  AppendU16(Query, 0);
+  AppendU16(Query, 0);
+  AppendU16(Query, 0);
+
+  std::size_t LabelStart = 0;
+  while (LabelStart < Host.size()) {
+    std::size_t LabelEnd = Host.find('.', LabelStart);
+    if (LabelEnd == std::string::npos)
+      LabelEnd = Host.size();
+    std::size_t LabelSize = LabelEnd - LabelStart;
+    if (LabelSize == 0 || LabelSize > 63)
+      throw std::runtime_error("Invalid host name: " + Host);
+    Query.push_back(static_cast<uint8_t>(LabelSize));
+    Query.insert(Query.end(), Host.begin() + LabelStart,
+                 Host.begin() + LabelEnd);
+    LabelStart = LabelEnd + 1;
+  }
+  Query.push_back(0);
+  if (Query.size() - HeaderSize > 255)
+    throw std::runtime_error("Invalid host name: " + Host);
+
+  AppendU16(Query, Type);
+  AppendU16(Query, ClassIN);
+  return Query;
+}
+
+// Returns the offset past the (possibly compressed) name at Offset
+std::size_t SkipName(const uint8_t *Bytes, std::size_t Size,
+                     std::size_t Offset) {
+  while (Offset < Size) {
+    uint8_t Length = Bytes[Offset];
+    if (Length == 0)
+      return Offset + 1;
+    // Compression pointer ends the name
+    if ((Length & 0xc0) == 0xc0)
+      return Offset + 2;
+    Offset += Length + 1;
+  }
+  throw std::runtime_error("Malformed DNS response");
+}
+
+// Adds the answers of the response to Answer, returns false if the response
+// isn't the one we're waiting for
+bool ParseResponse(const uint8_t *Bytes, std::size_t Size, uint16_t Id,
+                   DNSAnswer &Answer) {
+  if (Size < HeaderSize || ReadU16(Bytes) != Id)
+    return false;
+  uint16_t Flags = ReadU16(Bytes + 2);
+  if (!(Flags & 0x8000))
+    return false;
+
+  // The answer section of a truncated response can't be trusted, the caller
+  // retries with a resolver that falls back to TCP
+  if (Flags & 0x0200) {
+    Answer.Truncated = true;
+    return true;
+  }
+  uint16_t ResponseCode = Flags & 0xf;
+  if (ResponseCode == 3) {
+    Answer.NameError = true;
+    return true;
+  }
+  // Servers often fail AAAA queries only, which must not discard a good A
+  // answer, so any other failure just answers the query with nothing
+  if (ResponseCode != 0)
+    return true;
+
+  uint16_t QuestionsNum = ReadU16(Bytes + 4);
+  uint16_t AnswersNum = ReadU16(Bytes + 6);
+  std::size_t Offset = HeaderSize;
+  for (uint16_t i = 0; i < QuestionsNum; i++)
+    Offset = SkipName(Bytes, Size, Offset) + 4;
+
+  for (uint16_t i = 0; i < AnswersNum; i++) {
+    Offset = SkipName(Bytes, Size, Offset);
+    if (Offset + 10 > Size)
+      throw std::runtime_error("Malformed DNS response");
+    uint16_t Type = ReadU16(Bytes + Offset);
+    uint32_t TTL = ReadU32(Bytes + Offset + 4);
+    uint16_t DataSize = ReadU16(Bytes + Offset + 8);
+    Offset += 10;
+    if (Offset + DataSize > Size)
+      throw std::runtime_error("Malformed DNS response");
+
+    ResolvedAddress Address;
+    memset(&Address, 0, sizeof(Address));
+    if (Type == TypeA && DataSize == 4) {
+      auto *Addr = reinterpret_cast<struct sockaddr_in *>(&Address.Addr);
+      Addr->sin_family = AF_INET;
+      memcpy(&Addr->sin_addr, Bytes + Offset, 4);
+      Address.AddrLen = sizeof(*Addr);
+    } else if (Type == TypeAAAA && DataSize == 16) {
+      auto *Addr = reinterpret_cast<struct sockaddr_in6 *>(&Address.Addr);
+      Addr->sin6_family = AF_INET6;
+      memcpy(&Addr->sin6_addr, Bytes + Offset, 16);
+      Address.AddrLen = sizeof(*Addr);
+    } else {
+      // CNAMEs are followed by the records of the canonical name
+      Offset += DataSize;
+      continue;
+    }
+    Offset += DataSize;
+
+    Answer.TTL =
+        Answer.Addresses.empty() ? TTL : std::min(Answer.TTL, TTL);
+    Answer.Addresses.push_back(Address);
+  }
+  return true;
+}
+} // namespace
+
+DNSClient::DNSClient(const std::string &NameServer) {
+  std::string Host = NameServer;
+  uint16_t Port = DefaultPort;
+  if (!Host.empty() && Host.front() == '[') {
+    auto End = Host.find(']');
+    if (End == std::string::npos)
+      throw std::runtime_error("Invalid name server address: " + NameServer);
+    if (End + 1 < Host.size() && Host[End + 1] == ':' &&
+        !Utils::StrToInt<uint16_t>(Port, Host.substr(End + 2)))
+      throw std::runtime_error("Invalid name server port: " + NameServer);
+    Host = Host.substr(1, End - 1);
+  } else if (std::count(Host.begin(), Host.end(), ':') == 1) {
+    auto Colon = Host.find(':');
+    if (!Utils::StrToInt<uint16_t>(Port, Host.substr(Colon + 1)))
+      throw std::runtime_error("Invalid name server port: " + NameServer);
+    Host.resize(Colon);
+  }
+
+  memset(&ServerAddr, 0, sizeof(ServerAddr));
+  auto *Addr4 = reinterpret_cast<struct sockaddr_in *>(&ServerAddr);
+  auto *Addr6 = reinterpret_cast<struct sockaddr_in6 *>(&ServerAddr);
+  if (inet_pton(AF_INET, Host.c_str(), &Addr4->sin_addr) == 1) {
+    Addr4->sin_family = AF_INET;
+    Addr4->sin_port = htons(Port);
+    ServerAddrLen = sizeof(*Addr4);
+  } else if (inet_pton(AF_INET6, Host.c_str(), &Addr6->sin6_addr) == 1) {
+    Addr6->sin6_family = AF_INET6;
+    Addr6->sin6_port = htons(Port);
+    ServerAddrLen = sizeof(*Addr6);
+  } else {
+    throw std::runtime_error("Invalid name server address: " + NameServer);
+  }
+}
+
+DNSAnswer DNSClient::Query(const std::string &Host) {
+  using namespace std::chrono;
+  int FD = socket(ServerAddr.ss_family, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+  if (FD == -1)
+    Exception::ThrowSystemError("socket()");
+  struct FDCloser {
+    int FD;
+    ~FDCloser() { close(FD); }
+  } Closer{FD};
+
+  if (connect(FD, reinterpret_cast<const struct sockaddr *>(&ServerAddr),
+              ServerAddrLen) == -1)
+    Exception::ThrowSystemError("connect()");
+
+  // Both queries are in flight at the same time
+  const uint16_t Types[] = {TypeA, TypeAAAA};
+  uint16_t Ids[2];
+  std::vector<uint8_t> Queries[2];
+  bool Answered[2] = {false, false};
+  for (int i = 0; i < 2; i++) {
+    Ids[i] = NextQueryId();
+    Queries[i] = MakeQuery(Ids[i], Host, Types[i]);
+  }
+
+  DNSAnswer Answer;
+  uint8_t Response[MaxMessageSize];
+  for (std::size_t Attempt = 0; Attempt < Globals::ResolverAttemptsNum;
+       Attempt++) {
+    for (int i = 0; i < 2; i++)
+      if (!Answered[i] &&
+          send(FD, Queries[i].data(), Queries[i].size(), 0) == -1)
+        Exception::ThrowSystemError("send()");
+
+    auto Deadline = steady_clock::now() +
+                    milliseconds(Globals::ResolverTimeoutMSec);
+    while (!(Answered[0] && Answered[1])) {
+      auto Remaining =
+          duration_cast<milliseconds>(Deadline - steady_clock::now()).count();
+      if (Remaining <= 0)
+        break;
+      struct pollfd PollFD {
+        FD, POLLIN, 0
+      };
+      int Status = poll(&PollFD, 1, static_cast<int>(Remaining));
+      if (Status == -1 && errno != EINTR)
+        Exception::ThrowSystemError("poll()");
+      if (Status <= 0)
+        continue;
+
+      ssize_t Received = recv(FD, Response, sizeof(Response), 0);
+      if (Received == -1) {
+        // ICMP port unreachable is reported on connected UDP sockets
+        if (errno == ECONNREFUSED)
+          Exception::ThrowSystemError("recv()");
+        continue;
+      }
+      for (int i = 0; i < 2; i++) {
+        if (Answered[i])
+          continue;
+        if (ParseResponse(Response, Received, Ids[i], Answer)) {
+          Answered[i] = true;
+          break;
+        }
+      }
+      if (Answer.NameError)
+        return Answer;
+    }
+    if (Answered[0] && Answered[1])
+      return Answer;
+  }
+
+  // A partial answer is still usable
+  if (Answered[0] || Answered[1])
+    return Answer;
+  Exception::ThrowSystemError(ETIMEDOUT, "DNS query for " + Host);
+  return Answer;
+}
+} // namespace proxy
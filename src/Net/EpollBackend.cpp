@@ -0,0 +1,92 @@
+#include <Net/EpollBackend.hpp>
+
+#ifdef __linux__
+#include <Common/Globals.hpp>
+#include <Common/ProxyException.hpp>
+#include <algorithm>
+#include <cerrno>
+#include <poll.h>
+#include <unistd.h>
+
+namespace proxy {
+static uint32_t ToEpollEvents(short Events, int Flags) {
+  uint32_t EpollEvents = 0;
+  if (Events & POLLIN)
+    EpollEvents |= EPOLLIN;
+  if (Events & POLLPRI)
+    EpollEvents |= EPOLLPRI;
+  if (Events & POLLOUT)
+    EpollEvents |= EPOLLOUT;
+  if (Flags & PollerBackend::EdgeTriggered)
+    EpollEvents |= EPOLLET;
+  if (Flags & PollerBackend::OneShot)
+    EpollEvents |= EPOLLONESHOT;
+  return EpollEvents;
+}
+
+static short FromEpollEvents(uint32_t EpollEvents) {
+  short Events = 0;
+  if (EpollEvents & EPOLLIN)
+    Events |= POLLIN;
+  if (EpollEvents & EPOLLPRI)
+    Events |= POLLPRI;
+  if (EpollEvents & EPOLLOUT)
+    Events |= POLLOUT;
+  if (EpollEvents & EPOLLERR)
+    Events |= POLLERR;
+  if (EpollEvents & EPOLLHUP)
+    Events |= POLLHUP;
+  return Events;
+}
+
+EpollBackend::EpollBackend() {
+  EpollFD = epoll_create1(EPOLL_CLOEXEC);
+  if (EpollFD == -1)
+    Exception::ThrowSystemError("epoll_create1()");
+}
+
+void EpollBackend::Control(int Op, int FD, short Events, int Flags) {
+  struct epoll_event Event {};
+  Event.events = ToEpollEvents(Events, Flags);
+  Event.data.fd = FD;
+  if (epoll_ctl(EpollFD, Op, FD, &Event) == -1)
+    Exception::ThrowSystemError("epoll_ctl()");
+}
+
+void EpollBackend::Add(int FD, short Events, int Flags) {
+  Control(EPOLL_CTL_ADD, FD, Events, Flags);
+  RegisteredNum++;
+}
+
+void EpollBackend::Modify(int FD, short Events, int Flags) {
+  Control(EPOLL_CTL_MOD, FD, Events, Flags);
+}
+
+void EpollBackend::Remove(int FD) {
+  RegisteredNum--;
+  // Closed fds are removed from the epoll set by the kernel
+  if (epoll_ctl(EpollFD, EPOLL_CTL_DEL, FD, nullptr) == -1 &&
+      errno != ENOENT && errno != EBADF)
+    Exception::ThrowSystemError("epoll_ctl()");
+}
+
+int EpollBackend::Wait(int TimeoutMSec, std::vector<PolledEvent> &Ready) {
+  Ready.clear();
+  if (RegisteredNum == 0)
+    return 0;
+  Events.resize(std::min(RegisteredNum, Globals::EpollMaxEvents));
+  int Status = epoll_wait(EpollFD, Events.data(), Events.size(), TimeoutMSec);
+  if (Status == -1) {
+    if (errno == EINTR)
+      return 0;
+    Exception::ThrowSystemError("epoll_wait()");
+  }
+
+  for (int i = 0; i < Status; i++)
+    Ready.push_back({Events[i].data.fd, FromEpollEvents(Events[i].events)});
+  return Status;
+}
+
+EpollBackend::~EpollBackend() { close(EpollFD); }
+} // namespace proxy
+#endif
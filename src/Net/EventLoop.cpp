@@ -0,0 +1,369 @@
+#include <Common/Globals.hpp>
+#include <Common/ProxyException.hpp>
+#include <Common/Utils.hpp>
+#include <Logging/Logger.hpp>
+#include <Net/EventLoop.hpp>
+#include <Parallel/LockGuard.hpp>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
+
+namespace proxy {
+EventLoop::EventLoop(std::size_t Idx, PollerType Type)
+    : Idx(Idx), Poll(Type),
+      Timers(std::chrono::milliseconds(Globals::TimerWheelTickMSec)) {
+#ifdef __linux__
+  // A counter instead of a pipe: no buffer to fill up and a single read
+  // drains any number of signals
+  WakeupFDs[0] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (WakeupFDs[0] == -1)
+    Exception::ThrowSystemError("eventfd()");
+  WakeupFDs[1] = WakeupFDs[0];
+#else
+  if (pipe(WakeupFDs) == -1)
+    Exception::ThrowSystemError("pipe()");
+  for (int FD : WakeupFDs) {
+    if (fcntl(FD, F_SETFL, fcntl(FD, F_GETFL) | O_NONBLOCK) < 0) {
+      close(WakeupFDs[0]);
+      close(WakeupFDs[1]);
+      Exception::ThrowSystemError("fcntl()");
+    }
+  }
+#endif
+  LastUpstreamsCheck = SocketBase::ClockT::now();
+}
+
+std::size_t EventLoop::GetIdx() const { return Idx; }
+
+Poller *EventLoop::GetPoller() { return &Poll; }
+
+UpstreamPool *EventLoop::GetUpstreamPool() { return &Upstreams; }
+
+TimerWheel *EventLoop::GetTimers() { return &Timers; }
+
+bool EventLoop::IsInLoopThread() const {
+  return LoopThread.GetId() == ThisThread::GetId();
+}
+
+// The thread is only created here, so that a loop that never started can be
+// destroyed without joining
+void EventLoop::Start() {
+  LoopThread = Thread(Function(&EventLoop::LoopRoutine, this));
+  LoopThread.StartThread();
+}
+
+void EventLoop::Terminate() {
+  {
+    LockGuard<WriteLocker> G(&IsTerminatedLock, false);
+    _IsTerminated = true;
+  }
+  SignalWakeup();
+}
+
+bool EventLoop::IsTerminated() {
+  LockGuard<ReadLocker> G(&IsTerminatedLock, false);
+  return _IsTerminated;
+}
+
+void EventLoop::Join() {
+  if (LoopThread.Joinable())
+    LoopThread.Join();
+}
+
+void EventLoop::SignalWakeup() {
+#ifdef __linux__
+  uint64_t Value = 1;
+#else
+  char Value = 0;
+#endif
+  // A full pipe or counter means the loop is going to wake up anyway
+  if (write(WakeupFDs[1], &Value, sizeof(Value)) == -1 && errno != EAGAIN)
+    Log::DefaultLogger.LogError("[Loop #", Idx, "] write(): ", strerror(errno));
+}
+
+void EventLoop::DrainWakeups() {
+#ifdef __linux__
+  uint64_t Value;
+  if (read(WakeupFDs[0], &Value, sizeof(Value)) == -1 && errno != EAGAIN)
+    Log::DefaultLogger.LogError("[Loop #", Idx, "] read(): ", strerror(errno));
+#else
+  char Buf[Globals::StackBufferSize];
+  while (read(WakeupFDs[0], Buf, sizeof(Buf)) > 0)
+    ;
+#endif
+}
+
+bool EventLoop::HasPendingWork() const {
+  return !PendingHandlers.empty() || !WokenHandlers.empty() ||
+         !WokenListeners.empty();
+}
+
+void EventLoop::Attach(PollHandlerBase *HB) {
+  HB->SetEventLoop(this);
+  if (IsInLoopThread()) {
+    StartHandler(HB);
+    return;
+  }
+  bool NeedSignal;
+  {
+    LockGuard<MutexLocker> G(&PendingMutex);
+    NeedSignal = !HasPendingWork();
+    PendingHandlers.push_back(HB);
+  }
+  if (NeedSignal)
+    SignalWakeup();
+}
+
+void EventLoop::Wakeup(PollHandlerBase *HB) {
+  bool NeedSignal;
+  {
+    LockGuard<MutexLocker> G(&PendingMutex);
+    NeedSignal = !HasPendingWork();
+    WokenHandlers.insert(HB);
+  }
+  if (NeedSignal)
+    SignalWakeup();
+}
+
+void EventLoop::WakeupListeners(CacheListener *const *Listeners,
+                                std::size_t Num) {
+  bool NeedSignal;
+  {
+    LockGuard<MutexLocker> G(&PendingMutex);
+    NeedSignal = !HasPendingWork();
+    for (std::size_t i = 0; i < Num; i++) {
+      if (Listeners[i]->MarkWakeupPending())
+        WokenListeners.push_back(Listeners[i]);
+    }
+    NeedSignal = NeedSignal && !WokenListeners.empty();
+  }
+  if (NeedSignal)
+    SignalWakeup();
+}
+
+void EventLoop::ForgetListener(CacheListener *Listener) {
+  LockGuard<MutexLocker> G(&PendingMutex);
+  for (auto It = WokenListeners.begin(); It != WokenListeners.end(); ++It) {
+    if (*It == Listener) {
+      WokenListeners.erase(It);
+      break;
+    }
+  }
+}
+
+void EventLoop::MarkDeadHandler(PollHandlerBase *HB) {
+  if (HB)
+    DeadHandlers.insert(HB);
+}
+
+void EventLoop::StartHandler(PollHandlerBase *HB) {
+  Handlers.insert(HB);
+  try {
+    HB->Start();
+  } catch (const std::exception &E) {
+    Log::DefaultLogger.LogError("[Loop #", Idx,
+                                "] Failed to start handler: ", E.what());
+    HB->Terminate();
+    MarkDeadHandler(HB);
+  }
+}
+
+void EventLoop::RunPending() {
+  std::vector<PollHandlerBase *> NewHandlers;
+  std::set<PollHandlerBase *> Woken;
+  std::vector<CacheListener *> Listeners;
+  {
+    LockGuard<MutexLocker> G(&PendingMutex);
+    NewHandlers.swap(PendingHandlers);
+    Woken.swap(WokenHandlers);
+    Listeners.swap(WokenListeners);
+  }
+
+  for (auto *HB : NewHandlers)
+    StartHandler(HB);
+
+  for (auto *HB : Woken) {
+    if (Handlers.find(HB) == Handlers.end() ||
+        DeadHandlers.find(HB) != DeadHandlers.end())
+      continue;
+    try {
+      HB->HandleWakeup();
+    } catch (const std::exception &E) {
+      Log::DefaultLogger.LogError("[Loop #", Idx, "] ", E.what());
+      HB->Terminate();
+      MarkDeadHandler(HB);
+    }
+  }
+
+  // Listeners are only deleted by this thread after they are forgotten, so
+  // the ones taken here are alive
+  for (auto *L : Listeners) {
+    L->ClearWakeupPending();
+    L->OnCacheWakeup();
+  }
+}
+
+void EventLoop::RunCompletedIO() {
+  std::vector<PollHandlerBase *> Drained;
+  for (auto *Req : Poll.GetCompletedIO()) {
+    // Cleared only now, so that the readiness handlers run before don't
+    // submit another request
+    Req->InFlight = false;
+    auto *HB = Req->Handler;
+    auto It = DrainingHandlers.find(HB);
+    if (It != DrainingHandlers.end()) {
+      // Other requests of the handler may follow in the list
+      if (!HB->HasIOInFlight()) {
+        DrainingHandlers.erase(It);
+        Drained.push_back(HB);
+      }
+      continue;
+    }
+    if (Handlers.find(HB) == Handlers.end() ||
+        DeadHandlers.find(HB) != DeadHandlers.end())
+      continue;
+    try {
+      HB->HandleIO(Req);
+    } catch (const std::exception &E) {
+      Log::DefaultLogger.LogError("[Loop #", Idx, "] ", E.what());
+      HB->Terminate();
+      MarkDeadHandler(HB);
+    }
+  }
+  for (auto *HB : Drained)
+    delete HB;
+}
+
+void EventLoop::ExpireTimers() {
+  using namespace std::chrono;
+  auto Now = SocketBase::ClockT::now();
+  if (duration_cast<milliseconds>(Now - LastUpstreamsCheck).count() >=
+      static_cast<long>(Globals::EventLoopTickMSec)) {
+    LastUpstreamsCheck = Now;
+    Upstreams.CloseExpired();
+  }
+
+  Timers.Advance(Now, ExpiredTimers);
+  for (auto *T : ExpiredTimers) {
+    auto *HB = T->GetHandler();
+    // Handlers terminated by an earlier timer
+    if (DeadHandlers.find(HB) != DeadHandlers.end())
+      continue;
+    if (T->GetKind() == TimeoutKind::Idle) {
+      auto Time = HB->GetLastIOTimePoint();
+      if (Time.has_value() && *Time + T->GetTimeout() > Now) {
+        Timers.Arm(T, TimeoutKind::Idle,
+                   duration_cast<milliseconds>(*Time + T->GetTimeout() - Now));
+        continue;
+      }
+    }
+    auto *Sock = HB->GetSocket();
+    Log::DefaultLogger.LogInfo("Socket #", Sock ? Sock->GetFD() : -1, " ",
+                               TimeoutKindToString(T->GetKind()),
+                               " timeout expired, disconnecting");
+    HB->Terminate();
+    MarkDeadHandler(HB);
+  }
+  ExpiredTimers.clear();
+}
+
+void EventLoop::EraseDeadHandlers() {
+  if (DeadHandlers.empty())
+    return;
+  // Handlers may mark each other dead while being deleted
+  while (!DeadHandlers.empty()) {
+    std::set<PollHandlerBase *> Dead;
+    Dead.swap(DeadHandlers);
+    {
+      LockGuard<MutexLocker> G(&PendingMutex);
+      for (auto *HB : Dead)
+        WokenHandlers.erase(HB);
+    }
+    for (auto *HB : Dead) {
+      Handlers.erase(HB);
+      if (HB->HasIOInFlight()) {
+        DrainingHandlers.insert(HB);
+        continue;
+      }
+      delete HB;
+    }
+    Poll.Flush();
+  }
+}
+
+void EventLoop::LoopRoutine() {
+  ThisThread::BlockInterruptionSignals();
+  // The wakeup FD is always drained, so it's safe to be edge-triggered
+  Poll.Add(WakeupFDs[0], POLLIN, nullptr, Poller::EdgeTriggered);
+  Log::DefaultLogger.LogDebug("[Loop #", Idx, "] Started");
+
+  while (!IsTerminated()) {
+    Poll.Poll(Globals::EventLoopTickMSec);
+
+    for (auto &Client : Poll) {
+      auto *HB = Client.GetHandler();
+      if (!HB) {
+        DrainWakeups();
+        continue;
+      }
+      if (DeadHandlers.find(HB) != DeadHandlers.end())
+        continue;
+
+      Log::DefaultLogger.LogDebug(
+          "FD ", Client.GetFD(), " received ",
+          Utils::EventsToString(Client.GetReceivedEvents()));
+      try {
+        HB->Handle(&Poll, &Client);
+      } catch (const std::exception &E) {
+        Log::DefaultLogger.LogError("[Loop #", Idx, "] FD ", Client.GetFD(),
+                                    ": ", E.what());
+        HB->Terminate();
+        MarkDeadHandler(HB);
+      }
+    }
+
+    RunCompletedIO();
+    RunPending();
+    ExpireTimers();
+    // Remove dead sockets from the poll pool before they get closed
+    Poll.Flush();
+    EraseDeadHandlers();
+  }
+
+  // The handlers are deleted by another thread, the kernel must be done
+  // with their buffers by then
+  Poll.DrainIO();
+  Log::DefaultLogger.LogDebug("[Loop #", Idx, "] Terminating");
+}
+
+EventLoop::~EventLoop() {
+  Join();
+  {
+    LockGuard<MutexLocker> G(&PendingMutex, false);
+    for (auto *HB : PendingHandlers)
+      Handlers.insert(HB);
+    PendingHandlers.clear();
+    WokenHandlers.clear();
+    WokenListeners.clear();
+  }
+  for (auto *HB : Handlers)
+    HB->Terminate();
+  for (auto *HB : Handlers)
+    delete HB;
+  for (auto *HB : DrainingHandlers)
+    delete HB;
+  Handlers.clear();
+  DeadHandlers.clear();
+  DrainingHandlers.clear();
+  close(WakeupFDs[0]);
+  if (WakeupFDs[1] != WakeupFDs[0])
+    close(WakeupFDs[1]);
+}
+} // namespace proxy
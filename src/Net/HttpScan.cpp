@@ -0,0 +1,226 @@
+#include <Net/HttpScan.hpp>
+#include <cstring>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define PROXY_HTTP_SCAN_X86
+#include <immintrin.h>
+#endif
+
+namespace proxy {
+namespace {
+using LineScan = HttpScan::LineScan;
+
+struct Kernels {
+  HttpScan::Level Level;
+  LineScan (*ScanLine)(const char *, const char *);
+  const char *(*FindLineEnd)(const char *, const char *);
+};
+
+bool IsCtl(unsigned char C) {
+  return (C < 0x20 && C != '\t' && C != '\n') || C == 0x7f;
+}
+
+// Also finishes the tails of the vector kernels
+LineScan ScanLineScalar(const char *P, const char *End, LineScan Res) {
+  for (; P != End; P++) {
+    auto C = static_cast<unsigned char>(*P);
+    if (C == '\n') {
+      Res.LineEnd = P;
+      return Res;
+    }
+    if (C == ':' && !Res.Colon)
+      Res.Colon = P;
+    if (!Res.Ctl && IsCtl(C))
+      Res.Ctl = P;
+  }
+  return Res;
+}
+
+LineScan ScanLineScalar(const char *Begin, const char *End) {
+  return ScanLineScalar(Begin, End, LineScan());
+}
+
+const char *FindLineEndScalar(const char *Begin, const char *End) {
+  return static_cast<const char *>(memchr(Begin, '\n', End - Begin));
+}
+
+// Records the first colon and control character of a block given the
+// bitmasks of their positions, returns true if the block ends the line
+bool AddBlockMasks(const char *Block, unsigned NL, unsigned Colon,
+                   unsigned Ctl, LineScan &Res) {
+  if (NL) {
+    // Only the bytes preceding the line end count
+    unsigned Before = (NL & -NL) - 1;
+    Colon &= Before;
+    Ctl &= Before;
+  }
+  if (Colon && !Res.Colon)
+    Res.Colon = Block + __builtin_ctz(Colon);
+  if (Ctl && !Res.Ctl)
+    Res.Ctl = Block + __builtin_ctz(Ctl);
+  if (NL)
+    Res.LineEnd = Block + __builtin_ctz(NL);
+  return NL != 0;
+}
+
+#ifdef PROXY_HTTP_SCAN_X86
+LineScan ScanLineSSE2(const char *P, const char *End) {
+  LineScan Res;
+  const __m128i NL = _mm_set1_epi8('\n');
+  const __m128i Colon = _mm_set1_epi8(':');
+  const __m128i Tab = _mm_set1_epi8('\t');
+  const __m128i Del = _mm_set1_epi8(0x7f);
+  const __m128i MaxCtl = _mm_set1_epi8(0x1f);
+  for (; End - P >= 16; P += 16) {
+    __m128i Bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(P));
+    __m128i IsNL = _mm_cmpeq_epi8(Bytes, NL);
+    // Unsigned Bytes <= 0x1f
+    __m128i IsLow = _mm_cmpeq_epi8(_mm_min_epu8(Bytes, MaxCtl), Bytes);
+    __m128i IsNLOrTab = _mm_or_si128(IsNL, _mm_cmpeq_epi8(Bytes, Tab));
+    __m128i IsCtl = _mm_or_si128(_mm_andnot_si128(IsNLOrTab, IsLow),
+                                 _mm_cmpeq_epi8(Bytes, Del));
+    unsigned NLMask = _mm_movemask_epi8(IsNL);
+    unsigned ColonMask = _mm_movemask_epi8(_mm_cmpeq_epi8(Bytes, Colon));
+    unsigned CtlMask = _mm_movemask_epi8(IsCtl);
+    if ((NLMask | ColonMask | CtlMask) &&
+        AddBlockMasks(P, NLMask, ColonMask, CtlMask, Res))
+      return Res;
+  }
+  return ScanLineScalar(P, End, Res);
+}
+
+const char *FindLineEndSSE2(const char *P, const char *End) {
+  const __m128i NL = _mm_set1_epi8('\n');
+  for (; End - P >= 16; P += 16) {
+    __m128i Bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(P));
+    unsigned Mask = _mm_movemask_epi8(_mm_cmpeq_epi8(Bytes, NL));
+    if (Mask)
+      return P + __builtin_ctz(Mask);
+  }
+  return FindLineEndScalar(P, End);
+}
+
+__attribute__((target("avx2"))) LineScan ScanLineAVX2(const char *P,
+                                                      const char *End) {
+  LineScan Res;
+  const __m256i NL = _mm256_set1_epi8('\n');
+  const __m256i Colon = _mm256_set1_epi8(':');
+  const __m256i Tab = _mm256_set1_epi8('\t');
+  const __m256i Del = _mm256_set1_epi8(0x7f);
+  const __m256i MaxCtl = _mm256_set1_epi8(0x1f);
+  for (; End - P >= 32; P += 32) {
+    __m256i Bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(P));
+    __m256i IsNL = _mm256_cmpeq_epi8(Bytes, NL);
+    __m256i IsLow =
+        _mm256_cmpeq_epi8(_mm256_min_epu8(Bytes, MaxCtl), Bytes);
+    __m256i IsNLOrTab =
+        _mm256_or_si256(IsNL, _mm256_cmpeq_epi8(Bytes, Tab));
+    __m256i IsCtl = _mm256_or_si256(_mm256_andnot_si256(IsNLOrTab, IsLow),
+                                    _mm256_cmpeq_epi8(Bytes, Del));
+    unsigned NLMask = _mm256_movemask_epi8(IsNL);
+    unsigned ColonMask =
+        _mm256_movemask_epi8(_mm256_cmpeq_epi8(Bytes, Colon));
+    unsigned CtlMask = _mm256_movemask_epi8(IsCtl);
+    if ((NLMask | ColonMask | CtlMask) &&
+        AddBlockMasks(P, NLMask, ColonMask, CtlMask, Res))
+      return Res;
+  }
+  return ScanLineScalar(P, End, Res);
+}
+
+__attribute__((target("avx2"))) const char *FindLineEndAVX2(const char *P,
+                                                            const char *End) {
+  const __m256i NL = _mm256_set1_epi8('\n');
+  for (; End - P >= 32; P += 32) {
+    __m256i Bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(P));
+    unsigned Mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(Bytes, NL));
+    if (Mask)
+      return P + __builtin_ctz(Mask);
+  }
+  return FindLineEndScalar(P, End);
+}
+#endif
+
+const Kernels ScalarKernels{HttpScan::Level::Scalar, ScanLineScalar,
+                            FindLineEndScalar};
+#ifdef PROXY_HTTP_SCAN_X86
+const Kernels SSE2Kernels{HttpScan::Level::SSE2, ScanLineSSE2,
+                          FindLineEndSSE2};
+const Kernels AVX2Kernels{HttpScan::Level::AVX2, ScanLineAVX2,
+                          FindLineEndAVX2};
+#endif
+
+bool IsSupported(HttpScan::Level L) {
+#ifdef PROXY_HTTP_SCAN_X86
+  // SSE2 is a part of x86-64
+  if (L == HttpScan::Level::AVX2) {
+    // May run before the constructors of libgcc
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+  }
+  return true;
+#else
+  return L == HttpScan::Level::Scalar;
+#endif
+}
+
+const Kernels *GetKernelsFor(HttpScan::Level L) {
+#ifdef PROXY_HTTP_SCAN_X86
+  if (L == HttpScan::Level::AVX2)
+    return &AVX2Kernels;
+  if (L == HttpScan::Level::SSE2)
+    return &SSE2Kernels;
+#endif
+  return &ScalarKernels;
+}
+
+const Kernels *DetectKernels() {
+  if (IsSupported(HttpScan::Level::AVX2))
+    return GetKernelsFor(HttpScan::Level::AVX2);
+  if (IsSupported(HttpScan::Level::SSE2))
+    return GetKernelsFor(HttpScan::Level::SSE2);
+  return &ScalarKernels;
+}
+
+const Kernels *Current = DetectKernels();
+} // namespace
+
+HttpScan::LineScan HttpScan::ScanLine(const char *Begin, const char *End) {
+  return Current->ScanLine(Begin, End);
+}
+
+const char *HttpScan::FindLineEnd(const char *Begin, const char *End) {
+  return Current->FindLineEnd(Begin, End);
+}
+
+const char *HttpScan::FindHeadEnd(const char *Begin, const char *End) {
+  const char *P = Begin;
+  while (const char *NL = Current->FindLineEnd(P, End)) {
+    if (NL - Begin >= 3 && memcmp(NL - 3, "\r\n\r", 3) == 0)
+      return NL + 1;
+    P = NL + 1;
+  }
+  return nullptr;
+}
+
+HttpScan::Level HttpScan::GetLevel() { return Current->Level; }
+
+bool HttpScan::SetLevel(Level L) {
+  if (!IsSupported(L))
+    return false;
+  Current = GetKernelsFor(L);
+  return true;
+}
+
+const char *HttpScan::LevelToString(Level L) {
+  switch (L) {
+  case Level::Scalar:
+    return "scalar";
+  case Level::SSE2:
+    return "SSE2";
+  case Level::AVX2:
+    return "AVX2";
+  }
+  return "unknown";
+}
+} // namespace proxy
@@ -0,0 +1,351 @@
+#include <Net/IoUringBackend.hpp>
+
+#ifdef PROXY_HAS_IO_URING
+#include <Common/Globals.hpp>
+#include <Common/ProxyException.hpp>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <limits>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace proxy {
+// user_data of the requests whose completions carry no events
+static constexpr uint64_t TimeoutUserData = ~0ULL;
+static constexpr uint64_t PollRemoveUserData = ~0ULL - 1;
+static constexpr uint64_t CancelUserData = ~0ULL - 2;
+// Set in the user_data of poll requests, I/O requests carry the IORequest
+// pointer instead
+static constexpr uint64_t PollUserDataFlag = 1ULL << 63;
+static constexpr uint32_t GenerationMask = (1U << 31) - 1;
+
+static uint64_t ToUserData(int FD, uint32_t Generation) {
+  return PollUserDataFlag | (static_cast<uint64_t>(Generation) << 32) |
+         static_cast<uint32_t>(FD);
+}
+
+static int UserDataFD(uint64_t UserData) {
+  return static_cast<int>(static_cast<uint32_t>(UserData));
+}
+
+static uint32_t UserDataGeneration(uint64_t UserData) {
+  return static_cast<uint32_t>(UserData >> 32) & GenerationMask;
+}
+
+template <typename T> static T *RingPtr(void *Ring, uint32_t Offset) {
+  return reinterpret_cast<T *>(static_cast<char *>(Ring) + Offset);
+}
+
+IoUringBackend::IoUringBackend() {
+  struct io_uring_params Params;
+  memset(&Params, 0, sizeof(Params));
+  RingFD = static_cast<int>(
+      syscall(__NR_io_uring_setup, Globals::IoUringEntries, &Params));
+  if (RingFD < 0)
+    Exception::ThrowSystemError("io_uring_setup()");
+
+  SQRingSize = Params.sq_off.array + Params.sq_entries * sizeof(unsigned);
+  CQRingSize =
+      Params.cq_off.cqes + Params.cq_entries * sizeof(struct io_uring_cqe);
+  bool SingleMMap = Params.features & IORING_FEAT_SINGLE_MMAP;
+  if (SingleMMap)
+    SQRingSize = CQRingSize = std::max(SQRingSize, CQRingSize);
+
+  SQRing = mmap(nullptr, SQRingSize, PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_POPULATE, RingFD, IORING_OFF_SQ_RING);
+  if (SQRing == MAP_FAILED) {
+    SQRing = nullptr;
+    Unmap();
+    Exception::ThrowSystemError("mmap()");
+  }
+
+  if (SingleMMap) {
+    CQRing = SQRing;
+  } else {
+    CQRing = mmap(nullptr, CQRingSize, PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_POPULATE, RingFD, IORING_OFF_CQ_RING);
+    if (CQRing == MAP_FAILED) {
+      CQRing = nullptr;
+      Unmap();
+      Exception::ThrowSystemError("mmap()");
+    }
+  }
+
+  SQEsSize = Params.sq_entries * sizeof(struct io_uring_sqe);
+  void *SQEsPtr = mmap(nullptr, SQEsSize, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, RingFD, IORING_OFF_SQES);
+  if (SQEsPtr == MAP_FAILED) {
+    Unmap();
+    Exception::ThrowSystemError("mmap()");
+  }
+  SQEs = static_cast<struct io_uring_sqe *>(SQEsPtr);
+
+  SQHead = RingPtr<unsigned>(SQRing, Params.sq_off.head);
+  SQTail = RingPtr<unsigned>(SQRing, Params.sq_off.tail);
+  SQArray = RingPtr<unsigned>(SQRing, Params.sq_off.array);
+  SQMask = *RingPtr<unsigned>(SQRing, Params.sq_off.ring_mask);
+  SQEntries = *RingPtr<unsigned>(SQRing, Params.sq_off.ring_entries);
+  CQHead = RingPtr<unsigned>(CQRing, Params.cq_off.head);
+  CQTail = RingPtr<unsigned>(CQRing, Params.cq_off.tail);
+  CQMask = *RingPtr<unsigned>(CQRing, Params.cq_off.ring_mask);
+  CQEs = RingPtr<struct io_uring_cqe>(CQRing, Params.cq_off.cqes);
+  LocalSQTail = *SQTail;
+}
+
+void IoUringBackend::Unmap() {
+  if (SQEs)
+    munmap(SQEs, SQEsSize);
+  if (CQRing && CQRing != SQRing)
+    munmap(CQRing, CQRingSize);
+  if (SQRing)
+    munmap(SQRing, SQRingSize);
+  SQEs = nullptr;
+  SQRing = CQRing = nullptr;
+  if (RingFD >= 0)
+    close(RingFD);
+  RingFD = -1;
+}
+
+struct io_uring_sqe *IoUringBackend::GetSQE() {
+  if (LocalSQTail - __atomic_load_n(SQHead, __ATOMIC_ACQUIRE) >= SQEntries) {
+    // Submission queue is full, hand the queued requests to the kernel
+    Enter(0);
+    if (LocalSQTail - __atomic_load_n(SQHead, __ATOMIC_ACQUIRE) >= SQEntries)
+      Exception::ThrowSystemError(EBUSY, "io_uring_enter()");
+  }
+  unsigned Idx = LocalSQTail & SQMask;
+  struct io_uring_sqe *SQE = &SQEs[Idx];
+  memset(SQE, 0, sizeof(*SQE));
+  SQArray[Idx] = Idx;
+  LocalSQTail++;
+  return SQE;
+}
+
+void IoUringBackend::QueuePoll(int FD, Registration &R) {
+  R.Generation = NextGeneration++ & GenerationMask;
+  R.Armed = true;
+  auto *SQE = GetSQE();
+  SQE->opcode = IORING_OP_POLL_ADD;
+  SQE->fd = FD;
+  // poll(2) flags share their values with the kernel poll mask
+  SQE->poll32_events = static_cast<uint16_t>(R.Events);
+  SQE->user_data = ToUserData(FD, R.Generation);
+}
+
+void IoUringBackend::QueuePollRemove(int FD, const Registration &R) {
+  auto *SQE = GetSQE();
+  SQE->opcode = IORING_OP_POLL_REMOVE;
+  SQE->fd = -1;
+  SQE->addr = ToUserData(FD, R.Generation);
+  SQE->user_data = PollRemoveUserData;
+}
+
+void IoUringBackend::QueueTimeout(int TimeoutMSec) {
+  Timeout.tv_sec = TimeoutMSec / 1000;
+  Timeout.tv_nsec = (TimeoutMSec % 1000) * 1000000L;
+  auto *SQE = GetSQE();
+  SQE->opcode = IORING_OP_TIMEOUT;
+  SQE->fd = -1;
+  SQE->addr = reinterpret_cast<uint64_t>(&Timeout);
+  SQE->len = 1;
+  // Also complete as soon as any other request does, so the timeout never
+  // outlives the wait it was queued for
+  SQE->off = 1;
+  SQE->user_data = TimeoutUserData;
+}
+
+void IoUringBackend::QueueIO(IORequest *Req, struct io_uring_sqe *SQE) {
+  SQE->fd = Req->FD;
+  SQE->user_data = reinterpret_cast<uint64_t>(Req);
+  Req->Prev = nullptr;
+  Req->Next = InFlightIO;
+  if (InFlightIO)
+    InFlightIO->Prev = Req;
+  InFlightIO = Req;
+}
+
+bool IoUringBackend::SupportsIO() const { return true; }
+
+void IoUringBackend::SubmitRecv(IORequest *Req, char *Buf, std::size_t Size) {
+  auto *SQE = GetSQE();
+  SQE->opcode = IORING_OP_RECV;
+  SQE->addr = reinterpret_cast<uint64_t>(Buf);
+  SQE->len = static_cast<uint32_t>(
+      std::min<std::size_t>(Size, std::numeric_limits<int>::max()));
+  QueueIO(Req, SQE);
+}
+
+void IoUringBackend::SubmitSend(IORequest *Req) {
+  auto *SQE = GetSQE();
+  SQE->opcode = IORING_OP_SENDMSG;
+  SQE->addr = reinterpret_cast<uint64_t>(&Req->Msg);
+  SQE->len = 1;
+  SQE->msg_flags = MSG_NOSIGNAL;
+  QueueIO(Req, SQE);
+}
+
+void IoUringBackend::Cancel(IORequest *Req) {
+  auto *SQE = GetSQE();
+  SQE->opcode = IORING_OP_ASYNC_CANCEL;
+  SQE->fd = -1;
+  SQE->addr = reinterpret_cast<uint64_t>(Req);
+  SQE->user_data = CancelUserData;
+}
+
+void IoUringBackend::TakeCompleted(std::vector<IORequest *> &Done) {
+  Done.insert(Done.end(), Completed.begin(), Completed.end());
+  Completed.clear();
+}
+
+void IoUringBackend::DrainIO(std::vector<IORequest *> &Done) {
+  for (auto *Req = InFlightIO; Req; Req = Req->Next)
+    Cancel(Req);
+  std::vector<PolledEvent> Ready;
+  while (InFlightIO) {
+    Enter(1);
+    Reap(Ready);
+  }
+  TakeCompleted(Done);
+}
+
+int IoUringBackend::Enter(unsigned MinComplete) {
+  __atomic_store_n(SQTail, LocalSQTail, __ATOMIC_RELEASE);
+  unsigned ToSubmit = LocalSQTail - __atomic_load_n(SQHead, __ATOMIC_ACQUIRE);
+  if (ToSubmit == 0 && MinComplete == 0)
+    return 0;
+  unsigned Flags = MinComplete ? IORING_ENTER_GETEVENTS : 0;
+  int Status = static_cast<int>(syscall(__NR_io_uring_enter, RingFD, ToSubmit,
+                                        MinComplete, Flags, nullptr, 0));
+  if (Status < 0) {
+    if (errno == EINTR)
+      return -1;
+    // Completion queue backpressure is resolved by reaping what's there
+    if (errno == EBUSY || errno == EAGAIN)
+      return 0;
+    Exception::ThrowSystemError("io_uring_enter()");
+  }
+  return Status;
+}
+
+void IoUringBackend::Reap(std::vector<PolledEvent> &Ready) {
+  unsigned Head = *CQHead;
+  unsigned Tail = __atomic_load_n(CQTail, __ATOMIC_ACQUIRE);
+  for (; Head != Tail; Head++) {
+    const auto &CQE = CQEs[Head & CQMask];
+    if (CQE.user_data == TimeoutUserData ||
+        CQE.user_data == PollRemoveUserData ||
+        CQE.user_data == CancelUserData)
+      continue;
+
+    if (!(CQE.user_data & PollUserDataFlag)) {
+      auto *Req = reinterpret_cast<IORequest *>(CQE.user_data);
+      Req->Result = CQE.res;
+      if (Req->Prev)
+        Req->Prev->Next = Req->Next;
+      else
+        InFlightIO = Req->Next;
+      if (Req->Next)
+        Req->Next->Prev = Req->Prev;
+      Completed.push_back(Req);
+      continue;
+    }
+
+    int FD = UserDataFD(CQE.user_data);
+    auto It = Registrations.find(FD);
+    // Completions of removed or replaced poll requests
+    if (It == Registrations.end() ||
+        It->second.Generation != UserDataGeneration(CQE.user_data))
+      continue;
+
+    auto &R = It->second;
+    R.Armed = false;
+    short Events = CQE.res < 0 ? POLLERR : static_cast<short>(CQE.res);
+    Ready.push_back({FD, Events});
+    if (!(R.Flags & OneShot))
+      RearmFDs.push_back(FD);
+  }
+  __atomic_store_n(CQHead, Head, __ATOMIC_RELEASE);
+}
+
+void IoUringBackend::Add(int FD, short Events, int Flags) {
+  auto &R = Registrations[FD];
+  R = {Events, Flags, 0, false};
+  QueuePoll(FD, R);
+}
+
+void IoUringBackend::Modify(int FD, short Events, int Flags) {
+  auto It = Registrations.find(FD);
+  if (It == Registrations.end()) {
+    Add(FD, Events, Flags);
+    return;
+  }
+  auto &R = It->second;
+  if (R.Armed)
+    QueuePollRemove(FD, R);
+  R.Events = Events;
+  R.Flags = Flags;
+  QueuePoll(FD, R);
+}
+
+void IoUringBackend::Remove(int FD) {
+  auto It = Registrations.find(FD);
+  if (It == Registrations.end())
+    return;
+  if (It->second.Armed)
+    QueuePollRemove(FD, It->second);
+  Registrations.erase(It);
+}
+
+int IoUringBackend::Wait(int TimeoutMSec, std::vector<PolledEvent> &Ready) {
+  using namespace std::chrono;
+  Ready.clear();
+  if (Registrations.empty() && !InFlightIO) {
+    Enter(0);
+    return 0;
+  }
+
+  // Poll requests are one-shot, re-arm the ones that fired last time to get
+  // level-triggered behaviour
+  for (int FD : RearmFDs) {
+    auto It = Registrations.find(FD);
+    if (It != Registrations.end() && !It->second.Armed)
+      QueuePoll(FD, It->second);
+  }
+  RearmFDs.clear();
+
+  auto Deadline = steady_clock::now() + milliseconds(TimeoutMSec);
+  bool Interrupted = false;
+  while (!Interrupted) {
+    bool HasCompletions = *CQHead != __atomic_load_n(CQTail, __ATOMIC_ACQUIRE);
+    if (HasCompletions || TimeoutMSec == 0) {
+      Enter(0);
+    } else {
+      int Remaining = TimeoutMSec;
+      if (TimeoutMSec > 0) {
+        Remaining = static_cast<int>(
+            duration_cast<milliseconds>(Deadline - steady_clock::now())
+                .count());
+        if (Remaining <= 0)
+          break;
+        QueueTimeout(Remaining);
+      }
+      Interrupted = Enter(1) < 0;
+    }
+    Reap(Ready);
+    // Completions of cancelled requests and timeouts don't count as events
+    if (!Ready.empty() || !Completed.empty() || TimeoutMSec == 0 ||
+        HasCompletions)
+      break;
+    if (TimeoutMSec > 0 && steady_clock::now() >= Deadline)
+      break;
+  }
+  return static_cast<int>(Ready.size());
+}
+
+IoUringBackend::~IoUringBackend() { Unmap(); }
+} // namespace proxy
+#endif
@@ -0,0 +1,66 @@
+#include <Common/Globals.hpp>
+#include <Common/ProxyException.hpp>
+#include <Logging/Logger.hpp>
+#include <Net/Pipe.hpp>
+#include <Parallel/Thread.hpp>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace proxy {
+#ifdef __linux__
+Pipe::Pipe() {
+  if (pipe2(FDs, O_NONBLOCK | O_CLOEXEC) == -1)
+    Exception::ThrowSystemError("pipe2()");
+  // Larger pipes take more data per splice(), failing is harmless
+  fcntl(FDs[1], F_SETPIPE_SZ, static_cast<int>(Globals::SplicePipeSize));
+}
+
+ssize_t Pipe::SpliceFrom(SocketBase *Sock, std::size_t MaxSize) {
+  MaxSize = std::min(MaxSize, Globals::SplicePipeSize);
+  ssize_t Moved = splice(Sock->GetFD(), nullptr, FDs[1], nullptr, MaxSize,
+                         SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+  ThisThread::InterruptionPoint();
+  if (Moved < 0) {
+    if (errno == EAGAIN)
+      return -1;
+    Exception::ThrowSystemError("splice()");
+  }
+  Sock->UpdateLastIOTimePoint();
+  Size += Moved;
+  return Moved;
+}
+
+ssize_t Pipe::SpliceTo(SocketBase *Sock) {
+  ssize_t Moved = splice(FDs[0], nullptr, Sock->GetFD(), nullptr, Size,
+                         SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+  ThisThread::InterruptionPoint();
+  if (Moved < 0) {
+    if (errno == EAGAIN)
+      return -1;
+    Exception::ThrowSystemError("splice()");
+  }
+  Sock->UpdateLastIOTimePoint();
+  Size -= Moved;
+  return Moved;
+}
+#else
+Pipe::Pipe() { Exception::ThrowSystemError(ENOSYS, "splice()"); }
+
+ssize_t Pipe::SpliceFrom(SocketBase *, std::size_t) { return -1; }
+
+ssize_t Pipe::SpliceTo(SocketBase *) { return -1; }
+#endif
+
+std::size_t Pipe::GetSize() const { return Size; }
+
+bool Pipe::IsEmpty() const { return Size == 0; }
+
+Pipe::~Pipe() {
+  for (int FD : FDs)
+    if (FD != -1 && close(FD) != 0)
+      Log::DefaultLogger.LogError("close(pipe): ", strerror(errno));
+}
+} // namespace proxy
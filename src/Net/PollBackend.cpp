@@ -0,0 +1,66 @@
+#include <Common/ProxyException.hpp>
+#include <Net/PollBackend.hpp>
+#include <cerrno>
+
+namespace proxy {
+// Disarmed one-shot fds are stored negated so that poll() skips them
+static int DecodeFD(int FD) { return FD < 0 ? ~FD : FD; }
+
+void PollBackend::Add(int FD, short Events, int Flags) {
+  FDIndices[FD] = PollFDs.size();
+  PollFDs.push_back({.fd = FD, .events = Events, .revents = 0});
+  PollFlags.push_back(Flags);
+}
+
+void PollBackend::Modify(int FD, short Events, int Flags) {
+  auto It = FDIndices.find(FD);
+  if (It == FDIndices.end()) {
+    Add(FD, Events, Flags);
+    return;
+  }
+  auto &PFD = PollFDs[It->second];
+  PFD.fd = FD;
+  PFD.events = Events;
+  PollFlags[It->second] = Flags;
+}
+
+void PollBackend::Remove(int FD) {
+  auto It = FDIndices.find(FD);
+  if (It == FDIndices.end())
+    return;
+  std::size_t Idx = It->second;
+  FDIndices.erase(It);
+  std::size_t LastIdx = PollFDs.size() - 1;
+  if (Idx != LastIdx) {
+    PollFDs[Idx] = PollFDs[LastIdx];
+    PollFlags[Idx] = PollFlags[LastIdx];
+    FDIndices[DecodeFD(PollFDs[Idx].fd)] = Idx;
+  }
+  PollFDs.pop_back();
+  PollFlags.pop_back();
+}
+
+int PollBackend::Wait(int TimeoutMSec, std::vector<PolledEvent> &Ready) {
+  Ready.clear();
+  if (PollFDs.size() == 0)
+    return 0;
+  int Status = poll(PollFDs.data(), PollFDs.size(), TimeoutMSec);
+  if (Status == -1) {
+    if (errno == EINTR)
+      return 0;
+    Exception::ThrowSystemError("poll()");
+  }
+
+  auto ReadyNum = static_cast<std::size_t>(Status);
+  for (std::size_t i = 0; i < PollFDs.size() && Ready.size() < ReadyNum; i++) {
+    auto &PFD = PollFDs[i];
+    if (PFD.revents == 0)
+      continue;
+    Ready.push_back({PFD.fd, PFD.revents});
+    PFD.revents = 0;
+    if (PollFlags[i] & OneShot)
+      PFD.fd = ~PFD.fd;
+  }
+  return Ready.size();
+}
+} // namespace proxy
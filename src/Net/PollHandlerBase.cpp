@@ -0,0 +1,11 @@
+#include <Net/EventLoop.hpp>
+#include <Net/PollHandlerBase.hpp>
+
+namespace proxy {
+void PollHandlerBase::ArmTimer(Timer &T, TimeoutKind Kind,
+                               std::size_t TimeoutSec) {
+  if (T.IsArmed() && T.GetKind() == Kind)
+    return;
+  Loop->GetTimers()->Arm(&T, Kind, std::chrono::seconds(TimeoutSec));
+}
+} // namespace proxy
@@ -1,19 +1,53 @@
 #include <Common/ProxyException.hpp>
 #include <Common/Utils.hpp>
 #include <Logging/Logger.hpp>
+#include <Net/EpollBackend.hpp>
+#include <Net/IoUringBackend.hpp>
+#include <Net/PollBackend.hpp>
 #include <Net/Poller.hpp>
 #include <Parallel/LockGuard.hpp>
-#include <bitset>
 #include <cerrno>
 #include <cstring>
 #include <vector>
 
 namespace proxy {
-void Poller::Add(int Fd, short Events, PollHandlerBase *Handler) {
+static std::unique_ptr<PollerBackend> MakeBackend(PollerType Type) {
+  switch (Type) {
+  case PollerType::IoUring:
+#ifdef PROXY_HAS_IO_URING
+    try {
+      return std::make_unique<IoUringBackend>();
+    } catch (const std::system_error &E) {
+      Log::DefaultLogger.LogError("io_uring is not available (", E.what(),
+                                  "), falling back to epoll");
+    }
+#else
+    Log::DefaultLogger.LogError("io_uring is not supported, falling back to "
+                                "epoll");
+#endif
+    [[fallthrough]];
+  case PollerType::Epoll:
+#ifdef __linux__
+    return std::make_unique<EpollBackend>();
+#else
+    Log::DefaultLogger.LogError("epoll is not supported, falling back to poll");
+    break;
+#endif
+  case PollerType::Poll:
+    break;
+  }
+  return std::make_unique<PollBackend>();
+}
+
+Poller::Poller(PollerType Type, std::size_t InitialSize)
+    : Backend(MakeBackend(Type)), Clients(InitialSize) {}
+
+void Poller::Add(int Fd, short Events, PollHandlerBase *Handler, int Flags) {
   Log::DefaultLogger.LogDebug("Added FD=", Fd, " (",
                               Utils::EventsToString(Events), ") to poll pool");
-  PollUpdates.emplace_back(std::make_pair(PollUpdateType::AddClient,
-                                          PollClient(Fd, Events, 0, Handler)));
+  PollUpdates.emplace_back(
+      std::make_pair(PollUpdateType::AddClient,
+                     PollClient(Fd, Events, 0, Handler, Flags)));
 }
 
 void Poller::Remove(int Fd, short Events) {
@@ -27,35 +61,40 @@ void Poller::Remove(int Fd, short Events) {
 void Poller::AddClient(PollClient &Client) {
   int FD = Client.GetFD();
   short Events = Client.GetPollEvents();
-  auto *Handler = Client.GetHandler();
-  auto It = std::find_if(PollFDs.begin(), PollFDs.end(),
-                         [&](struct pollfd &PFD) { return PFD.fd == FD; });
-  if (It != PollFDs.end()) {
-    It->events |= Events;
-    auto &Cl = Clients[FD];
-    Cl.SetHandler(Handler);
-    Cl.SetPollEvents(Cl.GetPollEvents() | Events);
+  int Flags = Client.GetFlags();
+  auto It = Clients.find(FD);
+  if (It != Clients.end()) {
+    auto &Cl = It->second;
+    Cl.SetHandler(Client.GetHandler());
+    Events |= Cl.GetPollEvents();
+    if (Events != Cl.GetPollEvents() || Flags != Cl.GetFlags() ||
+        (Flags & OneShot))
+      Backend->Modify(FD, Events, Flags);
+    Cl.SetPollEvents(Events);
+    Cl.SetFlags(Flags);
     return;
   }
 
-  PollFDs.push_back({.fd = FD, .events = Events, .revents = 0});
-  Clients[FD] = Client;
+  Backend->Add(FD, Events, Flags);
+  Clients.emplace(FD, Client);
 }
 
 void Poller::RemoveClient(const PollClient &Client) {
   int FD = Client.GetFD();
-  short Events = Client.GetPollEvents();
-  for (auto It = PollFDs.begin(); It != PollFDs.end();) {
-    if (It->fd == FD) {
-      It->events &= ~Events;
-      // If no events will be polled for this Fd anymore, remove it completely
-      if (It->events == 0) {
-        It = PollFDs.erase(It);
-        Clients.erase(FD);
-        continue;
-      }
-    }
-    ++It;
+  auto It = Clients.find(FD);
+  if (It == Clients.end())
+    return;
+  auto &Cl = It->second;
+  short Events = Cl.GetPollEvents() & ~Client.GetPollEvents();
+  // If no events will be polled for this Fd anymore, remove it completely
+  if (Events == 0) {
+    Backend->Remove(FD);
+    Clients.erase(It);
+    return;
+  }
+  if (Events != Cl.GetPollEvents()) {
+    Backend->Modify(FD, Events, Cl.GetFlags());
+    Cl.SetPollEvents(Events);
   }
 }
 
@@ -70,44 +109,73 @@ void Poller::Flush() {
 }
 
 void Poller::ResetReceivedEvents() {
-  for (auto &PFD : PollFDs)
-    PFD.revents = 0;
-  for (auto &[FD, Client] : Clients)
-    Client.SetReceivedEvents(0);
+  for (auto &Event : ReadyEvents) {
+    auto It = Clients.find(Event.FD);
+    if (It != Clients.end())
+      It->second.SetReceivedEvents(0);
+  }
+  ReadyEvents.clear();
 }
 
 Poller::PolledClientsIterator Poller::begin() {
-  auto FirstPolled = std::find_if(PollFDs.begin(), PollFDs.end(),
-                                  [](auto &PFD) { return PFD.revents != 0; });
-  return PolledClientsIterator(Clients, FirstPolled, PollFDs.end());
+  return PolledClientsIterator(Clients, ReadyEvents.begin());
 }
 
 Poller::PolledClientsIterator Poller::end() {
-  return PolledClientsIterator(Clients, PollFDs.end());
+  return PolledClientsIterator(Clients, ReadyEvents.end());
 }
 
-std::size_t Poller::GetPolledClientsNum() const { return PollFDs.size(); }
+std::size_t Poller::GetPolledClientsNum() const { return Clients.size(); }
 
 int Poller::Poll(int TimeoutMSec) {
   Flush();
   ResetReceivedEvents();
-  if (PollFDs.size() == 0)
-    return 0;
-  int Status = poll(PollFDs.data(), PollFDs.size(), TimeoutMSec);
+  CompletedIO.clear();
+  int Status = Backend->Wait(TimeoutMSec, ReadyEvents);
+  Backend->TakeCompleted(CompletedIO);
   ThisThread::InterruptionPoint();
-  if (Status == -1)
-    Exception::ThrowSystemError("poll()");
 
   Log::DefaultLogger.LogDebug("Polled ", Status, " clients");
 
-  std::size_t PFDNum = 0;
-  for (auto &PFD : PollFDs) {
-    if (PFDNum++ == Status)
-      break;
-    auto &Cl = Clients[PFD.fd];
-    Cl.SetReceivedEvents(PFD.revents);
-    Cl.SetPollEvents(PFD.events);
+  for (auto &Event : ReadyEvents) {
+    auto It = Clients.find(Event.FD);
+    if (It != Clients.end())
+      It->second.SetReceivedEvents(Event.Events);
   }
   return Status;
 }
+
+bool Poller::SupportsIO() const { return Backend->SupportsIO(); }
+
+void Poller::SubmitRecv(IORequest *Req, int FD, char *Buf, std::size_t Size) {
+  Req->FD = FD;
+  Req->InFlight = true;
+  Backend->SubmitRecv(Req, Buf, Size);
+}
+
+void Poller::SubmitSend(IORequest *Req, int FD, struct iovec *IOVecs,
+                        std::size_t IOVecsNum) {
+  Req->FD = FD;
+  Req->Msg = {};
+  Req->Msg.msg_iov = IOVecs;
+  Req->Msg.msg_iovlen = IOVecsNum;
+  Req->InFlight = true;
+  Backend->SubmitSend(Req);
+}
+
+void Poller::CancelIO(IORequest *Req) {
+  if (Req->InFlight)
+    Backend->Cancel(Req);
+}
+
+const std::vector<IORequest *> &Poller::GetCompletedIO() const {
+  return CompletedIO;
+}
+
+void Poller::DrainIO() {
+  std::vector<IORequest *> Done;
+  Backend->DrainIO(Done);
+  for (auto *Req : Done)
+    Req->InFlight = false;
+}
 } // namespace proxy
@@ -1,17 +1,25 @@
 #include <Common/Globals.hpp>
 #include <Logging/Logger.hpp>
+#include <Net/EventLoop.hpp>
 #include <Net/Poller.hpp>
 #include <Net/RemoteHandler.hpp>
+#include <Net/RequestParser.hpp>
+#include <Net/RequestWriter.hpp>
+#include <Net/UpstreamPool.hpp>
 #include <Net/Server.hpp>
 #include <Parallel/LockGuard.hpp>
+#include <algorithm>
 #include <cassert>
+#include <cstring>
 #include <memory>
 #include <optional>
+#include <string_view>
+#include <sys/ioctl.h>
 
 namespace proxy {
 void RemoteHandler::Finish() {
   Terminate();
-  Srv->MarkDeadHandler(this);
+  Loop->MarkDeadHandler(this);
 }
 
 void RemoteHandler::Terminate() {
@@ -21,9 +29,19 @@ void RemoteHandler::Terminate() {
       return;
     _IsTerminated = true;
   }
-  if (CR) {
-    CR->SetComplete(CR->IsFinished());
-    CR->Finish();
+  if (IsResolving)
+    Srv->GetResolver()->Cancel(RemoteHost, this);
+  if (RemoteSock && Loop) {
+    Loop->GetPoller()->Remove(RemoteSock->GetFD());
+    Loop->GetPoller()->CancelIO(&RecvRequest);
+  }
+  // Records that weren't read up to EOF stay incomplete
+  if (CR)
+    FinishRecord(false);
+  if (EndToEndWriteHandler) {
+    auto *Handler = EndToEndWriteHandler;
+    EndToEndWriteHandler = nullptr;
+    Handler->HandleRemoteEndFinished(this);
   }
 }
 
@@ -35,59 +53,360 @@ std::optional<SocketBase::TimePointT> RemoteHandler::GetLastIOTimePoint() {
   return {};
 }
 
+void RemoteHandler::SetCacheRecord(CacheRecordPtr Record) {
+  // The record has to be finished even if the remote is never reached,
+  // otherwise its listeners would wait for it forever
+  CR = std::move(Record);
+}
+
 RemoteHandler::Mode RemoteHandler::GetRemoteMode() const { return _Mode; }
 
 void RemoteHandler::SetEndToEndBuffer(std::vector<char> *EndToEndBuffer) {
   this->EndToEndBuffer = EndToEndBuffer;
 }
 
+void RemoteHandler::SetEndToEndPipe(Pipe *EndToEndPipe) {
+  this->EndToEndPipe = EndToEndPipe;
+}
+
 void RemoteHandler::SetEndToEndWriteHandler(
     EndToEndHandlerBase *EndToEndWriteHandler) {
   this->EndToEndWriteHandler = EndToEndWriteHandler;
 }
 
-void RemoteHandler::ReadToCache() {
-  auto *C = Srv->GetCache();
-  CR = C->GetRecord(RemoteAddress);
+std::size_t RemoteHandler::GetNextBlockSize() {
+  int Available = 0;
+  if (ioctl(RemoteSock->GetFD(), FIONREAD, &Available) < 0)
+    Available = 0;
+  // Small responses usually arrive at once and take a single block of their
+  // size, larger ones get twice larger blocks each time
+  auto *LastBlock = CR->GetLastBlock();
+  std::size_t Size = Globals::DefaultCacheBlockSize;
+  if (LastBlock)
+    Size = std::max(2 * LastBlock->GetCapacity(),
+                    static_cast<std::size_t>(Available));
+  else if (Available > 0)
+    Size = Available;
+  auto Remaining = Framer.GetRemainingSize();
+  if (Remaining.has_value() && *Remaining > 0 && *Remaining < Size)
+    Size = *Remaining;
+  // The limit includes the block header
+  return std::min(Size, Srv->GetConfig().MaxCacheBlockSize -
+                            CacheBlock::HeaderSize);
+}
 
-  std::unique_ptr<CacheBlock> CB;
+CacheBlock *RemoteHandler::GetFreeBlock(CacheBlockPtr &NewBlock) {
+  // The last block is filled up before the next one is started
+  CacheBlock *Block = CR->GetLastBlock();
+  if (Block && Block->GetFreeSpace() > 0)
+    return Block;
   try {
-    CB.reset(new CacheBlock(Globals::DefaultCacheBlockSize));
+    NewBlock.reset(CacheBlock::Create(GetNextBlockSize()));
   } catch (const std::bad_alloc &BA) {
     Log::DefaultLogger.LogInfo(
         "[Remote #", RemoteSock->GetFD(),
         "] There is insufficient amount of RAM available, stopping "
         "cache downloading");
     Finish();
+    return nullptr;
+  }
+  return NewBlock.get();
+}
+
+void RemoteHandler::ReadToCache() {
+  if (Stale) {
+    ReadRevalidation();
     return;
   }
+  CacheBlockPtr NewBlock;
+  CacheBlock *Block = GetFreeBlock(NewBlock);
+  if (!Block)
+    return;
+  char *Free = Block->GetData() + Block->GetSize();
+  ssize_t ReadBytes = RemoteSock->Read(Free, Block->GetFreeSpace());
+  if (ReadBytes < 0)
+    return;
+  HandleCacheInput(Free, ReadBytes, std::move(NewBlock));
+}
 
-  std::size_t ReadBytes = RemoteSock->Read(CB->GetBytes());
+void RemoteHandler::SubmitRecv() {
+  CacheBlockPtr NewBlock;
+  CacheBlock *Block = GetFreeBlock(NewBlock);
+  if (!Block)
+    return;
+  char *Free = Block->GetData() + Block->GetSize();
+  std::size_t Size = Block->GetFreeSpace();
+  RecvBlock = std::move(NewBlock);
+  RecvRecord = CR;
+  Loop->GetPoller()->SubmitRecv(&RecvRequest, RemoteSock->GetFD(), Free,
+                                Size);
+}
 
+void RemoteHandler::HandleIO(IORequest *Req) {
+  CacheBlockPtr NewBlock = std::move(RecvBlock);
+  RecvRecord.Reset();
+  if (Req->Result < 0) {
+    if (CanRetry()) {
+      Retry();
+      return;
+    }
+    Exception::ThrowSystemError(-Req->Result, "recv()");
+  }
+  RemoteSock->UpdateLastIOTimePoint();
+  CacheBlock *Block = NewBlock ? NewBlock.get() : CR->GetLastBlock();
+  HandleCacheInput(Block->GetData() + Block->GetSize(), Req->Result,
+                   std::move(NewBlock));
+  // The response may be done, or the connection may be retried
+  if (!IsTerminated() && RemoteSock && HandledConnect && !RecvRequest.InFlight)
+    SubmitRecv();
+  if (Framer.HasHeaders())
+    ArmTimer(PhaseTimer, TimeoutKind::Idle, Globals::ClientTimeoutSec);
+}
+
+bool RemoteHandler::HasIOInFlight() const { return RecvRequest.InFlight; }
+
+void RemoteHandler::HandleCacheInput(char *Free, std::size_t ReadBytes,
+                                     CacheBlockPtr NewBlock) {
   Log::DefaultLogger.LogDebug("[Remote #", RemoteSock->GetFD(), "] Received ",
                               ReadBytes, " bytes");
 
   if (ReadBytes == 0) {
+    HandleEOF();
+    return;
+  }
+
+  std::size_t ResponseBytes = Framer.Feed(Free, ReadBytes);
+  ReceivedResponse = true;
+  bool Fits = true;
+  if (NewBlock) {
     Log::DefaultLogger.LogDebug("[Remote #", RemoteSock->GetFD(),
-                                "] Client terminated connection");
-    CR->Finish();
+                                "] Creating new cache block of ",
+                                NewBlock->GetCapacity(), " bytes");
+    NewBlock->Grow(ReadBytes);
+    Fits = CR->AppendBlock(NewBlock.release());
+  } else {
+    CR->GrowLastBlock(ReadBytes);
+  }
+  HandleCacheProgress(ResponseBytes == ReadBytes, Fits);
+}
+
+void RemoteHandler::HandleCacheProgress(bool IsClean, bool Fits) {
+  // The headers are parsed once, while the response is cached
+  if (!HasFreshness && Framer.HasHeaders()) {
+    CR->SetFreshness(Freshness::FromHeaders(
+        Framer.GetCacheHeaders(), Framer.GetStatusCode(), Freshness::Now(),
+        Srv->GetConfig().StaleWhileRevalidateSec));
+    HasFreshness = true;
+  }
+  if (Framer.IsDone()) {
+    FinishRecord(true);
+    ReleaseConnection(IsClean);
+    Finish();
+    return;
+  }
+  // Listeners get the rest of the response with a range request
+  if (!Fits) {
+    Log::DefaultLogger.LogInfo("[Remote #", RemoteSock->GetFD(),
+                               "] Response is too large to be cached");
     Finish();
+  }
+}
+
+void RemoteHandler::ReadRevalidation() {
+  std::size_t Offset = HeaderBuffer.size();
+  ssize_t ReadBytes = RemoteSock->ReadAppend(HeaderBuffer);
+  if (ReadBytes < 0)
+    return;
+  if (ReadBytes == 0) {
+    HandleEOF();
+    return;
+  }
+  std::size_t ResponseBytes =
+      Framer.Feed(HeaderBuffer.data() + Offset, ReadBytes);
+  ReceivedResponse = true;
+  if (!Framer.HasHeaders())
+    return;
+  bool IsClean = ResponseBytes == static_cast<std::size_t>(ReadBytes);
+
+  if (Framer.GetStatusCode() == 304) {
+    Log::DefaultLogger.LogDebug("[Remote #", RemoteSock->GetFD(), "] ",
+                                RemoteAddress, " is not modified");
+    CR->SetFreshness(Freshness::FromNotModified(Stale->GetFreshness(),
+                                                Framer.GetCacheHeaders(),
+                                                Freshness::Now()));
+    HasFreshness = true;
+    CR->ServeFrom(Stale.Get());
+    Stale = nullptr;
+    // The 304 response has no body
+    FinishRecord(true);
+    ReleaseConnection(IsClean && Framer.IsDone());
+    Finish();
+    return;
+  }
+
+  // A new response replaces the stale one and is cached as usual
+  Stale = nullptr;
+  CacheBlockPtr Block;
+  try {
+    Block.reset(
+        CacheBlock::Create(std::max(HeaderBuffer.size(), GetNextBlockSize())));
+  } catch (const std::bad_alloc &BA) {
+    Log::DefaultLogger.LogInfo(
+        "[Remote #", RemoteSock->GetFD(),
+        "] There is insufficient amount of RAM available, stopping "
+        "cache downloading");
+    Finish();
+    return;
+  }
+  memcpy(Block->GetData(), HeaderBuffer.data(), HeaderBuffer.size());
+  Block->Grow(HeaderBuffer.size());
+  std::vector<char>().swap(HeaderBuffer);
+  bool Fits = CR->AppendBlock(Block.release());
+  HandleCacheProgress(IsClean, Fits);
+}
+
+void RemoteHandler::FinishRecord(bool IsComplete) {
+  CR->SetComplete(IsComplete);
+  CR->Finish();
+  CR = nullptr;
+}
+
+void RemoteHandler::HandleEOF() {
+  Log::DefaultLogger.LogDebug("[Remote #", RemoteSock->GetFD(),
+                              "] Remote terminated connection");
+  if (CanRetry()) {
+    Retry();
+    return;
+  }
+  if (_Mode == Mode::Cache) {
+    // Truncated responses are resumed with range requests
+    FinishRecord(Framer.IsDone() || Framer.IsDelimitedByClose());
+  }
+  Finish();
+}
+
+bool RemoteHandler::CanRetry() const {
+  // A pooled connection may be closed by the origin right before it's
+  // reused, the request is safe to resend if nothing came back
+  return IsReused && !ReceivedResponse;
+}
+
+void RemoteHandler::Retry() {
+  Log::DefaultLogger.LogDebug("[Remote #", RemoteSock->GetFD(),
+                              "] Idle connection was closed, reconnecting");
+  Loop->GetPoller()->Remove(RemoteSock->GetFD());
+  delete RemoteSock;
+  RemoteSock = nullptr;
+  IsReused = false;
+  HandledConnect = false;
+  // Resolving has its own timeout
+  PhaseTimer.Cancel();
+  SentRequestBytes = 0;
+  Framer.Reset(IsHeadRequest());
+  HeaderBuffer.clear();
+  ResolveAndConnect();
+}
+
+void RemoteHandler::ReleaseConnection(bool IsClean) {
+  if (!IsClean || !Framer.IsKeepAlive() || !RemoteSock)
     return;
+  Loop->GetPoller()->Remove(RemoteSock->GetFD());
+  Loop->GetUpstreamPool()->Release(
+      UpstreamPool::MakeKey(RemoteHost, RemotePort), RemoteSock);
+  RemoteSock = nullptr;
+}
+
+static bool IsClientValidator(std::string_view Name) {
+  return Utils::EqualsIgnoreCase(Name, "If-None-Match") ||
+         Utils::EqualsIgnoreCase(Name, "If-Modified-Since");
+}
+
+bool RemoteHandler::MakeConditionalRequest() {
+  RequestParser Parser;
+  if (Parser.Parse(RequestBytes->data(), RequestBytes->size()) !=
+          RequestParser::Status::Complete ||
+      Parser.GetMethod() != "GET")
+    return false;
+
+  // The validators of the client are replaced with the stored ones
+  auto Request = std::make_shared<std::vector<char>>();
+  RequestWriter Writer(*Request,
+                       RequestBytes->size() + Globals::UpstreamRequestHeadroom);
+  Writer.WriteRequestLine(Parser.GetMethod(), Parser.GetURI(),
+                          Parser.GetVersionMajor(), Parser.GetVersionMinor());
+  for (std::size_t i = 0; i < Parser.GetHeadersNum(); i++) {
+    auto Header = Parser.GetHeader(i);
+    if (!IsClientValidator(Header.Name))
+      Writer.WriteHeader(Header.Name, Header.Value);
   }
+  const auto &Fresh = Stale->GetFreshness();
+  if (!Fresh.ETag.empty())
+    Writer.WriteHeader("If-None-Match", Fresh.ETag);
+  if (!Fresh.LastModified.empty())
+    Writer.WriteHeader("If-Modified-Since", Fresh.LastModified);
+  Writer.EndHead();
+  std::size_t HeaderSize = Parser.GetHeaderSize();
+  Writer.WriteBody(std::string_view(RequestBytes->data() + HeaderSize,
+                                    RequestBytes->size() - HeaderSize));
+  RequestBytes = std::move(Request);
+  Log::DefaultLogger.LogDebug("[Remote] Revalidating ", RemoteAddress);
+  return true;
+}
+
+bool RemoteHandler::IsHeadRequest() const {
+  return ResponseFramer::IsHeadRequestBytes(RequestBytes->data(),
+                                            RequestBytes->size());
+}
+
+bool RemoteHandler::IsIdempotentRequest() const {
+  std::string_view Line(RequestBytes->data(), RequestBytes->size());
+  for (std::string_view Method : {"GET ", "HEAD ", "OPTIONS ", "TRACE ",
+                                  "PUT ", "DELETE "})
+    if (Line.substr(0, Method.size()) == Method)
+      return true;
+  return false;
+}
 
+ssize_t RemoteHandler::SpliceEndToEnd(uint64_t Size) {
+  try {
+    return EndToEndPipe->SpliceFrom(RemoteSock, Size);
+  } catch (const std::system_error &E) {
+    if (E.code().value() != EINVAL)
+      throw;
+  }
   Log::DefaultLogger.LogDebug("[Remote #", RemoteSock->GetFD(),
-                              "] Creating new cache block");
-  CR->AppendBlock(CB.release());
+                              "] splice() isn't supported, copying");
+  EndToEndPipe = nullptr;
+  return RemoteSock->ReadAppend(*EndToEndBuffer);
 }
 
 void RemoteHandler::ReadEndToEnd() {
   EndToEndBuffer->clear();
-  RemoteSock->ReadAppend(*EndToEndBuffer);
+  // The headers have to be parsed, the body is passed through the pipe
+  uint64_t PassThroughSize = Framer.GetPassThroughSize();
+  bool Splice = EndToEndPipe && PassThroughSize > 0;
+  ssize_t ReadBytes = Splice ? SpliceEndToEnd(PassThroughSize)
+                             : RemoteSock->ReadAppend(*EndToEndBuffer);
+  if (ReadBytes < 0)
+    return;
+  if (ReadBytes == 0 && CanRetry()) {
+    Retry();
+    return;
+  }
   Log::DefaultLogger.LogInfo("[Remote #", RemoteSock->GetFD(), "] Received ",
-                             EndToEndBuffer->size(),
-                             " bytes in end-to-end mode");
-  EndToEndWriteHandler->HandleRemoteEndInput(this, EndToEndBuffer);
+                             ReadBytes, " bytes in end-to-end mode");
+  std::size_t ResponseBytes = ReadBytes;
+  if (!EndToEndBuffer->empty())
+    ResponseBytes = Framer.Feed(EndToEndBuffer->data(), EndToEndBuffer->size());
+  else
+    Framer.Skip(ReadBytes);
+  ReceivedResponse = true;
   Unregister();
+  EndToEndWriteHandler->HandleRemoteEndInput(this, EndToEndBuffer);
+  if (ReadBytes > 0 && Framer.IsDone()) {
+    ReleaseConnection(ResponseBytes == static_cast<std::size_t>(ReadBytes));
+    Finish();
+  }
 }
 
 void RemoteHandler::HandleRemoteInput(const PollClient &Client) {
@@ -95,13 +414,52 @@ void RemoteHandler::HandleRemoteInput(const PollClient &Client) {
     ReadToCache();
   else if (_Mode == Mode::EndToEnd)
     ReadEndToEnd();
+  if (Framer.HasHeaders())
+    ArmTimer(PhaseTimer, TimeoutKind::Idle, Globals::ClientTimeoutSec);
+}
+
+void RemoteHandler::Register() {
+  if (!IsTerminated() && RemoteSock)
+    Loop->GetPoller()->Add(RemoteSock->GetFD(), POLLIN, this);
 }
 
-void RemoteHandler::Unregister() { Poll.Remove(RemoteSock->GetFD(), POLLIN); }
+void RemoteHandler::Unregister() {
+  if (RemoteSock)
+    Loop->GetPoller()->Remove(RemoteSock->GetFD(), POLLIN);
+}
 
 void RemoteHandler::ConnectTo(const std::string &Host, uint16_t Port) {
-  RemoteSock = Socket::ConnectTo(Host, Port);
-  Poll.Add(RemoteSock->GetFD(), POLLOUT, this);
+  RemoteHost = Host;
+  RemotePort = Port;
+}
+
+void RemoteHandler::Connect(const ResolvedHost &Host) {
+  if (Host.Addresses.empty())
+    throw std::runtime_error("Failed to resolve " + RemoteHost + ": " +
+                             Host.Error);
+  RemoteSock = Socket::ConnectTo(Host.Addresses.front(), RemotePort);
+  Loop->GetPoller()->Add(RemoteSock->GetFD(), GetPollEvents(), this);
+  ArmTimer(PhaseTimer, TimeoutKind::Connect, Globals::ConnectTimeoutSec);
+}
+
+void RemoteHandler::OnResolved(ResolvedHostPtr Host) {
+  {
+    LockGuard<MutexLocker> G(&ResolvedMutex);
+    Resolved = std::move(Host);
+  }
+  Loop->Wakeup(this);
+}
+
+void RemoteHandler::HandleWakeup() {
+  ResolvedHostPtr Host;
+  {
+    LockGuard<MutexLocker> G(&ResolvedMutex);
+    Host = std::move(Resolved);
+  }
+  if (!Host || !IsResolving || IsTerminated())
+    return;
+  IsResolving = false;
+  Connect(*Host);
 }
 
 void RemoteHandler::HandleConnect(const PollClient &Client) {
@@ -111,59 +469,115 @@ void RemoteHandler::HandleConnect(const PollClient &Client) {
                           &SockErrorLen);
   if (Status < 0)
     Exception::ThrowSystemError("getsockopt()");
+  if (SockError != 0)
+    Exception::ThrowSystemError(SockError, "connect()");
   HandledConnect = true;
-  Poll.Remove(Client.GetFD(), POLLOUT);
-  RemoteSock->Write(RequestBytes);
+  ArmTimer(PhaseTimer, TimeoutKind::HeaderRead,
+           Globals::UpstreamHeaderTimeoutSec);
+  if (IsCompletionBased)
+    SubmitRecv();
 }
 
-bool RemoteHandler::IsTerminated() {
-  LockGuard<MutexLocker> G(&IsTerminatedMutex);
-  return _IsTerminated;
+short RemoteHandler::GetPollEvents() const {
+  // Only the connect and the request are waited for then
+  return IsCompletionBased ? POLLOUT : POLLIN | POLLOUT;
 }
 
-void RemoteHandler::RemoteRoutine() {
-  ThisThread::BlockInterruptionSignals();
-  int FD = RemoteSock->GetFD();
-  Poll.Add(RemoteSock->GetFD(), POLLIN, this);
-  while (!IsTerminated()) {
-    Log::DefaultLogger.LogDebug("[Remote #", FD, "] Waiting for events...");
-    int NumPolled = Poll.Poll(Globals::ClientTimeoutMSec);
-    if (NumPolled == 0) {
-      Finish();
+void RemoteHandler::WriteRequest() {
+  ssize_t WrittenBytes;
+  try {
+    WrittenBytes = RemoteSock->Write(RequestBytes->data() + SentRequestBytes,
+                                     RequestBytes->size() - SentRequestBytes);
+  } catch (const std::system_error &E) {
+    if (!CanRetry())
+      throw;
+    // The pending recv sees the closed connection and retries
+    if (RecvRequest.InFlight) {
+      Loop->GetPoller()->Remove(RemoteSock->GetFD(), POLLOUT);
       return;
     }
+    Retry();
+    return;
+  }
+  if (WrittenBytes < 0)
+    return;
+  SentRequestBytes += WrittenBytes;
+  if (SentRequestBytes == RequestBytes->size())
+    Loop->GetPoller()->Remove(RemoteSock->GetFD(), POLLOUT);
+}
 
-    for (auto &Client : Poll) {
-      Log::DefaultLogger.LogDebug(
-          "FD ", Client.GetFD(), " received ",
-          Utils::EventsToString(Client.GetReceivedEvents()));
-      try {
-        Handle(&Poll, &Client);
-      } catch (std::system_error &E) {
-        Log::DefaultLogger.LogFatal("[Remote #", Client.GetFD(),
-                                    "]: ", E.what());
-        Finish();
-      }
-      ThisThread::InterruptionPoint();
-    }
+bool RemoteHandler::IsTerminated() {
+  LockGuard<MutexLocker> G(&IsTerminatedMutex);
+  return _IsTerminated;
+}
+
+void RemoteHandler::Start() {
+  if (CR) {
+    Stale = CR->TakeStale();
+    if (Stale && !MakeConditionalRequest())
+      Stale = nullptr;
   }
+  // Revalidation responses are read into a separate buffer first
+  IsCompletionBased =
+      _Mode == Mode::Cache && !Stale && Loop->GetPoller()->SupportsIO();
 
-  Log::DefaultLogger.LogDebug("[Remote #", FD, "] Terminating");
+  // Only the requests that are safe to resend may go over pooled
+  // connections, those get retried if the origin drops them
+  if (!IsIdempotentRequest()) {
+    ResolveAndConnect();
+    return;
+  }
+  auto *Sock = Loop->GetUpstreamPool()->Acquire(
+      UpstreamPool::MakeKey(RemoteHost, RemotePort));
+  if (Sock) {
+    RemoteSock = Sock;
+    IsReused = true;
+    HandledConnect = true;
+    Loop->GetPoller()->Add(RemoteSock->GetFD(), GetPollEvents(), this);
+    ArmTimer(PhaseTimer, TimeoutKind::HeaderRead,
+             Globals::UpstreamHeaderTimeoutSec);
+    if (IsCompletionBased)
+      SubmitRecv();
+    return;
+  }
+  ResolveAndConnect();
 }
 
-void RemoteHandler::Start() { RemoteThread.StartThread(); }
+void RemoteHandler::ResolveAndConnect() {
+  auto Host = Srv->GetResolver()->Resolve(RemoteHost, this);
+  if (Host) {
+    Connect(*Host);
+    return;
+  }
+  Log::DefaultLogger.LogDebug("[Remote] Resolving ", RemoteHost);
+  IsResolving = true;
+}
 
 void RemoteHandler::Handle(Poller *P, PollClient *Client) {
   short Events = Client->GetReceivedEvents();
-  if (Events & (POLLHUP | POLLNVAL | POLLERR)) {
+  // Pending input is read first, EOF is detected by the read
+  if ((Events & (POLLNVAL | POLLERR)) ||
+      ((Events & POLLHUP) && !(Events & POLLIN))) {
+    // The pending recv reports the error or EOF along with the input
+    // received before it
+    if (RecvRequest.InFlight) {
+      Loop->GetPoller()->Remove(RemoteSock->GetFD());
+      return;
+    }
     Log::DefaultLogger.LogDebug("[Remote #", RemoteSock->GetFD(),
                                 "] Remote terminated connection");
-    Finish();
+    if (CanRetry())
+      Retry();
+    else
+      Finish();
     return;
   }
 
-  if (Events & POLLOUT)
-    HandleConnect(*Client);
+  if (Events & POLLOUT) {
+    if (!HandledConnect)
+      HandleConnect(*Client);
+    WriteRequest();
+  }
 
   if (Events & POLLIN)
     HandleRemoteInput(*Client);
@@ -171,8 +585,6 @@ void RemoteHandler::Handle(Poller *P, PollClient *Client) {
 
 RemoteHandler::~RemoteHandler() {
   Terminate();
-  RemoteThread.Interrupt();
-  RemoteThread.Join();
   if (RemoteSock)
     delete RemoteSock;
 }
@@ -0,0 +1,350 @@
+#include <Common/Globals.hpp>
+#include <Common/Utils.hpp>
+#include <Net/HttpScan.hpp>
+#include <Net/RequestParser.hpp>
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <limits>
+
+namespace proxy {
+// RFC 7230 token characters
+static bool IsTokenChar(unsigned char C) {
+  if (std::isalnum(C))
+    return true;
+  return C != 0 && strchr("!#$%&'*+-.^_`|~", C) != nullptr;
+}
+
+static bool IsToken(const char *Begin, const char *End) {
+  if (Begin == End)
+    return false;
+  for (auto *P = Begin; P != End; P++)
+    if (!IsTokenChar(static_cast<unsigned char>(*P)))
+      return false;
+  return true;
+}
+
+static bool IsSpace(char C) { return C == ' ' || C == '\t'; }
+
+void RequestParser::Reset() {
+  _State = State::RequestLine;
+  Buf = nullptr;
+  Pos = 0;
+  LineStart = 0;
+  SectionStart = 0;
+  HeaderSize = 0;
+  ChunkRemaining = 0;
+  LineColon.reset();
+  LineCtl.reset();
+  Method = Span();
+  URI = Span();
+  VersionMajor = 0;
+  VersionMinor = 0;
+  Headers.clear();
+  ContentLength.reset();
+  HasTransferEncoding = false;
+  IsChunked = false;
+  Error = nullptr;
+}
+
+RequestParser::Status RequestParser::Fail(const char *Message) {
+  _State = State::Error;
+  Error = Message;
+  return Status::Error;
+}
+
+std::string_view RequestParser::View(Span S) const {
+  return std::string_view(Buf + S.Offset, S.Size);
+}
+
+bool RequestParser::ParseRequestLine(std::size_t Begin, std::size_t End) {
+  const char *Line = Buf + Begin;
+  const char *LineEnd = Buf + End;
+  auto *MethodEnd = static_cast<const char *>(memchr(Line, ' ', End - Begin));
+  if (!MethodEnd || !IsToken(Line, MethodEnd)) {
+    Error = "Malformed request method";
+    return false;
+  }
+  const char *URIBegin = MethodEnd + 1;
+  auto *URIEnd = static_cast<const char *>(
+      memchr(URIBegin, ' ', LineEnd - URIBegin));
+  if (!URIEnd || URIEnd == URIBegin) {
+    Error = "Malformed request target";
+    return false;
+  }
+  const char *Version = URIEnd + 1;
+  if (LineEnd - Version != 8 || memcmp(Version, "HTTP/", 5) != 0 ||
+      !std::isdigit(static_cast<unsigned char>(Version[5])) ||
+      Version[6] != '.' ||
+      !std::isdigit(static_cast<unsigned char>(Version[7]))) {
+    Error = "Malformed HTTP version";
+    return false;
+  }
+  Method = {Begin, static_cast<std::size_t>(MethodEnd - Line)};
+  URI = {static_cast<std::size_t>(URIBegin - Buf),
+         static_cast<std::size_t>(URIEnd - URIBegin)};
+  VersionMajor = Version[5] - '0';
+  VersionMinor = Version[7] - '0';
+  return true;
+}
+
+bool RequestParser::ParseHeader(std::size_t Begin, std::size_t End,
+                                std::optional<std::size_t> ColonPos) {
+  const char *Line = Buf + Begin;
+  const char *LineEnd = Buf + End;
+  // Folded lines are obsolete and may be rejected, RFC 7230 3.2.4
+  if (IsSpace(*Line)) {
+    Error = "Folded header line";
+    return false;
+  }
+  const char *Colon = ColonPos ? Buf + *ColonPos : nullptr;
+  if (!Colon || !IsToken(Line, Colon)) {
+    Error = "Malformed header name";
+    return false;
+  }
+  if (Headers.size() == Globals::MaxRequestHeadersNum) {
+    Error = "Too many request headers";
+    return false;
+  }
+  const char *Value = Colon + 1;
+  const char *ValueEnd = LineEnd;
+  while (Value != ValueEnd && IsSpace(*Value))
+    Value++;
+  while (ValueEnd != Value && IsSpace(ValueEnd[-1]))
+    ValueEnd--;
+
+  HeaderSpan Header{{Begin, static_cast<std::size_t>(Colon - Line)},
+                    {static_cast<std::size_t>(Value - Buf),
+                     static_cast<std::size_t>(ValueEnd - Value)}};
+  Headers.push_back(Header);
+
+  auto Name = View(Header.Name);
+  auto ValueView = View(Header.Value);
+  if (Utils::EqualsIgnoreCase(Name, "Transfer-Encoding")) {
+    // Codings of all the headers form one list, the last one is applied last
+    auto Comma = ValueView.rfind(',');
+    auto Coding = ValueView.substr(Comma == std::string_view::npos ? 0
+                                                                   : Comma + 1);
+    while (!Coding.empty() && IsSpace(Coding.front()))
+      Coding.remove_prefix(1);
+    HasTransferEncoding = true;
+    IsChunked = Utils::EqualsIgnoreCase(Coding, "chunked");
+  } else if (Utils::EqualsIgnoreCase(Name, "Content-Length")) {
+    if (ValueView.empty()) {
+      Error = "Invalid Content-Length";
+      return false;
+    }
+    uint64_t Length = 0;
+    for (char C : ValueView) {
+      if (!std::isdigit(static_cast<unsigned char>(C)) ||
+          Length > (std::numeric_limits<uint64_t>::max() - 9) / 10) {
+        Error = "Invalid Content-Length";
+        return false;
+      }
+      Length = Length * 10 + (C - '0');
+    }
+    // Differing lengths make the framing ambiguous, RFC 7230 3.3.2
+    if (ContentLength.has_value() && *ContentLength != Length) {
+      Error = "Conflicting Content-Length headers";
+      return false;
+    }
+    ContentLength = Length;
+  }
+  return true;
+}
+
+bool RequestParser::FinishHead() {
+  HeaderSize = Pos;
+  if (!HasTransferEncoding) {
+    _State = State::Done;
+    return true;
+  }
+  // The origin could frame such a request by the other header, letting a
+  // request be smuggled in the body, RFC 7230 3.3.3
+  if (ContentLength.has_value()) {
+    Error = "Both Transfer-Encoding and Content-Length are present";
+    return false;
+  }
+  // The body length can't be determined otherwise
+  if (!IsChunked) {
+    Error = "Unsupported transfer coding";
+    return false;
+  }
+  _State = State::ChunkSize;
+  SectionStart = Pos;
+  return true;
+}
+
+bool RequestParser::ParseChunkSize(std::size_t Begin, std::size_t End) {
+  const char *Line = Buf + Begin;
+  const char *LineEnd = Buf + End;
+  uint64_t Size = 0;
+  const char *P = Line;
+  for (; P != LineEnd && std::isxdigit(static_cast<unsigned char>(*P)); P++) {
+    if (Size > std::numeric_limits<uint64_t>::max() >> 4) {
+      Error = "Chunk size is too large";
+      return false;
+    }
+    Size = Size * 16 + (std::isdigit(static_cast<unsigned char>(*P))
+                            ? *P - '0'
+                            : std::tolower(static_cast<unsigned char>(*P)) -
+                                  'a' + 10);
+  }
+  // Chunk extensions are passed on as they are
+  while (P != LineEnd && IsSpace(*P))
+    P++;
+  if (P == Line || (P != LineEnd && *P != ';')) {
+    Error = "Malformed chunk size";
+    return false;
+  }
+  ChunkRemaining = Size;
+  return true;
+}
+
+const char *RequestParser::GetSizeError() const {
+  switch (_State) {
+  case State::RequestLine:
+  case State::Headers:
+    return "Request headers are too large";
+  case State::Trailers:
+    return "Request trailers are too large";
+  default:
+    return "Chunk line is too large";
+  }
+}
+
+RequestParser::Status RequestParser::Parse(const char *Bytes,
+                                           std::size_t Size) {
+  Buf = Bytes;
+  if (_State == State::Done)
+    return Status::Complete;
+  if (_State == State::Error)
+    return Status::Error;
+
+  while (Pos < Size) {
+    if (_State == State::ChunkData) {
+      auto DataSize = std::min<uint64_t>(ChunkRemaining, Size - Pos);
+      Pos += DataSize;
+      ChunkRemaining -= DataSize;
+      if (ChunkRemaining == 0) {
+        _State = State::ChunkDataEnd;
+        LineStart = SectionStart = Pos;
+      }
+      continue;
+    }
+    // Colons and control characters are found along with the line end, the
+    // line is scanned once even if it comes in pieces
+    auto Scan = HttpScan::ScanLine(Bytes + Pos, Bytes + Size);
+    if (!LineColon && Scan.Colon)
+      LineColon = Scan.Colon - Bytes;
+    if (!LineCtl && Scan.Ctl)
+      LineCtl = Scan.Ctl - Bytes;
+    if (!Scan.LineEnd) {
+      Pos = Size;
+      break;
+    }
+    std::size_t Begin = LineStart;
+    std::size_t End = Scan.LineEnd - Bytes;
+    auto Colon = LineColon;
+    auto Ctl = LineCtl;
+    Pos = LineStart = End + 1;
+    LineColon.reset();
+    LineCtl.reset();
+    if (Pos - SectionStart > Globals::MaxRequestHeaderSize)
+      return Fail(GetSizeError());
+    bool HasCR = End > Begin && Bytes[End - 1] == '\r';
+    if (HasCR) {
+      End--;
+      if (Ctl == End)
+        Ctl.reset();
+    }
+    if (Ctl)
+      return Fail("Invalid character in request");
+
+    switch (_State) {
+    case State::RequestLine:
+      // Empty lines preceding the request are ignored, RFC 7230 3.5
+      if (End == Begin)
+        continue;
+      if (!ParseRequestLine(Begin, End))
+        return Fail(Error);
+      _State = State::Headers;
+      continue;
+
+    case State::Headers:
+      if (End != Begin) {
+        if (!ParseHeader(Begin, End, Colon))
+          return Fail(Error);
+        continue;
+      }
+      if (!FinishHead())
+        return Fail(Error);
+      if (_State == State::Done)
+        return Status::Complete;
+      continue;
+
+    default:
+      break;
+    }
+
+    // Bare LFs are tolerated in the head only, the body is forwarded as it
+    // is and has to be framed the same way by the origin
+    if (!HasCR)
+      return Fail("Chunk line doesn't end with CRLF");
+    if (_State == State::ChunkSize) {
+      if (!ParseChunkSize(Begin, End))
+        return Fail(Error);
+      _State = ChunkRemaining == 0 ? State::Trailers : State::ChunkData;
+      SectionStart = Pos;
+    } else if (_State == State::ChunkDataEnd) {
+      if (End != Begin)
+        return Fail("Chunk data is longer than its size");
+      _State = State::ChunkSize;
+      SectionStart = Pos;
+    } else if (End == Begin) {
+      _State = State::Done;
+      return Status::Complete;
+    } else if (!Colon || !IsToken(Bytes + Begin, Bytes + *Colon)) {
+      return Fail("Malformed trailer field");
+    }
+  }
+  if (_State != State::ChunkData &&
+      Pos - SectionStart > Globals::MaxRequestHeaderSize)
+    return Fail(GetSizeError());
+  return Status::Incomplete;
+}
+
+std::size_t RequestParser::GetHeaderSize() const {
+  return _State == State::Done ? HeaderSize : 0;
+}
+
+std::size_t RequestParser::GetRequestSize() const {
+  if (_State != State::Done)
+    return 0;
+  return IsChunked ? Pos : Pos + ContentLength.value_or(0);
+}
+
+const char *RequestParser::GetError() const { return Error; }
+
+std::string_view RequestParser::GetMethod() const { return View(Method); }
+
+std::string_view RequestParser::GetURI() const { return View(URI); }
+
+int RequestParser::GetVersionMajor() const { return VersionMajor; }
+
+int RequestParser::GetVersionMinor() const { return VersionMinor; }
+
+std::size_t RequestParser::GetHeadersNum() const { return Headers.size(); }
+
+RequestParser::Header RequestParser::GetHeader(std::size_t Idx) const {
+  return {View(Headers[Idx].Name), View(Headers[Idx].Value)};
+}
+
+std::optional<std::string_view>
+RequestParser::FindHeader(std::string_view Name) const {
+  for (const auto &Header : Headers)
+    if (Utils::EqualsIgnoreCase(View(Header.Name), Name))
+      return View(Header.Value);
+  return {};
+}
+} // namespace proxy
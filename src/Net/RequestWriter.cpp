@@ -0,0 +1,66 @@
+#include <Net/RequestWriter.hpp>
+#include <charconv>
+
+namespace proxy {
+RequestWriter::RequestWriter(std::vector<char> &Out, std::size_t SizeHint)
+    : Out(Out) {
+  Out.clear();
+  Out.reserve(SizeHint);
+}
+
+void RequestWriter::Append(std::string_view Bytes) {
+  Out.insert(Out.end(), Bytes.begin(), Bytes.end());
+}
+
+void RequestWriter::WriteRequestLine(std::string_view Method,
+                                     std::string_view URI, int VersionMajor,
+                                     int VersionMinor) {
+  // Versions are single digits, the parser doesn't accept others
+  char Version[] = " HTTP/0.0\r\n";
+  Version[6] = static_cast<char>('0' + VersionMajor);
+  Version[8] = static_cast<char>('0' + VersionMinor);
+  Append(Method);
+  Append(" ");
+  Append(URI);
+  Append(std::string_view(Version, sizeof(Version) - 1));
+}
+
+void RequestWriter::WriteHeader(std::string_view Name,
+                                std::string_view Value) {
+  Append(Name);
+  Append(": ");
+  Append(Value);
+  Append("\r\n");
+}
+
+void RequestWriter::WriteHostHeader(std::string_view Host, uint16_t Port) {
+  Append("Host: ");
+  Append(Host);
+  if (Port != 80) {
+    char Digits[8] = ":";
+    auto Res = std::to_chars(Digits + 1, Digits + sizeof(Digits), Port);
+    Append(std::string_view(Digits, Res.ptr - Digits));
+  }
+  Append("\r\n");
+}
+
+std::size_t RequestWriter::EndHead() {
+  Append("\r\n");
+  return Out.size();
+}
+
+void RequestWriter::WriteBody(std::string_view Body) { Append(Body); }
+
+void RequestWriter::InsertHeader(const std::vector<char> &Request,
+                                 std::size_t HeadSize, std::string_view Name,
+                                 std::string_view Value,
+                                 std::vector<char> &Out) {
+  // Goes before the empty line ending the head
+  std::size_t Pos = HeadSize - 2;
+  RequestWriter Writer(Out,
+                       Request.size() + Name.size() + Value.size() + 4);
+  Writer.Append(std::string_view(Request.data(), Pos));
+  Writer.WriteHeader(Name, Value);
+  Writer.Append(std::string_view(Request.data() + Pos, Request.size() - Pos));
+}
+} // namespace proxy
@@ -0,0 +1,250 @@
+#include <Common/Globals.hpp>
+#include <Functional/Function.hpp>
+#include <Logging/Logger.hpp>
+#include <Net/Resolver.hpp>
+#include <Parallel/LockGuard.hpp>
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cctype>
+#include <cstring>
+#include <fstream>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sstream>
+
+namespace proxy {
+static std::string NormalizeHost(const std::string &Host) {
+  std::string Name = Host;
+  // IPv6 literals come in brackets from URLs
+  if (Name.size() >= 2 && Name.front() == '[' && Name.back() == ']')
+    Name = Name.substr(1, Name.size() - 2);
+  if (!Name.empty() && Name.back() == '.')
+    Name.pop_back();
+  std::transform(Name.begin(), Name.end(), Name.begin(),
+                 [](unsigned char C) { return std::tolower(C); });
+  return Name;
+}
+
+static bool ParseAddress(const std::string &Str, ResolvedAddress &Address) {
+  memset(&Address, 0, sizeof(Address));
+  auto *Addr4 = reinterpret_cast<struct sockaddr_in *>(&Address.Addr);
+  auto *Addr6 = reinterpret_cast<struct sockaddr_in6 *>(&Address.Addr);
+  if (inet_pton(AF_INET, Str.c_str(), &Addr4->sin_addr) == 1) {
+    Addr4->sin_family = AF_INET;
+    Address.AddrLen = sizeof(*Addr4);
+    return true;
+  }
+  if (inet_pton(AF_INET6, Str.c_str(), &Addr6->sin6_addr) == 1) {
+    Addr6->sin6_family = AF_INET6;
+    Address.AddrLen = sizeof(*Addr6);
+    return true;
+  }
+  return false;
+}
+
+static ResolvedHostPtr MakeError(const std::string &Error) {
+  auto Host = std::make_shared<ResolvedHost>();
+  Host->Error = Error;
+  return Host;
+}
+
+Resolver::Resolver(ThreadPool *Pool, const ResolverConfig &Cfg) : Pool(Pool) {
+  if (!Cfg.HostsFile.empty())
+    LoadHostsFile(Cfg.HostsFile);
+
+  if (!Cfg.NameServer.empty()) {
+    DNS.emplace(Cfg.NameServer);
+    Log::DefaultLogger.LogInfo("Resolving host names with ", Cfg.NameServer);
+  } else {
+    Log::DefaultLogger.LogInfo("Resolving host names with getaddrinfo()");
+  }
+}
+
+void Resolver::LoadHostsFile(const std::string &Path) {
+  std::ifstream HostsFile(Path);
+  if (!HostsFile) {
+    Log::DefaultLogger.LogError("Couldn't open hosts file ", Path);
+    return;
+  }
+
+  std::unordered_map<std::string, std::shared_ptr<ResolvedHost>> Entries;
+  std::string Line;
+  while (std::getline(HostsFile, Line)) {
+    Line = Line.substr(0, Line.find('#'));
+    std::istringstream Words(Line);
+    std::string AddressStr, Name;
+    ResolvedAddress Address;
+    if (!(Words >> AddressStr) || !ParseAddress(AddressStr, Address))
+      continue;
+    while (Words >> Name) {
+      auto &Entry = Entries[NormalizeHost(Name)];
+      if (!Entry)
+        Entry = std::make_shared<ResolvedHost>();
+      Entry->Addresses.push_back(Address);
+    }
+  }
+  for (auto &[Name, Entry] : Entries)
+    Hosts.emplace(Name, std::move(Entry));
+}
+
+ResolvedHostPtr Resolver::Resolve(const std::string &Host,
+                                  ResolveListener *Listener) {
+  auto Name = NormalizeHost(Host);
+
+  ResolvedAddress Literal;
+  if (ParseAddress(Name, Literal)) {
+    HitsNum++;
+    auto Result = std::make_shared<ResolvedHost>();
+    Result->Addresses.push_back(Literal);
+    return Result;
+  }
+
+  auto HostsIt = Hosts.find(Name);
+  if (HostsIt != Hosts.end()) {
+    HitsNum++;
+    return HostsIt->second;
+  }
+
+  LockGuard<MutexLocker> G(&CacheMutex);
+  auto Now = ClockT::now();
+  auto It = Cache.find(Name);
+  if (It != Cache.end()) {
+    auto &Entry = It->second;
+    if (Entry.IsResolving) {
+      JoinedNum++;
+      Entry.Listeners.push_back(Listener);
+      return nullptr;
+    }
+    if (Entry.Expiry > Now) {
+      HitsNum++;
+      return Entry.Host;
+    }
+  }
+
+  MissesNum++;
+  if (Cache.size() >= Globals::ResolverCacheMaxSize)
+    PurgeExpired(Now);
+  auto &Entry = Cache[Name];
+  Entry.IsResolving = true;
+  Entry.Listeners.push_back(Listener);
+  Pool->Submit(Function(&Resolver::ResolveTask, this, std::string(Name)));
+  return nullptr;
+}
+
+void Resolver::Cancel(const std::string &Host, ResolveListener *Listener) {
+  LockGuard<MutexLocker> G(&CacheMutex);
+  auto It = Cache.find(NormalizeHost(Host));
+  if (It == Cache.end())
+    return;
+  auto &Listeners = It->second.Listeners;
+  Listeners.erase(std::remove(Listeners.begin(), Listeners.end(), Listener),
+                  Listeners.end());
+}
+
+void Resolver::PurgeExpired(ClockT::time_point Now) {
+  for (auto It = Cache.begin(); It != Cache.end();) {
+    if (!It->second.IsResolving && It->second.Expiry <= Now)
+      It = Cache.erase(It);
+    else
+      ++It;
+  }
+}
+
+void Resolver::ResolveTask(std::string Host) {
+  uint32_t TTL = Globals::ResolverNegativeTTLSec;
+  ResolvedHostPtr Result;
+  try {
+    Result = Lookup(Host, TTL);
+  } catch (const std::exception &E) {
+    Result = MakeError(E.what());
+    TTL = Globals::ResolverNegativeTTLSec;
+  }
+
+  if (Result->Addresses.empty())
+    Log::DefaultLogger.LogError("Failed to resolve ", Host, ": ",
+                                Result->Error);
+  else
+    Log::DefaultLogger.LogInfo("Resolved ", Host, " to ",
+                               Result->Addresses.size(), " addresses, TTL ",
+                               TTL, "s");
+
+  TTL = std::min(TTL, Globals::ResolverMaxTTLSec);
+  LockGuard<MutexLocker> G(&CacheMutex);
+  auto &Entry = Cache[Host];
+  Entry.Host = Result;
+  Entry.Expiry = ClockT::now() + std::chrono::seconds(TTL);
+  Entry.IsResolving = false;
+  // Listeners are notified under the lock, so that Cancel() guarantees
+  // there are no notifications in flight
+  for (auto *Listener : Entry.Listeners)
+    Listener->OnResolved(Result);
+  Entry.Listeners.clear();
+}
+
+ResolvedHostPtr Resolver::Lookup(const std::string &Host, uint32_t &TTL) {
+  ResolvedHostPtr Result;
+  if (DNS) {
+    try {
+      Result = LookupWithDNS(Host, TTL);
+    } catch (const std::exception &E) {
+      Log::DefaultLogger.LogError("DNS query for ", Host, " failed: ",
+                                  E.what());
+    }
+  }
+  if (!Result)
+    Result = LookupWithGAI(Host, TTL);
+  if (Result->Addresses.empty())
+    TTL = Globals::ResolverNegativeTTLSec;
+  return Result;
+}
+
+ResolvedHostPtr Resolver::LookupWithDNS(const std::string &Host,
+                                        uint32_t &TTL) {
+  auto Answer = DNS->Query(Host);
+  if (Answer.NameError)
+    return MakeError("Host not found");
+  // Let getaddrinfo() deal with whatever the stub can't
+  if (Answer.Truncated || Answer.Addresses.empty())
+    return nullptr;
+
+  auto Result = std::make_shared<ResolvedHost>();
+  Result->Addresses = std::move(Answer.Addresses);
+  // Prefer IPv4 the same way getaddrinfo() usually does
+  std::stable_sort(Result->Addresses.begin(), Result->Addresses.end(),
+                   [](const ResolvedAddress &L, const ResolvedAddress &R) {
+                     return L.Addr.ss_family == AF_INET &&
+                            R.Addr.ss_family != AF_INET;
+                   });
+  TTL = Answer.TTL;
+  return Result;
+}
+
+ResolvedHostPtr Resolver::LookupWithGAI(const std::string &Host,
+                                        uint32_t &TTL) {
+  struct addrinfo Hints;
+  memset(&Hints, 0, sizeof(Hints));
+  Hints.ai_family = AF_UNSPEC;     // IPv4 or IPv6
+  Hints.ai_socktype = SOCK_STREAM; // TCP
+
+  struct addrinfo *AddrInfos;
+  int Status = getaddrinfo(Host.c_str(), nullptr, &Hints, &AddrInfos);
+  if (Status)
+    return MakeError(std::string("getaddrinfo(): ") + gai_strerror(Status));
+
+  auto Result = std::make_shared<ResolvedHost>();
+  for (auto *Info = AddrInfos; Info; Info = Info->ai_next) {
+    ResolvedAddress Address;
+    memset(&Address, 0, sizeof(Address));
+    memcpy(&Address.Addr, Info->ai_addr, Info->ai_addrlen);
+    Address.AddrLen = Info->ai_addrlen;
+    Result->Addresses.push_back(Address);
+  }
+  freeaddrinfo(AddrInfos);
+  TTL = Globals::ResolverDefaultTTLSec;
+  return Result;
+}
+
+Resolver::Stats Resolver::GetStats() const {
+  return {HitsNum.load(), MissesNum.load(), JoinedNum.load()};
+}
+} // namespace proxy
@@ -0,0 +1,251 @@
+#include <Common/Globals.hpp>
+#include <Common/Utils.hpp>
+#include <Net/HttpScan.hpp>
+#include <Net/ResponseFramer.hpp>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+
+namespace proxy {
+static std::string Trim(const std::string &Str) {
+  auto Begin = Str.find_first_not_of(" \t");
+  if (Begin == std::string::npos)
+    return "";
+  auto End = Str.find_last_not_of(" \t");
+  return Str.substr(Begin, End - Begin + 1);
+}
+
+static std::string ToLower(std::string Str) {
+  std::transform(Str.begin(), Str.end(), Str.begin(),
+                 [](unsigned char C) { return std::tolower(C); });
+  return Str;
+}
+
+ResponseFramer::ResponseFramer(bool IsHeadRequest)
+    : IsHeadRequest(IsHeadRequest) {}
+
+void ResponseFramer::Reset(bool IsHeadRequest) {
+  *this = ResponseFramer(IsHeadRequest);
+}
+
+bool ResponseFramer::HasHeaders() const {
+  return _State != State::StatusLine && _State != State::Headers;
+}
+
+const CacheHeaders &ResponseFramer::GetCacheHeaders() const {
+  return _CacheHeaders;
+}
+
+bool ResponseFramer::IsDone() const { return _State == State::Done; }
+
+bool ResponseFramer::IsDelimitedByClose() const {
+  return _State == State::UntilClose;
+}
+
+bool ResponseFramer::IsKeepAlive() const { return KeepAlive; }
+
+int ResponseFramer::GetStatusCode() const { return StatusCode; }
+
+std::size_t ResponseFramer::GetHeaderSize() const { return HeaderSize; }
+
+bool ResponseFramer::IsHeadRequestBytes(const char *Bytes, std::size_t Size) {
+  return Size >= 5 && memcmp(Bytes, "HEAD ", 5) == 0;
+}
+
+void ResponseFramer::StartUntilClose() {
+  _State = State::UntilClose;
+  KeepAlive = false;
+}
+
+bool ResponseFramer::ReadLine(const char *&Bytes, const char *End) {
+  auto *NewLine = HttpScan::FindLineEnd(Bytes, End);
+  const char *LineEnd = NewLine ? NewLine + 1 : End;
+  if (_State == State::StatusLine || _State == State::Headers ||
+      _State == State::Trailers) {
+    HeaderSize += LineEnd - Bytes;
+    if (HeaderSize > Globals::MaxResponseHeaderSize) {
+      Bytes = LineEnd;
+      StartUntilClose();
+      return false;
+    }
+  }
+  Line.append(Bytes, NewLine ? NewLine : End);
+  Bytes = LineEnd;
+  if (!NewLine)
+    return false;
+  if (!Line.empty() && Line.back() == '\r')
+    Line.pop_back();
+  return true;
+}
+
+void ResponseFramer::ParseStatusLine() {
+  // HTTP/1.x NNN Reason
+  if (Line.size() < 12 || Line.compare(0, 7, "HTTP/1.") != 0 ||
+      Line[8] != ' ') {
+    StartUntilClose();
+    return;
+  }
+  StatusCode = atoi(Line.c_str() + 9);
+  KeepAlive = Line[7] != '0';
+  HasContentLength = false;
+  IsChunked = false;
+  _CacheHeaders = CacheHeaders();
+  _State = State::Headers;
+}
+
+void ResponseFramer::ParseHeader() {
+  auto Colon = Line.find(':');
+  if (Colon == std::string::npos)
+    return;
+  auto Name = Trim(Line.substr(0, Colon));
+  auto Value = Trim(Line.substr(Colon + 1));
+
+  if (Utils::EqualsIgnoreCase(Name, "Content-Length")) {
+    char *ValueEnd;
+    Remaining = strtoull(Value.c_str(), &ValueEnd, 10);
+    HasContentLength = !Value.empty() && *ValueEnd == '\0';
+  } else if (Utils::EqualsIgnoreCase(Name, "Transfer-Encoding")) {
+    auto Codings = ToLower(Value);
+    const std::string Chunked = "chunked";
+    // Anything but chunked as the final coding is delimited by close
+    IsChunked = Codings.size() >= Chunked.size() &&
+                Codings.compare(Codings.size() - Chunked.size(),
+                                Chunked.size(), Chunked) == 0;
+    if (!IsChunked)
+      HasContentLength = false;
+  } else if (Utils::EqualsIgnoreCase(Name, "Connection")) {
+    auto Tokens = ToLower(Value);
+    if (Tokens.find("close") != std::string::npos)
+      KeepAlive = false;
+    else if (Tokens.find("keep-alive") != std::string::npos)
+      KeepAlive = true;
+  } else if (Utils::EqualsIgnoreCase(Name, "Cache-Control")) {
+    // Repeated fields make up a single list
+    if (!_CacheHeaders.CacheControl.empty())
+      _CacheHeaders.CacheControl += ", ";
+    _CacheHeaders.CacheControl += Value;
+  } else if (Utils::EqualsIgnoreCase(Name, "Pragma")) {
+    _CacheHeaders.Pragma = ToLower(Value);
+  } else if (Utils::EqualsIgnoreCase(Name, "Expires")) {
+    _CacheHeaders.Expires = Value;
+  } else if (Utils::EqualsIgnoreCase(Name, "Date")) {
+    _CacheHeaders.Date = Value;
+  } else if (Utils::EqualsIgnoreCase(Name, "Age")) {
+    _CacheHeaders.Age = Value;
+  } else if (Utils::EqualsIgnoreCase(Name, "ETag")) {
+    _CacheHeaders.ETag = Value;
+  } else if (Utils::EqualsIgnoreCase(Name, "Last-Modified")) {
+    _CacheHeaders.LastModified = Value;
+  } else if (Utils::EqualsIgnoreCase(Name, "Vary")) {
+    _CacheHeaders.HasVary = true;
+  }
+}
+
+void ResponseFramer::StartBody() {
+  // Interim responses are followed by the final one
+  if (StatusCode >= 100 && StatusCode < 200 && StatusCode != 101) {
+    _State = State::StatusLine;
+    return;
+  }
+  if (StatusCode == 101) {
+    StartUntilClose();
+    return;
+  }
+  if (IsHeadRequest || StatusCode == 204 || StatusCode == 304) {
+    _State = State::Done;
+    return;
+  }
+  if (IsChunked) {
+    _State = State::ChunkSize;
+    return;
+  }
+  if (HasContentLength) {
+    _State = Remaining == 0 ? State::Done : State::Body;
+    return;
+  }
+  StartUntilClose();
+}
+
+uint64_t ResponseFramer::GetPassThroughSize() const {
+  switch (_State) {
+  case State::Body:
+  case State::ChunkData:
+    return Remaining;
+  case State::UntilClose:
+    return std::numeric_limits<uint64_t>::max();
+  default:
+    return 0;
+  }
+}
+
+std::optional<uint64_t> ResponseFramer::GetRemainingSize() const {
+  if (_State == State::Body)
+    return Remaining;
+  return {};
+}
+
+void ResponseFramer::Skip(uint64_t Size) {
+  if (_State != State::Body && _State != State::ChunkData)
+    return;
+  Remaining -= std::min(Size, Remaining);
+  if (Remaining == 0)
+    _State = _State == State::Body ? State::Done : State::ChunkDataEnd;
+}
+
+std::size_t ResponseFramer::Feed(const char *Bytes, std::size_t Size) {
+  const char *Begin = Bytes;
+  const char *End = Bytes + Size;
+  while (Bytes < End && _State != State::Done) {
+    switch (_State) {
+    case State::Body:
+    case State::ChunkData: {
+      auto Size = std::min<uint64_t>(Remaining, End - Bytes);
+      Bytes += Size;
+      Remaining -= Size;
+      if (Remaining == 0)
+        _State = _State == State::Body ? State::Done : State::ChunkDataEnd;
+      break;
+    }
+
+    case State::UntilClose:
+      Bytes = End;
+      break;
+
+    case State::Done:
+      break;
+
+    default: {
+      if (!ReadLine(Bytes, End))
+        break;
+      if (_State == State::StatusLine) {
+        ParseStatusLine();
+      } else if (_State == State::Headers) {
+        if (Line.empty())
+          StartBody();
+        else
+          ParseHeader();
+      } else if (_State == State::ChunkSize) {
+        char *SizeEnd;
+        Remaining = strtoull(Line.c_str(), &SizeEnd, 16);
+        if (SizeEnd == Line.c_str())
+          StartUntilClose();
+        else
+          _State = Remaining == 0 ? State::Trailers : State::ChunkData;
+      } else if (_State == State::ChunkDataEnd) {
+        if (Line.empty())
+          _State = State::ChunkSize;
+        else
+          StartUntilClose();
+      } else if (_State == State::Trailers) {
+        if (Line.empty())
+          _State = State::Done;
+      }
+      Line.clear();
+      break;
+    }
+    }
+  }
+  return Bytes - Begin;
+}
+} // namespace proxy
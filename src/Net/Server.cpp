@@ -1,94 +1,94 @@
+#include <Cache/CacheBlock.hpp>
 #include <Common/Globals.hpp>
 #include <Logging/Logger.hpp>
 #include <Net/RemoteHandler.hpp>
 #include <Net/Server.hpp>
 #include <Parallel/LockGuard.hpp>
+#include <cerrno>
+#include <unistd.h>
 
 namespace proxy {
-Server::Server(uint16_t Port)
-    : ServerTasksSemaphore(0), Poll(std::make_unique<Poller>()),
-      SrvCache(std::make_unique<Cache>()) {
-  SrvSock = new ServerSocket(Port);
-  SrvHandler = new ServerHandler(this);
+static std::size_t GetDefaultWorkersNum() {
+  long CPUsNum = sysconf(_SC_NPROCESSORS_ONLN);
+  return CPUsNum > 0 ? static_cast<std::size_t>(CPUsNum) : 1;
 }
 
-ServerSocket *Server::GetServerSocket() { return SrvSock; }
+Server::Server(const Config &Cfg)
+    : Cfg(Cfg), ServerTasksSemaphore(0) {
+  if (this->Cfg.WorkersNum == 0)
+    this->Cfg.WorkersNum = GetDefaultWorkersNum();
+  for (std::size_t i = 0; i < this->Cfg.WorkersNum; i++)
+    Loops.push_back(std::make_unique<EventLoop>(i, Cfg.Poller));
+  Pool = std::make_unique<ThreadPool>(Cfg.PoolThreadsNum);
+  DNSResolver = std::make_unique<Resolver>(
+      Pool.get(), ResolverConfig{Cfg.HostsFile, Cfg.NameServer});
+  if (!Cfg.DiskCacheDir.empty())
+    Disk = std::make_unique<DiskCache>(Cfg.DiskCacheDir, Cfg.DiskCacheSize,
+                                       Pool.get());
+  SrvCache =
+      std::make_unique<Cache>(Cfg.CacheSize, Cfg.CachePolicy, Disk.get());
+  try {
+    if (Cfg.ReusePort) {
+      for (std::size_t i = 0; i < Loops.size(); i++)
+        SrvHandlers.push_back(
+            new ServerHandler(this, new ServerSocket(Cfg.Port, true), true));
+    } else {
+      SrvHandlers.push_back(
+          new ServerHandler(this, new ServerSocket(Cfg.Port)));
+    }
+  } catch (...) {
+    for (auto *SH : SrvHandlers)
+      delete SH;
+    throw;
+  }
+}
 
-Cache *Server::GetCache() { return SrvCache.get(); }
+const Config &Server::GetConfig() const { return Cfg; }
 
-void Server::Terminate() {
-  LockGuard<WriteLocker> G(&IsTerminatedLock);
-  _IsTerminated = true;
-}
+Cache *Server::GetCache() { return SrvCache.get(); }
 
-bool Server::IsTerminated() {
-  LockGuard<ReadLocker> G(&IsTerminatedLock);
-  return _IsTerminated;
-}
+DiskCache *Server::GetDiskCache() { return Disk.get(); }
 
-void Server::AddCacheListener(CacheListenerInfo CLI) {
-  LockGuard<MutexLocker> G(&CacheMutex);
-  if (!SrvCache->HasRecord(CLI.CacheAddress)) {
-    Log::DefaultLogger.LogDebug("No cache record found, connecting to ",
-                                CLI.RemoteHostName, ":", CLI.RemotePort);
-    auto *Handler = new RemoteHandler(this, CLI.CacheAddress, CLI.RequestBytes);
-    Handler->ConnectTo(CLI.RemoteHostName, CLI.RemotePort);
-    Handler->Start();
-  }
-  SrvCache->AddListener(CLI.CacheAddress, CLI.Listener);
-}
+ThreadPool *Server::GetThreadPool() { return Pool.get(); }
 
-void Server::RegisterHandler(PollHandlerBase *HB) {
-  LockGuard<MutexLocker> G(&HandlersMutex);
-  Handlers.insert(HB);
-}
+Resolver *Server::GetResolver() { return DNSResolver.get(); }
 
-void Server::RemoveHandler(PollHandlerBase *HB) {
-  if (!HB)
-    return;
-  LockGuard<MutexLocker> G(&HandlersMutex);
-  auto It = std::find(Handlers.begin(), Handlers.end(), HB);
-  Handlers.erase(It);
-  if (HB == SrvHandler)
-    Terminate();
-  delete HB;
-}
+std::size_t Server::GetEventLoopsNum() const { return Loops.size(); }
 
-void Server::EraseDeadHandlers() {
-  LockGuard<MutexLocker> G(&DeadHandlersMutex);
-  for (auto *HB : DeadHandlers)
-    RemoveHandler(HB);
-  DeadHandlers.clear();
+EventLoop *Server::GetEventLoop(std::size_t Idx) {
+  return Loops[Idx % Loops.size()].get();
 }
 
-void Server::MarkDeadHandler(PollHandlerBase *HB) {
-  if (!HB)
-    return;
+void Server::Terminate() {
   {
-    LockGuard<MutexLocker> G(&DeadHandlersMutex);
-    DeadHandlers.insert(HB);
+    LockGuard<WriteLocker> G(&IsTerminatedLock, false);
+    _IsTerminated = true;
   }
-  ServerTasksSemaphore.Release();
+  ServerTasksSemaphore.Release(false);
 }
 
-void Server::TerminateTimedOutHandlers() {
-  auto Now = SocketBase::ClockT::now();
-  using FSec = std::chrono::duration<float>;
-  LockGuard<MutexLocker> G(&HandlersMutex);
-  for (auto *HB : Handlers) {
-    if (HB == SrvHandler)
-      continue;
-    auto Time = HB->GetLastIOTimePoint();
-    if (!Time.has_value())
-      continue;
-    FSec TimePassed = Now - *Time;
-    if (TimePassed.count() >= Globals::ClientTimeoutSec) {
-      Log::DefaultLogger.LogInfo(
-          "Socket #", HB->GetSocket()->GetFD(),
-          " has been inactive for too long, disconnecting");
-      HB->Terminate();
-    }
-  }
+bool Server::IsTerminated() {
+  LockGuard<ReadLocker> G(&IsTerminatedLock, false);
+  return _IsTerminated;
+}
+
+bool Server::AddCacheListener(CacheListenerInfo CLI) {
+  // The record is looked up or created along with attaching the listener,
+  // so concurrent requests for the same address download it only once
+  CacheRecordPtr Record;
+  if (!SrvCache->AddListener(CLI.CacheAddress, CLI.Listener, Record))
+    return false;
+  if (!Record)
+    return true;
+
+  Log::DefaultLogger.LogDebug("No fresh cache record found, connecting to ",
+                              CLI.RemoteHostName, ":", CLI.RemotePort);
+  auto *Handler = new RemoteHandler(this, std::move(CLI.CacheAddress),
+                                    std::move(CLI.RequestBytes));
+  Handler->SetCacheRecord(std::move(Record));
+  Handler->ConnectTo(CLI.RemoteHostName, CLI.RemotePort);
+  CLI.Loop->Attach(Handler);
+  return true;
 }
 
 static Server *ServerPtr = nullptr;
@@ -101,9 +101,14 @@ static void OnSignal(int) {
 }
 }
 
-void Server::StartImpl() {
-  // ThisThread::DisableInterruption();
+void Server::StopLoops() {
+  for (auto &L : Loops)
+    L->Terminate();
+  for (auto &L : Loops)
+    L->Join();
+}
 
+void Server::StartImpl() {
   ServerPtr = this;
 
   struct sigaction OnSignalAction;
@@ -116,25 +121,58 @@ void Server::StartImpl() {
   if (0 != sigaction(SIGTERM, &OnSignalAction, NULL))
     Exception::ThrowSystemError("sigaction()");
 
-  Utils::UnlockInterruptionSignals();
+  // splice() can't suppress SIGPIPE like send() does with MSG_NOSIGNAL
+  struct sigaction IgnoreAction;
+  memset(&IgnoreAction, 0, sizeof(IgnoreAction));
+  IgnoreAction.sa_handler = SIG_IGN;
+
+  if (0 != sigaction(SIGPIPE, &IgnoreAction, NULL))
+    Exception::ThrowSystemError("sigaction()");
 
-  Log::DefaultLogger.LogInfo("Listening at port ", SrvSock->GetPort());
+  Log::DefaultLogger.LogInfo("Listening at port ", Cfg.Port, " with ",
+                             Loops.size(), " workers",
+                             Cfg.ReusePort ? " (sharded listeners)" : "");
 
-  RegisterHandler(SrvHandler);
-  SrvHandler->Start();
+  for (auto &L : Loops)
+    L->Start();
+  // The handlers are owned by the loops from now on
+  for (std::size_t i = 0; i < SrvHandlers.size(); i++)
+    Loops[i]->Attach(SrvHandlers[i]);
+  SrvHandlers.clear();
+
+  Utils::UnlockInterruptionSignals();
 
   while (!IsTerminated()) {
     try {
-      ServerTasksSemaphore.TimedAcquire(Globals::ClientTimeoutMSec);
-      EraseDeadHandlers();
-      TerminateTimedOutHandlers();
+      ServerTasksSemaphore.Acquire(false);
     } catch (const std::system_error &E) {
-      if (IsTerminated())
-        break;
+      if (IsTerminated() || E.code().value() == EINTR)
+        continue;
       Log::DefaultLogger.LogFatal("[Server]: ", E.what());
       Terminate();
     }
   }
+
+  Log::DefaultLogger.LogInfo("Shutting down...");
+  StopLoops();
+  auto Stats = DNSResolver->GetStats();
+  Log::DefaultLogger.LogInfo("Resolver: ", Stats.Hits, " hits, ", Stats.Misses,
+                             " misses, ", Stats.Joined, " joined lookups");
+  auto CStats = SrvCache->GetStats();
+  Log::DefaultLogger.LogInfo("Cache: ", CStats.RecordsNum, " records, ",
+                             CStats.Size, " bytes, ", CStats.EvictionsNum,
+                             " evictions");
+  auto BStats = CacheBlock::GetAllocatorStats();
+  Log::DefaultLogger.LogInfo("Cache blocks: ", BStats.UsedSlotsNum, " of ",
+                             BStats.SlotsNum, " slots used, ", BStats.SlabsNum,
+                             " slabs, ", BStats.Size, " bytes mapped");
+  if (Disk) {
+    auto DStats = Disk->GetStats();
+    Log::DefaultLogger.LogInfo("Disk cache: ", DStats.RecordsNum, " records, ",
+                               DStats.Size, " bytes in ", DStats.SegmentsNum,
+                               " segments, ", DStats.WritesNum, " writes, ",
+                               DStats.HitsNum, " hits");
+  }
 }
 
 void Server::Start() {
@@ -142,12 +180,20 @@ void Server::Start() {
     StartImpl();
   } catch (std::system_error &E) {
     Log::DefaultLogger.LogFatal(E.what());
+    StopLoops();
   }
 }
 
 Server::~Server() {
-  LockGuard<MutexLocker> G(&HandlersMutex, false);
-  for (auto *HB : Handlers)
-    delete HB;
+  StopLoops();
+  // Handlers are owned by the loops and have to go before the cache
+  Loops.clear();
+  // Lookups and disk writes in flight use the resolver and the disk cache
+  Pool.reset();
+  DNSResolver.reset();
+  for (auto *SH : SrvHandlers)
+    delete SH;
+  SrvCache.reset();
+  Disk.reset();
 }
 } // namespace proxy
@@ -1,77 +1,49 @@
+#include <Common/Globals.hpp>
 #include <Net/ClientHandler.hpp>
+#include <Net/EventLoop.hpp>
 #include <Net/ServerHandler.hpp>
-#include <Parallel/LockGuard.hpp>
 #include <cassert>
 #include <optional>
 #include <poll.h>
 
 namespace proxy {
-ServerHandler::ServerHandler(Server *Server)
-    : ServerThread(Function(&ServerHandler::ServerRoutine, this)) {
-  Srv = Server;
-  Sock = Srv->GetServerSocket();
-  SockFD = Sock->GetFD();
-}
+ServerHandler::ServerHandler(Server *Server, ServerSocket *Sock,
+                             bool IsSharded)
+    : Srv(Server), Sock(Sock), SockFD(Sock->GetFD()), IsSharded(IsSharded) {}
 
 SocketBase *ServerHandler::GetSocket() { return Sock; }
 
+// Listening socket never times out
 std::optional<SocketBase::TimePointT> ServerHandler::GetLastIOTimePoint() {
-  if (Sock)
-    return Sock->GetLastIOTimePoint();
   return {};
 }
 
 void ServerHandler::Terminate() {
-  LockGuard<WriteLocker> G(&IsTerminatedLock, false);
+  if (_IsTerminated)
+    return;
   _IsTerminated = true;
+  if (Loop)
+    Loop->GetPoller()->Remove(SockFD);
 }
 
-bool ServerHandler::IsTerminated() {
-  LockGuard<ReadLocker> G(&IsTerminatedLock, false);
-  return _IsTerminated;
-}
+bool ServerHandler::IsTerminated() { return _IsTerminated; }
 
 void ServerHandler::Finish() {
   Terminate();
-  Srv->MarkDeadHandler(this);
+  Loop->MarkDeadHandler(this);
+  Srv->Terminate();
 }
 
-void ServerHandler::ServerRoutine() {
-  ThisThread::BlockInterruptionSignals();
+void ServerHandler::Start() {
   Sock->Listen();
-  Poll.Add(SockFD, POLLIN, this);
-  while (!IsTerminated()) {
-    Log::DefaultLogger.LogDebug("Server: Polling...");
-    int PolledNum = Poll.Poll(Globals::ClientTimeoutMSec);
-    if (PolledNum == 0) {
-      Finish();
-      break;
-    }
-
-    int HandledNum = 0;
-
-    for (auto &Client : Poll) {
-      if (HandledNum++ == PolledNum)
-        break;
-      Log::DefaultLogger.LogDebug(
-          "FD ", Client.GetFD(), " received ",
-          Utils::EventsToString(Client.GetReceivedEvents()));
-      try {
-        Handle(&Poll, &Client);
-      } catch (const std::system_error &E) {
-        if (IsTerminated())
-          break;
-        Log::DefaultLogger.LogFatal("[Client #", Client.GetFD(),
-                                    "]: ", E.what());
-        Finish();
-      }
-      ThisThread::InterruptionPoint();
-    }
-  }
-  Log::DefaultLogger.LogInfo("Shutting down...");
+  Loop->GetPoller()->Add(SockFD, POLLIN, this);
 }
 
-void ServerHandler::Start() { ServerThread.StartThread(); }
+EventLoop *ServerHandler::NextEventLoop() {
+  if (IsSharded)
+    return Loop;
+  return Srv->GetEventLoop(NextLoopIdx++);
+}
 
 void ServerHandler::Handle(Poller *P, PollClient *Client) {
   auto Events = Client->GetReceivedEvents();
@@ -86,16 +58,24 @@ void ServerHandler::Handle(Poller *P, PollClient *Client) {
 
   assert(Client->GetFD() == Sock->GetFD());
 
-  Socket *ClientSocket = Sock->Accept();
-  auto *Handler = new ClientHandler(Srv, ClientSocket);
-  Srv->RegisterHandler(Handler);
-  Handler->Start();
+  // Drain the backlog in batches, leaving the rest for the next iteration
+  // so that a connection storm doesn't starve the other sockets of the loop
+  for (std::size_t i = 0; i < Globals::AcceptBatchSize; i++) {
+    Socket *ClientSocket;
+    try {
+      ClientSocket = Sock->Accept();
+    } catch (const std::system_error &E) {
+      Log::DefaultLogger.LogError("[Server]: ", E.what());
+      return;
+    }
+    if (!ClientSocket)
+      return;
+    NextEventLoop()->Attach(new ClientHandler(Srv, ClientSocket));
+  }
 }
 
 ServerHandler::~ServerHandler() {
   Terminate();
-  ServerThread.Interrupt();
-  ServerThread.Join();
   if (Sock)
     delete Sock;
 }
@@ -15,7 +15,7 @@
 #include <pthread.h>
 
 namespace proxy {
-ServerSocket::ServerSocket(uint16_t Port) {
+ServerSocket::ServerSocket(uint16_t Port, bool ReusePort) {
   this->Port = Port;
   Fd = socket(AF_INET6, SOCK_STREAM, 0);
   if (Fd == -1)
@@ -36,6 +36,14 @@ ServerSocket::ServerSocket(uint16_t Port) {
     Exception::ThrowSystemError("setsockopt()");
   }
 
+  if (ReusePort) {
+    int Reuse = 1;
+    if (setsockopt(Fd, SOL_SOCKET, SO_REUSEPORT, &Reuse, sizeof(Reuse)) == -1) {
+      close(Fd);
+      Exception::ThrowSystemError("setsockopt()");
+    }
+  }
+
   struct sockaddr_in6 Addr;
   memset(&Addr, 0, sizeof(Addr));
   Addr.sin6_addr = in6addr_any;
@@ -49,14 +57,15 @@ ServerSocket::ServerSocket(uint16_t Port) {
 }
 
 void ServerSocket::Listen() {
-  if (listen(Fd, SOMAXCONN) == -1) {
-    close(Fd);
+  SetNonBlocking(true);
+  if (listen(Fd, SOMAXCONN) == -1)
     Exception::ThrowSystemError("listen()");
-  }
 }
 
 Socket *ServerSocket::Accept() {
   auto *S = Socket::AcceptFrom(this);
+  if (!S)
+    return nullptr;
   Log::DefaultLogger.LogInfo("Accepted new connection at port ", Port,
                              " at FD ", S->GetFD());
   return S;
@@ -3,10 +3,16 @@
 #include <Logging/Logger.hpp>
 #include <Net/Socket.hpp>
 #include <Parallel/LockGuard.hpp>
+#include <algorithm>
 #include <cerrno>
 #include <chrono>
 #include <cstring>
+#include <netinet/in.h>
 #include <poll.h>
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
+#include <unistd.h>
 
 namespace proxy {
 static std::string AddrToStr(struct addrinfo *AddrInfo) {
@@ -37,9 +43,13 @@ ssize_t Socket::Write(const char *Bytes, std::size_t Size) {
   ssize_t SentBytes;
   SentBytes = send(Fd, Bytes, Size, MSG_NOSIGNAL);
   ThisThread::InterruptionPoint();
-  UpdateLastIOTimePoint();
-  if (SentBytes < 0)
+  if (SentBytes < 0) {
+    // Non-blocking socket isn't ready yet, wait for the next poll event
+    if (errno == EAGAIN || errno == EWOULDBLOCK)
+      return -1;
     Exception::ThrowSystemError("send()");
+  }
+  UpdateLastIOTimePoint();
   return SentBytes;
 }
 
@@ -47,20 +57,62 @@ ssize_t Socket::Read(char *Bytes, std::size_t Size) {
   ssize_t ReceivedBytes;
   ReceivedBytes = recv(Fd, Bytes, Size, MSG_NOSIGNAL);
   ThisThread::InterruptionPoint();
-  UpdateLastIOTimePoint();
-  if (ReceivedBytes < 0)
+  if (ReceivedBytes < 0) {
+    if (errno == EAGAIN || errno == EWOULDBLOCK)
+      return -1;
     Exception::ThrowSystemError("recv()");
+  }
+  UpdateLastIOTimePoint();
   return ReceivedBytes;
 }
 
+ssize_t Socket::Write(const struct iovec *IOVecs, std::size_t IOVecsNum) {
+  struct msghdr Msg;
+  memset(&Msg, 0, sizeof(Msg));
+  Msg.msg_iov = const_cast<struct iovec *>(IOVecs);
+  Msg.msg_iovlen = IOVecsNum;
+  ssize_t SentBytes = sendmsg(Fd, &Msg, MSG_NOSIGNAL);
+  ThisThread::InterruptionPoint();
+  if (SentBytes < 0) {
+    if (errno == EAGAIN || errno == EWOULDBLOCK)
+      return -1;
+    Exception::ThrowSystemError("sendmsg()");
+  }
+  UpdateLastIOTimePoint();
+  return SentBytes;
+}
+
 ssize_t Socket::Write(const std::vector<char> &Bytes) {
   return Write(Bytes.data(), Bytes.size());
 }
 
+ssize_t Socket::SendFile(int FileFD, uint64_t Offset, std::size_t Size) {
+#ifdef __linux__
+  off_t FileOffset = Offset;
+  ssize_t SentBytes = sendfile(Fd, FileFD, &FileOffset, Size);
+  ThisThread::InterruptionPoint();
+  if (SentBytes < 0) {
+    if (errno == EAGAIN || errno == EWOULDBLOCK)
+      return -1;
+    Exception::ThrowSystemError("sendfile()");
+  }
+  UpdateLastIOTimePoint();
+  return SentBytes;
+#else
+  char Buf[Globals::DefaultReadBufferSize];
+  ssize_t ReadBytes =
+      pread(FileFD, Buf, std::min(Size, sizeof(Buf)), Offset);
+  if (ReadBytes < 0)
+    Exception::ThrowSystemError("pread()");
+  return Write(Buf, ReadBytes);
+#endif
+}
+
 ssize_t Socket::ReadAppend(std::vector<char> &Bytes) {
   char Buf[Globals::DefaultReadBufferSize];
   ssize_t ReceivedBytes = Read(Buf, sizeof(Buf));
-  Bytes.insert(Bytes.end(), Buf, Buf + ReceivedBytes);
+  if (ReceivedBytes > 0)
+    Bytes.insert(Bytes.end(), Buf, Buf + ReceivedBytes);
   return ReceivedBytes;
 }
 
@@ -68,7 +120,8 @@ ssize_t Socket::Read(std::vector<char> &Bytes) {
   char Buf[Globals::DefaultReadBufferSize];
   Bytes.clear();
   ssize_t ReceivedBytes = Read(Buf, sizeof(Buf));
-  Bytes.insert(Bytes.begin(), Buf, Buf + ReceivedBytes);
+  if (ReceivedBytes > 0)
+    Bytes.insert(Bytes.begin(), Buf, Buf + ReceivedBytes);
   return ReceivedBytes;
 }
 
@@ -88,12 +141,18 @@ Socket *Socket::AcceptFrom(SocketBase *SB) {
   Socket *Sock = new Socket();
 
   struct addrinfo *SockAddrInfo = Sock->GetAddrInfo();
-  int SocketFd =
-      accept(SB->GetFD(), SockAddrInfo->ai_addr, &SockAddrInfo->ai_addrlen);
+  int SocketFd = accept4(SB->GetFD(), SockAddrInfo->ai_addr,
+                         &SockAddrInfo->ai_addrlen, SOCK_NONBLOCK | SOCK_CLOEXEC);
   try {
     ThisThread::InterruptionPoint();
-    if (SocketFd == -1)
-      Exception::ThrowSystemError("accept()");
+    if (SocketFd == -1) {
+      // Backlog of a non-blocking listener is drained
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        delete Sock;
+        return nullptr;
+      }
+      Exception::ThrowSystemError("accept4()");
+    }
   } catch (...) {
     delete Sock;
     throw;
@@ -104,58 +163,37 @@ Socket *Socket::AcceptFrom(SocketBase *SB) {
   return Sock;
 }
 
-Socket *Socket::ConnectTo(const std::string &Host, uint16_t Port) {
-  int FD;
-  struct addrinfo *AddrInfos;
-  struct addrinfo Hints;
-
-  memset(&Hints, 0, sizeof(Hints));
-  Hints.ai_family = AF_UNSPEC;     // IPv4 or IPv6
-  Hints.ai_socktype = SOCK_STREAM; // TCP
-
-  int Status = getaddrinfo(Host.c_str(), std::to_string(Port).c_str(), &Hints,
-                           &AddrInfos);
+Socket *Socket::ConnectTo(const ResolvedAddress &Address, uint16_t Port) {
+  int FD = socket(Address.Addr.ss_family,
+                  SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
   ThisThread::InterruptionPoint();
-  if (Status)
-    Exception::ThrowSystemError(Status, std::string("getaddrinfo()") +
-                                            gai_strerror(Status));
-
-  int yes = 1;
-  // Choose the first appropriate addr filled by gai
-  struct addrinfo *Info = nullptr;
-  for (Info = AddrInfos; Info != nullptr; Info = Info->ai_next) {
-    if ((FD = socket(Info->ai_family, Info->ai_socktype, Info->ai_protocol)) ==
-        -1) {
-      ThisThread::InterruptionPoint();
-      Log::DefaultLogger.LogError("socket()", strerror(errno));
-      continue;
-    }
-    break;
-  }
-
-  if (!Info) {
-    freeaddrinfo(AddrInfos);
-    close(FD);
-    Log::DefaultLogger.LogError("Failed to resolve ", Host, ":", Port);
-    Exception::ThrowSystemError("getaddrinfo()");
-  }
+  if (FD == -1)
+    Exception::ThrowSystemError("socket()");
 
   Socket *Sock = new Socket(FD);
-  memcpy(Sock->GetAddrInfo(), Info, sizeof(*Info));
-
   struct addrinfo *AddrInfo = Sock->GetAddrInfo();
-  Status = connect(FD, AddrInfo->ai_addr, AddrInfo->ai_addrlen);
+  memcpy(&Sock->Addr, &Address.Addr, Address.AddrLen);
+  if (Address.Addr.ss_family == AF_INET)
+    reinterpret_cast<struct sockaddr_in *>(&Sock->Addr)->sin_port =
+        htons(Port);
+  else
+    reinterpret_cast<struct sockaddr_in6 *>(&Sock->Addr)->sin6_port =
+        htons(Port);
+  AddrInfo->ai_family = Address.Addr.ss_family;
+  AddrInfo->ai_socktype = SOCK_STREAM;
+  AddrInfo->ai_addrlen = Address.AddrLen;
+
+  int Status = connect(FD, AddrInfo->ai_addr, AddrInfo->ai_addrlen);
   ThisThread::InterruptionPoint();
   if (Status < 0 && errno != EINPROGRESS) {
-    close(FD);
-    freeaddrinfo(AddrInfos);
-    Log::DefaultLogger.LogError("Failed to connect to ", Host, ":", Port);
-    Exception::ThrowSystemError("connect()");
+    int Error = errno;
+    Log::DefaultLogger.LogError("Failed to connect to ",
+                                AddrToStr(Sock->GetAddrInfo()));
+    delete Sock;
+    Exception::ThrowSystemError(Error, "connect()");
   }
   Sock->UpdateLastIOTimePoint();
-  freeaddrinfo(AddrInfos);
-  Log::DefaultLogger.LogInfo("Resolved ", Host, ":", Port, " to ",
-                             AddrToStr(Sock->GetAddrInfo()));
+  Log::DefaultLogger.LogInfo("Connecting to ", AddrToStr(Sock->GetAddrInfo()));
   return Sock;
 }
 } // namespace proxy
@@ -1,13 +1,11 @@
 #include <Common/ProxyException.hpp>
 #include <Logging/Logger.hpp>
 #include <Net/SocketBase.hpp>
-#include <Parallel/LockGuard.hpp>
 #include <chrono>
 #include <fcntl.h>
 
 namespace proxy {
 void SocketBase::UpdateLastIOTimePoint() {
-  LockGuard<WriteLocker> G(&LastIOTimeLock);
   LastIOTimePoint = ClockT::now();
 }
 
@@ -18,10 +16,11 @@ SocketBase::TimePointT SocketBase::GetLastIOTimePoint() {
 bool SocketBase::IsNonBlocking() { return _IsNonBlocking; }
 
 void SocketBase::SetNonBlocking(bool NonBlock) {
-  int Flag = O_NONBLOCK;
-  if (!Flag)
-    Flag = ~Flag;
-  if (fcntl(Fd, F_SETFL, fcntl(Fd, F_GETFL) | Flag) < 0)
+  int Flags = fcntl(Fd, F_GETFL);
+  if (Flags < 0)
+    Exception::ThrowSystemError("fcntl()");
+  Flags = NonBlock ? (Flags | O_NONBLOCK) : (Flags & ~O_NONBLOCK);
+  if (fcntl(Fd, F_SETFL, Flags) < 0)
     Exception::ThrowSystemError("fcntl()");
   Log::DefaultLogger.LogDebug("Socket #", Fd, " set to ",
                               (NonBlock ? " non-" : ""), "blocking");
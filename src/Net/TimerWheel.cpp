@@ -0,0 +1,126 @@
+#include <Net/TimerWheel.hpp>
+#include <algorithm>
+
+namespace proxy {
+const char *TimeoutKindToString(TimeoutKind Kind) {
+  switch (Kind) {
+  case TimeoutKind::Connect:
+    return "connect";
+  case TimeoutKind::HeaderRead:
+    return "header read";
+  case TimeoutKind::KeepAlive:
+    return "keep-alive";
+  case TimeoutKind::Idle:
+    return "idle";
+  case TimeoutKind::Request:
+    return "request";
+  }
+  return "unknown";
+}
+
+void TimerLink::Unlink() {
+  Prev->Next = Next;
+  Next->Prev = Prev;
+  Prev = Next = this;
+}
+
+void TimerLink::LinkBefore(TimerLink *Link) {
+  Prev = Link->Prev;
+  Next = Link;
+  Link->Prev->Next = this;
+  Link->Prev = this;
+}
+
+void Timer::Cancel() {
+  if (!Wheel)
+    return;
+  Unlink();
+  Wheel->ArmedNum--;
+  Wheel = nullptr;
+}
+
+TimerWheel::TimerWheel(std::chrono::milliseconds Tick)
+    : StartTime(ClockT::now()), Tick(Tick) {}
+
+uint64_t TimerWheel::ToTick(ClockT::time_point Time) const {
+  if (Time <= StartTime)
+    return 0;
+  return std::chrono::duration_cast<std::chrono::milliseconds>(Time -
+                                                               StartTime)
+             .count() /
+         Tick.count();
+}
+
+void TimerWheel::Insert(Timer *T) {
+  // Timers beyond the top level wait in its farthest slot and are cascaded
+  // again until they fit
+  constexpr uint64_t MaxDelta = (uint64_t(1) << (LevelBits * LevelsNum)) - 1;
+  uint64_t Expiry = std::min(T->ExpiryTick, CurTick + MaxDelta);
+  uint64_t Delta = Expiry - CurTick;
+  std::size_t Level = 0;
+  while (Level + 1 < LevelsNum && Delta >= (uint64_t(1) << (LevelBits *
+                                                            (Level + 1))))
+    Level++;
+  std::size_t Slot = (Expiry >> (LevelBits * Level)) & (SlotsNum - 1);
+  T->LinkBefore(&Slots[Level][Slot]);
+}
+
+void TimerWheel::Cascade(std::size_t Level) {
+  auto &Slot = Slots[Level][(CurTick >> (LevelBits * Level)) & (SlotsNum - 1)];
+  TimerLink Pending;
+  // Moved aside first, the timers may land in the same slot again
+  while (Slot.Next != &Slot) {
+    auto *Link = Slot.Next;
+    Link->Unlink();
+    Link->LinkBefore(&Pending);
+  }
+  while (Pending.Next != &Pending) {
+    auto *T = static_cast<Timer *>(Pending.Next);
+    T->Unlink();
+    Insert(T);
+  }
+}
+
+void TimerWheel::Arm(Timer *T, TimeoutKind Kind,
+                     std::chrono::milliseconds Timeout) {
+  T->Cancel();
+  T->Kind = Kind;
+  T->Timeout = Timeout;
+  // Rounded up, so that the timer never fires early
+  auto Expiry = ClockT::now() + Timeout + Tick - std::chrono::milliseconds(1);
+  T->ExpiryTick = std::max(ToTick(Expiry), CurTick + 1);
+  T->Wheel = this;
+  ArmedNum++;
+  Insert(T);
+}
+
+void TimerWheel::Advance(ClockT::time_point Now,
+                         std::vector<Timer *> &Expired) {
+  uint64_t NowTick = ToTick(Now);
+  while (CurTick < NowTick) {
+    if (ArmedNum == 0) {
+      CurTick = NowTick;
+      return;
+    }
+    CurTick++;
+    // Higher levels go first, their timers may move to the lower slots
+    // cascaded at the same tick
+    std::size_t TopLevel = 0;
+    while (TopLevel + 1 < LevelsNum &&
+           (CurTick & ((uint64_t(1) << (LevelBits * (TopLevel + 1))) - 1)) ==
+               0)
+      TopLevel++;
+    for (std::size_t Level = TopLevel; Level > 0; Level--)
+      Cascade(Level);
+
+    auto &Slot = Slots[0][CurTick & (SlotsNum - 1)];
+    while (Slot.Next != &Slot) {
+      auto *T = static_cast<Timer *>(Slot.Next);
+      T->Cancel();
+      Expired.push_back(T);
+    }
+  }
+}
+
+std::size_t TimerWheel::GetArmedNum() const { return ArmedNum; }
+} // namespace proxy
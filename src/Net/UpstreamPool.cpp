@@ -0,0 +1,85 @@
+#include <Common/Globals.hpp>
+#include <Logging/Logger.hpp>
+#include <Net/UpstreamPool.hpp>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <sys/socket.h>
+
+namespace proxy {
+std::string UpstreamPool::MakeKey(const std::string &Host, uint16_t Port) {
+  return Host + ":" + std::to_string(Port);
+}
+
+bool UpstreamPool::IsAlive(Socket *Sock) {
+  // An idle connection must have nothing to read: EOF means the origin
+  // closed it, data means a protocol error
+  char Byte;
+  ssize_t Status = recv(Sock->GetFD(), &Byte, sizeof(Byte),
+                        MSG_PEEK | MSG_DONTWAIT);
+  return Status == -1 && (errno == EAGAIN || errno == EWOULDBLOCK);
+}
+
+void UpstreamPool::Close(IdleIterator It) {
+  auto OriginIt = ByOrigin.find(It->Key);
+  auto &Connections = OriginIt->second;
+  Connections.erase(std::find(Connections.begin(), Connections.end(), It));
+  if (Connections.empty())
+    ByOrigin.erase(OriginIt);
+  delete It->Sock;
+  Idle.erase(It);
+}
+
+Socket *UpstreamPool::Acquire(const std::string &Key) {
+  CloseExpired();
+  auto OriginIt = ByOrigin.find(Key);
+  while (OriginIt != ByOrigin.end()) {
+    auto &Connections = OriginIt->second;
+    // The most recently used connection is the least likely to be closed
+    auto It = Connections.back();
+    Connections.pop_back();
+    Socket *Sock = It->Sock;
+    Idle.erase(It);
+    if (Connections.empty()) {
+      ByOrigin.erase(OriginIt);
+      OriginIt = ByOrigin.end();
+    }
+    if (IsAlive(Sock)) {
+      Log::DefaultLogger.LogDebug("Reusing connection #", Sock->GetFD(),
+                                  " to ", Key);
+      return Sock;
+    }
+    delete Sock;
+  }
+  return nullptr;
+}
+
+void UpstreamPool::Release(const std::string &Key, Socket *Sock) {
+  CloseExpired();
+  auto OriginIt = ByOrigin.find(Key);
+  if (OriginIt != ByOrigin.end() &&
+      OriginIt->second.size() >= Globals::UpstreamMaxIdlePerOrigin)
+    Close(OriginIt->second.front());
+  if (Idle.size() >= Globals::UpstreamMaxIdleTotal)
+    Close(Idle.begin());
+
+  Idle.push_back({Key, Sock, SocketBase::ClockT::now()});
+  ByOrigin[Key].push_back(std::prev(Idle.end()));
+  Log::DefaultLogger.LogDebug("Connection #", Sock->GetFD(), " to ", Key,
+                              " is idle");
+}
+
+void UpstreamPool::CloseExpired() {
+  auto Now = SocketBase::ClockT::now();
+  auto Timeout = std::chrono::seconds(Globals::UpstreamIdleTimeoutSec);
+  while (!Idle.empty() && Now - Idle.front().ReleaseTime >= Timeout)
+    Close(Idle.begin());
+}
+
+std::size_t UpstreamPool::GetIdleNum() const { return Idle.size(); }
+
+UpstreamPool::~UpstreamPool() {
+  for (auto &Connection : Idle)
+    delete Connection.Sock;
+}
+} // namespace proxy
@@ -0,0 +1,192 @@
+#include <Common/ProxyException.hpp>
+#include <Functional/Function.hpp>
+#include <Logging/Logger.hpp>
+#include <Parallel/ThreadPool.hpp>
+#include <climits>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#else
+#include <sched.h>
+#endif
+
+namespace proxy {
+namespace {
+thread_local const ThreadPool *CurrentPool = nullptr;
+thread_local std::size_t CurrentWorkerIdx = 0;
+
+void FutexWait(std::atomic<uint32_t> *Addr, uint32_t Expected) {
+#ifdef __linux__
+  // Spurious wakeups and EAGAIN are fine, the caller rechecks for tasks
+  syscall(SYS_futex, reinterpret_cast<uint32_t *>(Addr), FUTEX_WAIT_PRIVATE,
+          Expected, nullptr, nullptr, 0);
+#else
+  if (Addr->load(std::memory_order_acquire) == Expected)
+    sched_yield();
+#endif
+}
+
+void FutexWake(std::atomic<uint32_t> *Addr, int WaitersNum) {
+#ifdef __linux__
+  syscall(SYS_futex, reinterpret_cast<uint32_t *>(Addr), FUTEX_WAKE_PRIVATE,
+          WaitersNum, nullptr, nullptr, 0);
+#endif
+}
+} // namespace
+
+ThreadPool::ThreadPool(std::size_t ThreadsNum) {
+  if (ThreadsNum == 0) {
+    long CPUsNum = sysconf(_SC_NPROCESSORS_ONLN);
+    ThreadsNum = CPUsNum > 0 ? static_cast<std::size_t>(CPUsNum) : 1;
+  }
+  for (std::size_t i = 0; i < ThreadsNum; i++)
+    Workers.push_back(std::make_unique<Worker>());
+  // Workers may steal from each other as soon as they start, so all of them
+  // have to exist by then
+  for (std::size_t i = 0; i < ThreadsNum; i++) {
+    Workers[i]->WorkerThread =
+        Thread(Function(&ThreadPool::WorkerRoutine, this, std::size_t(i)));
+    Workers[i]->WorkerThread.StartThread();
+  }
+}
+
+std::size_t ThreadPool::GetThreadsNum() const { return Workers.size(); }
+
+void ThreadPool::SubmitTask(ThreadPoolTask *Task) {
+  Push(Task);
+  NotifyWorkers(1);
+}
+
+void ThreadPool::Push(ThreadPoolTask *Task) {
+  if (CurrentPool == this) {
+    Workers[CurrentWorkerIdx]->Tasks.Push(Task);
+    return;
+  }
+  ThreadPoolTask *Head = Injected.load(std::memory_order_relaxed);
+  do {
+    Task->Next = Head;
+  } while (!Injected.compare_exchange_weak(Head, Task,
+                                           std::memory_order_release,
+                                           std::memory_order_relaxed));
+}
+
+void ThreadPool::NotifyWorkers(int WaitersNum) {
+  WakeupSeq.fetch_add(1, std::memory_order_seq_cst);
+  if (WaitersNum == INT_MAX || SleepersNum.load(std::memory_order_seq_cst) > 0)
+    FutexWake(&WakeupSeq, WaitersNum);
+}
+
+ThreadPoolTask *ThreadPool::TakeInjected(Worker &W) {
+  if (!Injected.load(std::memory_order_relaxed))
+    return nullptr;
+  // Grab the whole queue at once, so there is no ABA problem to deal with
+  ThreadPoolTask *Head = Injected.exchange(nullptr, std::memory_order_acquire);
+  if (!Head)
+    return nullptr;
+
+  // Tasks are linked newest first. Pushing them in that order leaves the
+  // next oldest at the bottom to be popped and the newest ones to be stolen,
+  // the oldest one is run right away
+  int PushedNum = 0;
+  while (Head->Next) {
+    auto *Next = Head->Next;
+    W.Tasks.Push(Head);
+    Head = Next;
+    PushedNum++;
+  }
+  // Other workers may be sleeping while the batch sits in this deque
+  if (PushedNum > 0)
+    NotifyWorkers(PushedNum);
+  return Head;
+}
+
+ThreadPoolTask *ThreadPool::FindTask(std::size_t Idx,
+                                     std::size_t &NextVictim) {
+  auto &W = *Workers[Idx];
+  if (auto *Task = W.Tasks.Pop())
+    return Task;
+  if (auto *Task = TakeInjected(W))
+    return Task;
+
+  std::size_t WorkersNum = Workers.size();
+  for (std::size_t i = 0; i + 1 < WorkersNum; i++) {
+    std::size_t Victim = NextVictim++ % WorkersNum;
+    if (Victim == Idx)
+      Victim = NextVictim++ % WorkersNum;
+    if (auto *Task = Workers[Victim]->Tasks.Steal())
+      return Task;
+  }
+  return nullptr;
+}
+
+bool ThreadPool::HasTasks() const {
+  if (Injected.load(std::memory_order_acquire))
+    return true;
+  for (auto &W : Workers)
+    if (!W->Tasks.Empty())
+      return true;
+  return false;
+}
+
+void ThreadPool::RunTask(ThreadPoolTask *Task) {
+  std::unique_ptr<ThreadPoolTask> Guard(Task);
+  try {
+    Task->Run();
+  } catch (const std::exception &E) {
+    Log::DefaultLogger.LogError("[ThreadPool] Task failed: ", E.what());
+  }
+}
+
+void ThreadPool::WorkerRoutine(std::size_t Idx) {
+  ThisThread::BlockInterruptionSignals();
+  CurrentPool = this;
+  CurrentWorkerIdx = Idx;
+  // Pop from the bottom of the own deque reuses whatever the last task left
+  // in cache, victims are visited round-robin to spread the contention
+  std::size_t NextVictim = Idx + 1;
+
+  while (true) {
+    uint32_t Seq = WakeupSeq.load(std::memory_order_acquire);
+    if (auto *Task = FindTask(Idx, NextVictim)) {
+      RunTask(Task);
+      continue;
+    }
+
+    // Only the owner pushes to a deque and it pops everything it pushed
+    // before leaving, so whatever is left belongs to a worker that is still
+    // running and there is no point in spinning for it
+    if (IsStopping.load(std::memory_order_acquire))
+      break;
+
+    // Submitters bump WakeupSeq after pushing, so a task that arrived after
+    // the scan above makes the wait return immediately
+    SleepersNum.fetch_add(1, std::memory_order_seq_cst);
+    if (!HasTasks())
+      FutexWait(&WakeupSeq, Seq);
+    SleepersNum.fetch_sub(1, std::memory_order_relaxed);
+  }
+
+  CurrentPool = nullptr;
+}
+
+void ThreadPool::Stop() {
+  IsStopping.store(true, std::memory_order_release);
+  NotifyWorkers(INT_MAX);
+  for (auto &W : Workers)
+    if (W->WorkerThread.Joinable())
+      W->WorkerThread.Join();
+}
+
+ThreadPool::~ThreadPool() {
+  Stop();
+  // Tasks submitted after the workers were gone
+  ThreadPoolTask *Task = Injected.exchange(nullptr);
+  while (Task) {
+    auto *Next = Task->Next;
+    delete Task;
+    Task = Next;
+  }
+}
+} // namespace proxy
@@ -0,0 +1,108 @@
+#include <Cache/Cache.hpp>
+#include <iostream>
+#include <string>
+
+using namespace proxy;
+
+static int FailuresNum = 0;
+
+static void Check(bool Cond, const std::string &What) {
+  if (Cond)
+    return;
+  std::cerr << "FAILED: " << What << "\n";
+  FailuresNum++;
+}
+
+// Updates aren't delivered, the records are inspected directly
+class NullWakeupQueue : public CacheWakeupQueue {
+public:
+  void WakeupListeners(CacheListener *const *, std::size_t) override {}
+};
+
+class TestListener : public CacheListener {
+private:
+  NullWakeupQueue *Queue;
+
+public:
+  CacheRecord *Record = nullptr;
+
+  explicit TestListener(NullWakeupQueue *Queue) : Queue(Queue) {}
+
+  void OnCacheRecordAttach(CacheRecord *Attached) override {
+    Record = Attached;
+  }
+  void OnCacheWakeup() override {}
+  CacheWakeupQueue *GetWakeupQueue() override { return Queue; }
+
+  void Detach() {
+    if (Record)
+      Record->RemoveListener(this);
+    Record = nullptr;
+  }
+};
+
+static Freshness GetFreshness(const std::string &CacheControl) {
+  CacheHeaders Headers;
+  Headers.CacheControl = CacheControl;
+  return Freshness::FromHeaders(Headers, 200, Freshness::Now());
+}
+
+// Two overlapping requests for a response the origin marks as private
+static void TestPrivateResponse(Cache &C, NullWakeupQueue &Queue) {
+  const std::string URI = "example.com/private:80";
+  TestListener First(&Queue), Second(&Queue), Third(&Queue);
+  CacheRecordPtr Download;
+  Check(C.AddListener(URI, &First, Download) && Download &&
+            First.Record == Download.Get(),
+        "first request downloads the record");
+
+  CacheRecordPtr Joined;
+  Check(!C.AddListener(URI, &Second, Joined) && !Joined && !Second.Record,
+        "no joining before the headers are parsed");
+
+  Download->SetFreshness(GetFreshness("private, max-age=60"));
+  Check(!C.AddListener(URI, &Second, Joined) && !Joined && !Second.Record,
+        "no joining a private response");
+
+  Download->SetComplete(true);
+  Download->Finish();
+  CacheRecordPtr Refetch;
+  Check(C.AddListener(URI, &Third, Refetch) && Refetch &&
+            Refetch.Get() != Download.Get() &&
+            Third.Record == Refetch.Get(),
+        "finished private response is downloaded again");
+  Refetch->Finish();
+  First.Detach();
+  Third.Detach();
+}
+
+static void TestSharedResponse(Cache &C, NullWakeupQueue &Queue) {
+  const std::string URI = "example.com/public:80";
+  TestListener First(&Queue), Second(&Queue);
+  CacheRecordPtr Download;
+  Check(C.AddListener(URI, &First, Download) && Download,
+        "first request downloads the record");
+
+  Download->SetFreshness(GetFreshness("max-age=60"));
+  CacheRecordPtr Joined;
+  Check(C.AddListener(URI, &Second, Joined) && !Joined &&
+            Second.Record == Download.Get(),
+        "storable response is joined while it's downloaded");
+  Download->SetComplete(true);
+  Download->Finish();
+  First.Detach();
+  Second.Detach();
+}
+
+int main() {
+  NullWakeupQueue Queue;
+  Cache C(1 << 20, EvictionPolicyType::LRU);
+  TestPrivateResponse(C, Queue);
+  TestSharedResponse(C, Queue);
+  if (FailuresNum) {
+    std::cerr << FailuresNum << " checks failed\n";
+    return 1;
+  }
+  std::cout << "All checks passed\n";
+  return 0;
+}
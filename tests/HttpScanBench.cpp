@@ -0,0 +1,125 @@
+#include <Net/HttpScan.hpp>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace proxy;
+
+// Heads as sent by common clients and origins
+static const char *const Heads[] = {
+    "GET https://www.example.com/assets/app.3f9c2a.js HTTP/1.1\r\n"
+    "Host: www.example.com\r\n"
+    "Connection: keep-alive\r\n"
+    "sec-ch-ua: \"Chromium\";v=\"118\", \"Google Chrome\";v=\"118\", "
+    "\"Not=A?Brand\";v=\"99\"\r\n"
+    "sec-ch-ua-mobile: ?0\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 "
+    "(KHTML, like Gecko) Chrome/118.0.0.0 Safari/537.36\r\n"
+    "sec-ch-ua-platform: \"Linux\"\r\n"
+    "Accept: */*\r\n"
+    "Sec-Fetch-Site: same-origin\r\n"
+    "Sec-Fetch-Mode: no-cors\r\n"
+    "Sec-Fetch-Dest: script\r\n"
+    "Referer: https://www.example.com/\r\n"
+    "Accept-Encoding: gzip, deflate, br\r\n"
+    "Accept-Language: en-US,en;q=0.9\r\n"
+    "Cookie: _ga=GA1.2.1234567890.1697000000; session=eyJhbGciOiJIUzI1NiJ9."
+    "eyJzdWIiOiIxMjM0NTY3ODkwIn0.dGhpcyBpcyBub3QgYSByZWFsIHRva2Vu; "
+    "theme=dark\r\n"
+    "\r\n",
+
+    "GET http://example.org/index.html HTTP/1.1\r\n"
+    "Host: example.org\r\n"
+    "User-Agent: curl/8.4.0\r\n"
+    "Accept: */*\r\n"
+    "Proxy-Connection: Keep-Alive\r\n"
+    "\r\n",
+
+    "HTTP/1.1 200 OK\r\n"
+    "Date: Tue, 17 Oct 2023 10:12:45 GMT\r\n"
+    "Content-Type: application/javascript; charset=utf-8\r\n"
+    "Content-Length: 184231\r\n"
+    "Connection: keep-alive\r\n"
+    "Cache-Control: public, max-age=31536000, immutable\r\n"
+    "ETag: \"5f1c9e3a-2cfa7\"\r\n"
+    "Last-Modified: Mon, 16 Oct 2023 08:00:00 GMT\r\n"
+    "Vary: Accept-Encoding\r\n"
+    "Server: nginx/1.24.0\r\n"
+    "Strict-Transport-Security: max-age=63072000; includeSubDomains\r\n"
+    "X-Content-Type-Options: nosniff\r\n"
+    "Access-Control-Allow-Origin: *\r\n"
+    "Accept-Ranges: bytes\r\n"
+    "\r\n",
+
+    "HTTP/1.1 304 Not Modified\r\n"
+    "Date: Tue, 17 Oct 2023 10:12:46 GMT\r\n"
+    "ETag: \"5f1c9e3a-2cfa7\"\r\n"
+    "Cache-Control: max-age=600\r\n"
+    "\r\n",
+};
+
+// Scans every line of the head the way RequestParser does
+static std::size_t ScanLines(const std::string &Head) {
+  const char *P = Head.data();
+  const char *End = P + Head.size();
+  std::size_t Found = 0;
+  while (P != End) {
+    auto Scan = HttpScan::ScanLine(P, End);
+    if (!Scan.LineEnd)
+      break;
+    Found += (Scan.Colon != nullptr) + (Scan.Ctl != nullptr);
+    P = Scan.LineEnd + 1;
+  }
+  return Found;
+}
+
+static std::size_t FindHeadEnd(const std::string &Head) {
+  auto *HeadEnd = HttpScan::FindHeadEnd(Head.data(), Head.data() + Head.size());
+  return HeadEnd ? HeadEnd - Head.data() : 0;
+}
+
+template <typename ScanT>
+static double TimeNsPerHead(const std::vector<std::string> &Corpus,
+                            std::size_t Rounds, ScanT Scan) {
+  // Keeps the scans from being optimized out
+  volatile std::size_t Sink = 0;
+  auto Start = std::chrono::steady_clock::now();
+  for (std::size_t i = 0; i < Rounds; i++)
+    for (const auto &Head : Corpus)
+      Sink = Sink + Scan(Head);
+  std::chrono::duration<double, std::nano> Elapsed =
+      std::chrono::steady_clock::now() - Start;
+  return Elapsed.count() / (Rounds * Corpus.size());
+}
+
+// Usage: http-scan-bench [ROUNDS]
+int main(int argc, char const *argv[]) {
+  std::size_t Rounds = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 200000;
+  std::vector<std::string> Corpus(std::begin(Heads), std::end(Heads));
+  std::size_t Bytes = 0;
+  for (const auto &Head : Corpus)
+    Bytes += Head.size();
+  double BytesPerHead = static_cast<double>(Bytes) / Corpus.size();
+
+  auto Detected = HttpScan::GetLevel();
+  std::cout << Corpus.size() << " heads, " << BytesPerHead
+            << " bytes on average, " << Rounds << " rounds\n";
+  for (auto L : {HttpScan::Level::Scalar, HttpScan::Level::SSE2,
+                 HttpScan::Level::AVX2}) {
+    const char *Name = HttpScan::LevelToString(L);
+    if (!HttpScan::SetLevel(L)) {
+      std::cout << Name << ": not supported by the CPU\n";
+      continue;
+    }
+    double LinesNs = TimeNsPerHead(Corpus, Rounds, ScanLines);
+    double HeadEndNs = TimeNsPerHead(Corpus, Rounds, FindHeadEnd);
+    std::cout << Name << ": ScanLine " << LinesNs << " ns/head ("
+              << BytesPerHead / LinesNs << " GB/s), FindHeadEnd "
+              << HeadEndNs << " ns/head (" << BytesPerHead / HeadEndNs
+              << " GB/s)\n";
+  }
+  HttpScan::SetLevel(Detected);
+  return 0;
+}
@@ -0,0 +1,93 @@
+#include <Net/HttpScan.hpp>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+
+using namespace proxy;
+
+static int FailuresNum = 0;
+
+static void Check(bool Cond, const std::string &What) {
+  if (Cond)
+    return;
+  std::cerr << "FAILED: " << What << "\n";
+  FailuresNum++;
+}
+
+// Results as offsets from the start of the range, -1 for nullptr
+struct ScanResult {
+  long LineEnd;
+  long Colon;
+  long Ctl;
+  long FoundLineEnd;
+  long HeadEnd;
+
+  bool operator==(const ScanResult &Other) const {
+    return LineEnd == Other.LineEnd && Colon == Other.Colon &&
+           Ctl == Other.Ctl && FoundLineEnd == Other.FoundLineEnd &&
+           HeadEnd == Other.HeadEnd;
+  }
+};
+
+static long ToOffset(const char *P, const char *Begin) {
+  return P ? P - Begin : -1;
+}
+
+static ScanResult Scan(const char *Begin, const char *End) {
+  auto Line = HttpScan::ScanLine(Begin, End);
+  return {ToOffset(Line.LineEnd, Begin), ToOffset(Line.Colon, Begin),
+          ToOffset(Line.Ctl, Begin),
+          ToOffset(HttpScan::FindLineEnd(Begin, End), Begin),
+          ToOffset(HttpScan::FindHeadEnd(Begin, End), Begin)};
+}
+
+// Compares the kernels of the level against the scalar ones on random
+// ranges at every alignment. Each range is copied to a buffer of its exact
+// size, so that reads past it are caught by the sanitizers.
+static void TestLevel(HttpScan::Level L) {
+  std::string Name = HttpScan::LevelToString(L);
+  if (!HttpScan::SetLevel(L)) {
+    std::cout << "Skipping " << Name << ", not supported by the CPU\n";
+    return;
+  }
+  Check(HttpScan::GetLevel() == L, "level is set to " + Name);
+  // Mostly text with delimiters and control characters mixed in
+  const char Alphabet[] = "abcdefgh\r\n\r\n::\t \x01\x7f\x80\xff";
+  std::mt19937 Rng(1);
+  for (int i = 0; i < 20000; i++) {
+    std::size_t Size = Rng() % 160;
+    std::size_t Offset = Rng() % 32;
+    std::unique_ptr<char[]> Buf(new char[Offset + Size]);
+    char *Begin = Buf.get() + Offset;
+    // Sparse delimiters leave long runs for the vector loops
+    unsigned Density = Rng() % 4 == 0 ? 64 : 4;
+    for (std::size_t j = 0; j < Size; j++)
+      Begin[j] = Rng() % Density == 0
+                     ? Alphabet[Rng() % (sizeof(Alphabet) - 1)]
+                     : 'a' + Rng() % 26;
+
+    HttpScan::SetLevel(HttpScan::Level::Scalar);
+    auto Expected = Scan(Begin, Begin + Size);
+    HttpScan::SetLevel(L);
+    auto Actual = Scan(Begin, Begin + Size);
+    Check(Actual == Expected, Name + " differs from scalar on " +
+                                  std::string(Begin, Size));
+  }
+}
+
+int main() {
+  auto Detected = HttpScan::GetLevel();
+  std::cout << "Detected " << HttpScan::LevelToString(Detected) << "\n";
+  for (auto L : {HttpScan::Level::Scalar, HttpScan::Level::SSE2,
+                 HttpScan::Level::AVX2})
+    TestLevel(L);
+  HttpScan::SetLevel(Detected);
+  if (FailuresNum) {
+    std::cerr << FailuresNum << " checks failed\n";
+    return 1;
+  }
+  std::cout << "All checks passed\n";
+  return 0;
+}
@@ -0,0 +1,240 @@
+#include <Common/Globals.hpp>
+#include <Net/RequestParser.hpp>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace proxy;
+
+static int FailuresNum = 0;
+
+static void Check(bool Cond, const std::string &What) {
+  if (Cond)
+    return;
+  std::cerr << "FAILED: " << What << "\n";
+  FailuresNum++;
+}
+
+struct ParseResult {
+  RequestParser::Status Status = RequestParser::Status::Incomplete;
+  std::size_t HeaderSize = 0;
+  std::size_t RequestSize = 0;
+  std::string Method;
+  std::string URI;
+  std::vector<std::string> Headers;
+
+  bool operator==(const ParseResult &Other) const {
+    return Status == Other.Status && HeaderSize == Other.HeaderSize &&
+           RequestSize == Other.RequestSize && Method == Other.Method &&
+           URI == Other.URI && Headers == Other.Headers;
+  }
+};
+
+static ParseResult Collect(const RequestParser &Parser,
+                           RequestParser::Status Status) {
+  ParseResult Res;
+  Res.Status = Status;
+  if (Status != RequestParser::Status::Complete)
+    return Res;
+  Res.HeaderSize = Parser.GetHeaderSize();
+  Res.RequestSize = Parser.GetRequestSize();
+  Res.Method = std::string(Parser.GetMethod());
+  Res.URI = std::string(Parser.GetURI());
+  for (std::size_t i = 0; i < Parser.GetHeadersNum(); i++) {
+    auto Header = Parser.GetHeader(i);
+    Res.Headers.push_back(std::string(Header.Name) + ": " +
+                          std::string(Header.Value));
+  }
+  return Res;
+}
+
+// Feeds the prefixes ending at the given offsets, each one in a buffer of
+// its exact size so that reads past it are caught by the sanitizers
+static ParseResult ParseInSteps(const std::string &Request,
+                                const std::vector<std::size_t> &Offsets) {
+  RequestParser Parser;
+  auto Status = RequestParser::Status::Incomplete;
+  std::unique_ptr<char[]> Buf;
+  for (std::size_t Offset : Offsets) {
+    Buf.reset(new char[Offset ? Offset : 1]);
+    memcpy(Buf.get(), Request.data(), Offset);
+    Status = Parser.Parse(Buf.get(), Offset);
+    if (Status != RequestParser::Status::Incomplete)
+      break;
+  }
+  // The views must not outlive the buffer
+  return Collect(Parser, Status);
+}
+
+static ParseResult Parse(const std::string &Request) {
+  return ParseInSteps(Request, {Request.size()});
+}
+
+static bool IsComplete(const std::string &Request) {
+  return Parse(Request).Status == RequestParser::Status::Complete;
+}
+
+static bool IsError(const std::string &Request) {
+  return Parse(Request).Status == RequestParser::Status::Error;
+}
+
+static void CheckSplits(const std::string &Request) {
+  auto Whole = Parse(Request);
+  for (std::size_t i = 0; i <= Request.size(); i++)
+    Check(ParseInSteps(Request, {i, Request.size()}) == Whole,
+          "split at " + std::to_string(i) + " of " + Request);
+  std::vector<std::size_t> Bytewise;
+  for (std::size_t i = 0; i <= Request.size(); i++)
+    Bytewise.push_back(i);
+  Check(ParseInSteps(Request, Bytewise) == Whole, "bytewise " + Request);
+}
+
+static void TestSplits() {
+  const std::string Requests[] = {
+      "GET http://example.com/ HTTP/1.1\r\nHost: example.com\r\n\r\n",
+      "\r\n\r\nGET / HTTP/1.0\nHost: a\n\n",
+      "POST /p HTTP/1.1\r\nHost: a\r\nContent-Length: 5\r\n\r\nhello",
+      "POST /p HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n"
+      "5;ext=1\r\nhello\r\n1A\r\nabcdefghijklmnopqrstuvwxyz\r\n0\r\n"
+      "Checksum: 1\r\n\r\nGET / HTTP/1.1\r\n\r\n",
+      "POST /p HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n"
+      "3\r\n\r\n\r\n0\r\n\r\n",
+      "GET / HTTP/1.1\r\nHost: a\r\nX: \x01\r\n\r\n",
+      "GET / HTTP/1.1\r\nHost: a\r\n X: folded\r\n\r\n",
+  };
+  for (const auto &Request : Requests)
+    CheckSplits(Request);
+}
+
+static void TestFraming() {
+  auto Res = Parse("POST / HTTP/1.1\r\nContent-Length: 4\r\n\r\nab");
+  Check(Res.Status == RequestParser::Status::Complete &&
+            Res.RequestSize == Res.HeaderSize + 4,
+        "Content-Length body end");
+
+  // The last chunk inside the data doesn't end the request
+  std::string Chunked = "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n"
+                        "5\r\n0\r\n\r\n\r\n";
+  Check(!IsComplete(Chunked), "last chunk in the chunk data");
+  Chunked += "0\r\n\r\n";
+  Res = Parse(Chunked + "GET / HTTP/1.1\r\n\r\n");
+  Check(Res.Status == RequestParser::Status::Complete &&
+            Res.RequestSize == Chunked.size(),
+        "chunked body end");
+
+  Check(IsError("POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n"
+                "Content-Length: 5\r\n\r\n0\r\n\r\n"),
+        "Transfer-Encoding with Content-Length");
+  Check(IsError("POST / HTTP/1.1\r\nContent-Length: 5\r\n"
+                "Transfer-Encoding: chunked\r\n\r\n0\r\n\r\n"),
+        "Content-Length with Transfer-Encoding");
+  Check(IsError("POST / HTTP/1.1\r\nTransfer-Encoding: gzip\r\n\r\n"),
+        "final coding isn't chunked");
+  Check(IsError("POST / HTTP/1.1\r\nTransfer-Encoding: chunked, gzip\r\n\r\n"),
+        "chunked isn't final");
+  Check(IsError("POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n"
+                "Transfer-Encoding: gzip\r\n\r\n"),
+        "chunked isn't final in the last header");
+  Check(IsComplete("POST / HTTP/1.1\r\nTransfer-Encoding: gzip,Chunked\r\n"
+                   "\r\n0\r\n\r\n"),
+        "chunked after another coding");
+  Check(IsError("POST / HTTP/1.1\r\nContent-Length: 1\r\n"
+                "Content-Length: 2\r\n\r\n"),
+        "conflicting Content-Length");
+  Check(IsError("POST / HTTP/1.1\r\nContent-Length: 1x\r\n\r\n"),
+        "malformed Content-Length");
+
+  std::string Head = "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n";
+  Check(IsError(Head + "x\r\n"), "malformed chunk size");
+  Check(IsError(Head + "\r\n"), "empty chunk size");
+  Check(IsError(Head + "5 x\r\n"), "garbage after chunk size");
+  Check(IsComplete(Head + "1 ;a=b\r\nx\r\n0\r\n\r\n"), "chunk extension");
+  Check(IsError(Head + "10000000000000000\r\n"), "chunk size overflow");
+  Check(IsError(Head + "1\r\nxy\r\n"), "chunk data past its size");
+  Check(IsError(Head + "0\r\nbad trailer\r\n\r\n"), "malformed trailer");
+}
+
+static void TestLineEnds() {
+  Check(IsComplete("GET / HTTP/1.1\nHost: a\n\n"), "bare LF in the head");
+  Check(IsError("GET / HTTP/1.1\rHost: a\r\n\r\n"), "bare CR in the head");
+  Check(IsError("GET / HTTP/1.1\r\nHost: a\rb\r\n\r\n"), "bare CR in a value");
+  Check(IsError("GET / HTTP/1.1\r\nHost: a\r\r\n\r\n"), "CR before CRLF");
+  const char Nul[] = "GET / HTTP/1.1\r\nHost: a\0b\r\n\r\n";
+  Check(IsError(std::string(Nul, sizeof(Nul) - 1)), "NUL in a value");
+  Check(IsError("GET / HTTP/1.1\r\nHost: a\r\n\r\r\n"), "CR before the end");
+  std::string Head = "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n";
+  Check(IsError(Head + "1\nx\r\n0\r\n\r\n"), "bare LF after chunk size");
+  Check(IsError(Head + "1\r\nx\n0\r\n\r\n"), "bare LF after chunk data");
+  Check(IsError(Head + "0\r\n\n"), "bare LF after trailers");
+  Check(IsError(Head + "1\r\nx\r0\r\n\r\n"), "bare CR after chunk data");
+}
+
+static void TestLimits() {
+  std::string Line = "GET / HTTP/1.1\r\n";
+  std::string Filler = "X: ";
+  std::size_t Max = Globals::MaxRequestHeaderSize;
+  // Filler plus its CRLF and the final CRLF take exactly the limit
+  Filler.append(Max - Line.size() - Filler.size() - 4, 'a');
+  std::string Request = Line + Filler + "\r\n\r\n";
+  Check(Request.size() == Max && IsComplete(Request), "head at the limit");
+  Request = Line + Filler + "a\r\n\r\n";
+  Check(IsError(Request), "head past the limit");
+  Check(IsError(Line + Filler + "aaaaa"), "incomplete head past the limit");
+
+  Request = Line;
+  for (std::size_t i = 0; i < Globals::MaxRequestHeadersNum; i++)
+    Request += "X: 1\r\n";
+  Check(IsComplete(Request + "\r\n"), "headers number at the limit");
+  Check(IsError(Request + "X: 1\r\n\r\n"), "too many headers");
+
+  std::string Head = "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n";
+  // Chunk data isn't limited, the lines around it are
+  std::string Data(Max * 2, 'd');
+  char Size[32];
+  snprintf(Size, sizeof(Size), "%zx\r\n", Data.size());
+  Check(IsComplete(Head + Size + Data + "\r\n0\r\n\r\n"), "large chunk");
+  Check(IsError(Head + "1;" + std::string(Max, 'e') + "\r\n"),
+        "chunk line past the limit");
+  Check(IsError(Head + "1;" + std::string(Max, 'e')),
+        "incomplete chunk line past the limit");
+  Check(IsError(Head + "0\r\nX: " + std::string(Max, 't') + "\r\n\r\n"),
+        "trailers past the limit");
+}
+
+// Mutated requests must parse the same however they are split
+static void TestMutations() {
+  const std::string Seed =
+      "POST /p HTTP/1.1\r\nHost: a\r\nTransfer-Encoding: chunked\r\n\r\n"
+      "4\r\nabcd\r\n0\r\nT: 1\r\n\r\n";
+  const char Alphabet[] = "\r\n :;0aF\t\x01";
+  std::mt19937 Rng(1);
+  for (int i = 0; i < 2000; i++) {
+    std::string Request = Seed;
+    for (int j = Rng() % 4; j >= 0; j--) {
+      std::size_t Pos = Rng() % Request.size();
+      Request[Pos] = Alphabet[Rng() % (sizeof(Alphabet) - 1)];
+    }
+    auto Whole = Parse(Request);
+    std::size_t Split = Rng() % (Request.size() + 1);
+    Check(ParseInSteps(Request, {Split, Request.size()}) == Whole,
+          "mutated split at " + std::to_string(Split) + " of " + Request);
+  }
+}
+
+int main() {
+  TestSplits();
+  TestFraming();
+  TestLineEnds();
+  TestLimits();
+  TestMutations();
+  if (FailuresNum) {
+    std::cerr << FailuresNum << " checks failed\n";
+    return 1;
+  }
+  std::cout << "All checks passed\n";
+  return 0;
+}
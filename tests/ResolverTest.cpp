@@ -0,0 +1,364 @@
+#include <Net/DNSClient.hpp>
+#include <Net/Resolver.hpp>
+#include <Parallel/ThreadPool.hpp>
+#include <arpa/inet.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <netinet/in.h>
+#include <poll.h>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using namespace proxy;
+
+static int FailuresNum = 0;
+
+static void Check(bool Cond, const std::string &What) {
+  if (Cond)
+    return;
+  std::cerr << "FAILED: " << What << "\n";
+  FailuresNum++;
+}
+
+static std::string ToString(const ResolvedAddress &Address) {
+  char Buf[INET6_ADDRSTRLEN] = "";
+  if (Address.Addr.ss_family == AF_INET)
+    inet_ntop(AF_INET,
+              &reinterpret_cast<const sockaddr_in *>(&Address.Addr)->sin_addr,
+              Buf, sizeof(Buf));
+  else
+    inet_ntop(
+        AF_INET6,
+        &reinterpret_cast<const sockaddr_in6 *>(&Address.Addr)->sin6_addr, Buf,
+        sizeof(Buf));
+  return Buf;
+}
+
+static std::string ToString(const std::vector<ResolvedAddress> &Addresses) {
+  std::string Result;
+  for (const auto &Address : Addresses)
+    Result += (Result.empty() ? "" : " ") + ToString(Address);
+  return Result;
+}
+
+// Answers the queries on a loopback UDP socket with canned responses picked
+// by the queried name
+class StubNameServer {
+private:
+  struct Record {
+    uint16_t Type;
+    std::string Address;
+    uint32_t TTL;
+  };
+
+  int FD = -1;
+  uint16_t Port = 0;
+  std::atomic<bool> IsStopping{false};
+  std::mutex QueriesMutex;
+  std::map<std::string, int> QueriesNum;
+  std::thread ServerThread;
+
+  static void AppendU16(std::vector<uint8_t> &Bytes, uint16_t Value) {
+    Bytes.push_back(static_cast<uint8_t>(Value >> 8));
+    Bytes.push_back(static_cast<uint8_t>(Value & 0xff));
+  }
+
+  static void AppendU32(std::vector<uint8_t> &Bytes, uint32_t Value) {
+    AppendU16(Bytes, static_cast<uint16_t>(Value >> 16));
+    AppendU16(Bytes, static_cast<uint16_t>(Value & 0xffff));
+  }
+
+  static std::vector<Record> GetRecords(const std::string &Name,
+                                        uint16_t &Flags) {
+    if (Name == "a.test")
+      return {{1, "192.0.2.1", 300}, {1, "192.0.2.2", 100},
+              {28, "2001:db8::1", 200}};
+    if (Name == "v6.test")
+      return {{28, "2001:db8::2", 300}};
+    if (Name == "short.test")
+      return {{1, "192.0.2.3", 1}};
+    if (Name == "slow.test") {
+      std::this_thread::sleep_for(std::chrono::milliseconds(200));
+      return {{1, "192.0.2.4", 300}};
+    }
+    if (Name == "trunc.test")
+      Flags |= 0x0200;
+    else
+      Flags |= 3; // NXDOMAIN
+    return {};
+  }
+
+  void Answer(const uint8_t *Query, std::size_t Size,
+              const sockaddr_in &Client) {
+    if (Size < 17)
+      return;
+    std::string Name;
+    std::size_t Offset = 12;
+    while (Offset < Size && Query[Offset] != 0) {
+      uint8_t Length = Query[Offset];
+      if (!Name.empty())
+        Name += '.';
+      Name.append(reinterpret_cast<const char *>(Query + Offset + 1), Length);
+      Offset += Length + 1;
+    }
+    std::size_t QuestionEnd = Offset + 5;
+    if (QuestionEnd > Size)
+      return;
+    uint16_t Type = static_cast<uint16_t>((Query[Offset + 1] << 8) |
+                                          Query[Offset + 2]);
+    {
+      std::lock_guard<std::mutex> G(QueriesMutex);
+      QueriesNum[Name + (Type == 1 ? "/A" : "/AAAA")]++;
+    }
+
+    uint16_t Flags = 0x8180;
+    auto Records = GetRecords(Name, Flags);
+    std::vector<uint8_t> Response(Query, Query + 2);
+    AppendU16(Response, Flags);
+    AppendU16(Response, 1);
+    std::size_t AnswersNumPos = Response.size();
+    AppendU16(Response, 0);
+    AppendU16(Response, 0);
+    AppendU16(Response, 0);
+    Response.insert(Response.end(), Query + 12, Query + QuestionEnd);
+    uint16_t AnswersNum = 0;
+    for (const auto &R : Records) {
+      if (R.Type != Type)
+        continue;
+      uint8_t Data[16];
+      int Family = Type == 1 ? AF_INET : AF_INET6;
+      inet_pton(Family, R.Address.c_str(), Data);
+      AppendU16(Response, 0xc00c); // Points to the question name
+      AppendU16(Response, Type);
+      AppendU16(Response, 1);
+      AppendU32(Response, R.TTL);
+      AppendU16(Response, Type == 1 ? 4 : 16);
+      Response.insert(Response.end(), Data, Data + (Type == 1 ? 4 : 16));
+      AnswersNum++;
+    }
+    Response[AnswersNumPos] = static_cast<uint8_t>(AnswersNum >> 8);
+    Response[AnswersNumPos + 1] = static_cast<uint8_t>(AnswersNum & 0xff);
+    sendto(FD, Response.data(), Response.size(), 0,
+           reinterpret_cast<const sockaddr *>(&Client), sizeof(Client));
+  }
+
+  void ServerRoutine() {
+    uint8_t Query[512];
+    while (!IsStopping) {
+      struct pollfd PollFD {
+        FD, POLLIN, 0
+      };
+      if (poll(&PollFD, 1, 50) <= 0)
+        continue;
+      sockaddr_in Client;
+      socklen_t ClientLen = sizeof(Client);
+      ssize_t Received =
+          recvfrom(FD, Query, sizeof(Query), 0,
+                   reinterpret_cast<sockaddr *>(&Client), &ClientLen);
+      if (Received > 0)
+        Answer(Query, Received, Client);
+    }
+  }
+
+public:
+  StubNameServer() {
+    FD = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    sockaddr_in Addr;
+    memset(&Addr, 0, sizeof(Addr));
+    Addr.sin_family = AF_INET;
+    Addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t AddrLen = sizeof(Addr);
+    if (FD == -1 ||
+        bind(FD, reinterpret_cast<sockaddr *>(&Addr), sizeof(Addr)) == -1 ||
+        getsockname(FD, reinterpret_cast<sockaddr *>(&Addr), &AddrLen) == -1) {
+      perror("Couldn't start the stub name server");
+      exit(1);
+    }
+    Port = ntohs(Addr.sin_port);
+    ServerThread = std::thread(&StubNameServer::ServerRoutine, this);
+  }
+
+  ~StubNameServer() {
+    IsStopping = true;
+    ServerThread.join();
+    close(FD);
+  }
+
+  std::string GetAddress() const {
+    return "127.0.0.1:" + std::to_string(Port);
+  }
+
+  int GetQueriesNum(const std::string &Query) {
+    std::lock_guard<std::mutex> G(QueriesMutex);
+    return QueriesNum[Query];
+  }
+};
+
+class TestListener : public ResolveListener {
+private:
+  std::mutex ResultMutex;
+  std::condition_variable ResultCond;
+  ResolvedHostPtr Result;
+  int CallsNum = 0;
+
+public:
+  void OnResolved(ResolvedHostPtr Host) override {
+    std::lock_guard<std::mutex> G(ResultMutex);
+    Result = std::move(Host);
+    CallsNum++;
+    ResultCond.notify_all();
+  }
+
+  ResolvedHostPtr Wait() {
+    std::unique_lock<std::mutex> G(ResultMutex);
+    ResultCond.wait_for(G, std::chrono::seconds(10),
+                        [this] { return CallsNum > 0; });
+    return Result;
+  }
+
+  int GetCallsNum() {
+    std::lock_guard<std::mutex> G(ResultMutex);
+    return CallsNum;
+  }
+};
+
+static void TestDNSClient(StubNameServer &Stub) {
+  DNSClient Client(Stub.GetAddress());
+
+  auto Answer = Client.Query("a.test");
+  Check(ToString(Answer.Addresses) == "192.0.2.1 192.0.2.2 2001:db8::1" ||
+            ToString(Answer.Addresses) == "2001:db8::1 192.0.2.1 192.0.2.2",
+        "A and AAAA records, got " + ToString(Answer.Addresses));
+  Check(Answer.TTL == 100, "minimum TTL of the records");
+  Check(!Answer.NameError && !Answer.Truncated, "a.test flags");
+
+  Answer = Client.Query("v6.test");
+  Check(ToString(Answer.Addresses) == "2001:db8::2",
+        "AAAA record only, got " + ToString(Answer.Addresses));
+
+  Answer = Client.Query("missing.test");
+  Check(Answer.NameError && Answer.Addresses.empty(), "NXDOMAIN");
+
+  Answer = Client.Query("trunc.test");
+  Check(Answer.Truncated && Answer.Addresses.empty(), "truncated response");
+
+  bool Threw = false;
+  try {
+    DNSClient Bogus("not-an-address");
+  } catch (const std::exception &) {
+    Threw = true;
+  }
+  Check(Threw, "invalid name server address");
+}
+
+static std::string WriteHostsFile() {
+  char Path[] = "/tmp/resolver-test-hostsXXXXXX";
+  int FD = mkstemp(Path);
+  if (FD == -1) {
+    perror("Couldn't create the hosts file");
+    exit(1);
+  }
+  const char Contents[] = "# Comment line\n"
+                          "192.0.2.10 Web.Example.test web # Alias\n"
+                          "2001:db8::10\tweb.example.test\n"
+                          "not-an-address ignored.test\n";
+  if (write(FD, Contents, sizeof(Contents) - 1) !=
+      static_cast<ssize_t>(sizeof(Contents) - 1)) {
+    perror("Couldn't write the hosts file");
+    exit(1);
+  }
+  close(FD);
+  return Path;
+}
+
+static void TestHostsFile(Resolver &R) {
+  TestListener Listener;
+  auto Host = R.Resolve("web.example.test.", &Listener);
+  Check(Host && ToString(Host->Addresses) == "192.0.2.10 2001:db8::10",
+        "hosts file entry");
+  Host = R.Resolve("WEB", &Listener);
+  Check(Host && ToString(Host->Addresses) == "192.0.2.10", "hosts file alias");
+  Host = R.Resolve("[2001:db8::20]", &Listener);
+  Check(Host && ToString(Host->Addresses) == "2001:db8::20", "IPv6 literal");
+  Check(R.GetStats().Hits == 3 && R.GetStats().Misses == 0,
+        "hosts file lookups are hits");
+  Check(Listener.GetCallsNum() == 0, "no notifications for hits");
+}
+
+static void TestTTL(Resolver &R, StubNameServer &Stub) {
+  TestListener First;
+  Check(!R.Resolve("short.test", &First), "first lookup is a miss");
+  auto Host = First.Wait();
+  Check(Host && ToString(Host->Addresses) == "192.0.2.3", "short.test");
+
+  TestListener Second;
+  Check(R.Resolve("short.test", &Second) == Host, "cached before expiry");
+  Check(Stub.GetQueriesNum("short.test/A") == 1, "no query before expiry");
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(1100));
+  Check(!R.Resolve("short.test", &Second), "lookup after expiry is a miss");
+  Host = Second.Wait();
+  Check(Host && ToString(Host->Addresses) == "192.0.2.3",
+        "short.test after expiry");
+  Check(Stub.GetQueriesNum("short.test/A") == 2, "query after expiry");
+
+  TestListener Missing;
+  Check(!R.Resolve("missing.test", &Missing), "missing.test is a miss");
+  Host = Missing.Wait();
+  Check(Host && Host->Addresses.empty() && !Host->Error.empty(),
+        "NXDOMAIN is an error");
+}
+
+static void TestJoinedLookups(Resolver &R, StubNameServer &Stub) {
+  auto Before = R.GetStats();
+  TestListener First, Second;
+  // The stub delays the answer, so the second lookup joins the first one
+  Check(!R.Resolve("slow.test", &First) && !R.Resolve("Slow.Test", &Second),
+        "concurrent lookups are pending");
+  auto FirstHost = First.Wait();
+  auto SecondHost = Second.Wait();
+  Check(FirstHost && FirstHost == SecondHost, "joined lookups share a result");
+  auto After = R.GetStats();
+  Check(After.Misses - Before.Misses == 1 && After.Joined - Before.Joined == 1,
+        "second lookup joined the first one");
+  Check(Stub.GetQueriesNum("slow.test/A") == 1, "single query for both");
+  Check(First.GetCallsNum() == 1 && Second.GetCallsNum() == 1,
+        "each listener notified once");
+}
+
+int main() {
+  StubNameServer Stub;
+  TestDNSClient(Stub);
+
+  auto HostsPath = WriteHostsFile();
+  {
+    ThreadPool Pool(2);
+    ResolverConfig Cfg;
+    Cfg.HostsFile = HostsPath;
+    Cfg.NameServer = Stub.GetAddress();
+    Resolver R(&Pool, Cfg);
+    TestHostsFile(R);
+    TestTTL(R, Stub);
+    TestJoinedLookups(R, Stub);
+    Pool.Stop();
+  }
+  unlink(HostsPath.c_str());
+
+  if (FailuresNum) {
+    std::cerr << FailuresNum << " checks failed\n";
+    return 1;
+  }
+  std::cout << "All checks passed\n";
+  return 0;
+}